@@ -0,0 +1,352 @@
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "AsyncIO.h"
+
+using std::deque;
+using std::vector;
+
+bool AsyncIO::useUring = true;
+
+//
+// the io_uring of a thread: the submission and completion queues
+// shared with the kernel
+//
+struct AsyncIO::Ring {
+  int       fd;       // the descriptor returned by io_uring_setup
+  unsigned* sqHead;   // the next submission the kernel takes (kernel-owned)
+  unsigned* sqTail;   // the next free submission slot (ours)
+  unsigned  sqMask;
+  unsigned* sqArray;  // submission slot -> index of its sqe
+  unsigned* cqHead;   // the next completion to take (ours)
+  unsigned* cqTail;   // the next completion slot the kernel fills (kernel-owned)
+  unsigned  cqMask;
+  struct io_uring_sqe* sqes;
+  struct io_uring_cqe* cqes;
+  void*     sqRing;   // the mapped queues
+  size_t    sqRingSize;
+  void*     cqRing;   // the same as sqRing if the kernel maps both at once
+  size_t    cqRingSize;
+  size_t    sqesSize;
+};
+
+static pthread_once_t ringOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t  ringKey;     // the ring of each thread
+static bool           ringBroken;  // io_uring could not be set up. do not retry
+
+//
+// the fallback thread pool
+//
+struct Batch {
+  vector<AsyncIO::Request*> completed;  // done, but not reported to the caller yet
+  pthread_cond_t            ready;      // signaled when a request is done
+};
+
+struct Job {
+  AsyncIO::Request* req;
+  Batch*            batch;
+};
+
+static pthread_once_t  poolOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t poolLatch = PTHREAD_MUTEX_INITIALIZER;  // protects jobs and batches
+static pthread_cond_t  poolWork = PTHREAD_COND_INITIALIZER;    // signaled when jobs are added
+static deque<Job>*     jobs;         // requests waiting for a worker
+static int             workerCount;  // # of workers that could be started
+
+// transfer the rest of a request with pread()/pwrite(), starting
+// after the first done bytes. a read stops at the end of the file.
+// return the # of bytes transferred in total, or -1 on an error.
+static ssize_t transfer(AsyncIO::Request& req, size_t done)
+{
+  while (done < req.length) {
+    ssize_t len = req.write ?
+      ::pwrite(req.fd, req.buffer + done, req.length - done, req.offset + done) :
+      ::pread(req.fd, req.buffer + done, req.length - done, req.offset + done);
+    if (len < 0 && errno == EINTR) continue;
+    if (len < 0) return -1;
+    if (len == 0) break;
+    done += len;
+  }
+  return (ssize_t)done;
+}
+
+// report a completed request to the caller.
+// return the error code of the request. 0 if no error
+static RC report(AsyncIO::Request& req, AsyncIO::Completion done, void* arg)
+{
+  RC rc = 0;
+
+  // a short read is the end of the file, but a short write is an error
+  if (req.result < 0 || (req.write && (size_t)req.result != req.length)) {
+    rc = req.write ? RC_FILE_WRITE_FAILED : RC_FILE_READ_FAILED;
+  }
+  if (done != NULL) done(req, arg);
+  return rc;
+}
+
+static void* work(void*)
+{
+  pthread_mutex_lock(&poolLatch);
+  for (;;) {
+    while (jobs->empty()) pthread_cond_wait(&poolWork, &poolLatch);
+    Job job = jobs->front();
+    jobs->pop_front();
+    pthread_mutex_unlock(&poolLatch);
+
+    job.req->result = transfer(*job.req, 0);
+
+    pthread_mutex_lock(&poolLatch);
+    job.batch->completed.push_back(job.req);
+    pthread_cond_signal(&job.batch->ready);
+  }
+  return NULL;
+}
+
+static void startWorkers()
+{
+  // the workers run until the program exits, so the queue is never freed
+  jobs = new deque<Job>;
+  for (int i = 0; i < AsyncIO::WORKER_COUNT; i++) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, work, NULL) != 0) break;
+    pthread_detach(thread);
+    workerCount++;
+  }
+}
+
+RC AsyncIO::run(Request* reqs, int n, Completion done, void* arg)
+{
+  if (n <= 0) return 0;
+
+  // a single request has nothing to overlap with
+  if (n == 1) {
+    reqs[0].result = transfer(reqs[0], 0);
+    return report(reqs[0], done, arg);
+  }
+
+  Ring* ring = useUring ? ringOfThread() : NULL;
+  if (ring != NULL) return runRing(*ring, reqs, n, done, arg);
+  return runPool(reqs, n, done, arg);
+}
+
+bool AsyncIO::isUring()
+{
+  return useUring && ringOfThread() != NULL;
+}
+
+void AsyncIO::makeRingKey()
+{
+  pthread_key_create(&ringKey, closeRing);
+}
+
+AsyncIO::Ring* AsyncIO::setupRing()
+{
+  struct io_uring_params params;
+  Ring* ring = new Ring;
+
+  memset(ring, 0, sizeof(*ring));
+  memset(&params, 0, sizeof(params));
+  ring->fd = (int)::syscall(__NR_io_uring_setup, QUEUE_DEPTH, &params);
+  if (ring->fd < 0) { delete ring; return NULL; }
+
+  // map the queues. newer kernels map both rings with one mmap()
+  ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single && ring->cqRingSize > ring->sqRingSize) ring->sqRingSize = ring->cqRingSize;
+
+  ring->sqRing = ::mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (ring->sqRing == MAP_FAILED) ring->sqRing = NULL;
+  if (single) {
+    ring->cqRing = ring->sqRing;
+  } else {
+    ring->cqRing = ::mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cqRing == MAP_FAILED) ring->cqRing = NULL;
+  }
+  ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  void* sqes = ::mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  ring->sqes = (sqes == MAP_FAILED) ? NULL : (struct io_uring_sqe*)sqes;
+
+  if (ring->sqRing == NULL || ring->cqRing == NULL || ring->sqes == NULL) {
+    closeRing(ring);
+    return NULL;
+  }
+
+  char* sq = (char*)ring->sqRing;
+  char* cq = (char*)ring->cqRing;
+  ring->sqHead = (unsigned*)(sq + params.sq_off.head);
+  ring->sqTail = (unsigned*)(sq + params.sq_off.tail);
+  ring->sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+  ring->sqArray = (unsigned*)(sq + params.sq_off.array);
+  ring->cqHead = (unsigned*)(cq + params.cq_off.head);
+  ring->cqTail = (unsigned*)(cq + params.cq_off.tail);
+  ring->cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+  return ring;
+}
+
+void AsyncIO::closeRing(void* p)
+{
+  Ring* ring = (Ring*)p;
+
+  if (ring->sqes != NULL) ::munmap(ring->sqes, ring->sqesSize);
+  if (ring->cqRing != NULL && ring->cqRing != ring->sqRing) ::munmap(ring->cqRing, ring->cqRingSize);
+  if (ring->sqRing != NULL) ::munmap(ring->sqRing, ring->sqRingSize);
+  ::close(ring->fd);
+  delete ring;
+}
+
+AsyncIO::Ring* AsyncIO::ringOfThread()
+{
+  pthread_once(&ringOnce, makeRingKey);
+
+  Ring* ring = (Ring*)pthread_getspecific(ringKey);
+  if (ring == NULL && !__atomic_load_n(&ringBroken, __ATOMIC_RELAXED)) {
+    // the ring is closed by closeRing() when the thread exits
+    if ((ring = setupRing()) == NULL) {
+      __atomic_store_n(&ringBroken, true, __ATOMIC_RELAXED);
+    } else {
+      pthread_setspecific(ringKey, ring);
+    }
+  }
+  return ring;
+}
+
+RC AsyncIO::runRing(Ring& ring, Request* reqs, int n, Completion done, void* arg)
+{
+  vector<struct iovec> iov(n);
+  unsigned tail = *ring.sqTail;  // only this thread submits to the ring
+  int  next = 0;       // the next request to submit
+  int  inFlight = 0;   // # of submitted requests that are not done yet
+  bool failed = false; // io_uring_enter() failed. submit nothing more
+  RC   rc = 0;
+  RC   err;
+
+  while (next < n || inFlight > 0) {
+    // fill the ring with as many requests as it takes
+    while (!failed && next < n && inFlight < QUEUE_DEPTH) {
+      Request& req = reqs[next];
+      unsigned slot = tail & ring.sqMask;
+      struct io_uring_sqe* sqe = &ring.sqes[slot];
+
+      iov[next].iov_base = req.buffer;
+      iov[next].iov_len = req.length;
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = req.write ? IORING_OP_WRITEV : IORING_OP_READV;
+      sqe->fd = req.fd;
+      sqe->off = req.offset;
+      sqe->addr = (unsigned long)&iov[next];
+      sqe->len = 1;
+      sqe->user_data = next;
+      ring.sqArray[slot] = slot;
+
+      tail++;
+      next++;
+      inFlight++;
+    }
+    __atomic_store_n(ring.sqTail, tail, __ATOMIC_RELEASE);
+
+    // submit what the kernel has not taken yet, and wait for a completion
+    if (!failed) {
+      unsigned pending = tail - __atomic_load_n(ring.sqHead, __ATOMIC_ACQUIRE);
+      if (::syscall(__NR_io_uring_enter, ring.fd, pending, 1,
+                    IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+          errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        // take back the requests that the kernel has not seen.
+        // they are the last ones submitted, and are run by the thread
+        // pool once the ones in the kernel are done.
+        unsigned head = __atomic_load_n(ring.sqHead, __ATOMIC_ACQUIRE);
+        next -= tail - head;
+        inFlight -= tail - head;
+        tail = head;
+        __atomic_store_n(ring.sqTail, tail, __ATOMIC_RELEASE);
+        failed = true;
+      }
+    }
+
+    // take the completions
+    unsigned head = *ring.cqHead;
+    unsigned end = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+    if (failed && head == end && inFlight > 0) sched_yield();
+    for (; head != end; head++) {
+      struct io_uring_cqe* cqe = &ring.cqes[head & ring.cqMask];
+      Request& req = reqs[cqe->user_data];
+      int res = cqe->res;
+      __atomic_store_n(ring.cqHead, head + 1, __ATOMIC_RELEASE);
+      inFlight--;
+
+      // the kernel may stop a transfer short. finish it here
+      if (res < 0) {
+        req.result = -1;
+      } else if (res > 0 && (size_t)res < req.length) {
+        req.result = transfer(req, res);
+      } else {
+        req.result = res;
+      }
+      if ((err = report(req, done, arg)) < 0 && rc == 0) rc = err;
+    }
+
+    if (failed && inFlight == 0) break;
+  }
+
+  if (next < n && (err = runPool(reqs + next, n - next, done, arg)) < 0 && rc == 0) rc = err;
+  return rc;
+}
+
+RC AsyncIO::runPool(Request* reqs, int n, Completion done, void* arg)
+{
+  vector<Request*> ready;
+  Batch batch;
+  RC    rc = 0;
+  RC    err;
+
+  pthread_once(&poolOnce, startWorkers);
+
+  // no thread could be started. do the requests one by one
+  if (workerCount == 0) {
+    for (int i = 0; i < n; i++) {
+      reqs[i].result = transfer(reqs[i], 0);
+      if ((err = report(reqs[i], done, arg)) < 0 && rc == 0) rc = err;
+    }
+    return rc;
+  }
+
+  pthread_cond_init(&batch.ready, NULL);
+  pthread_mutex_lock(&poolLatch);
+  for (int i = 0; i < n; i++) {
+    Job job = { &reqs[i], &batch };
+    jobs->push_back(job);
+  }
+  pthread_cond_broadcast(&poolWork);
+
+  // report the requests as they complete, without holding the latch
+  for (int finished = 0; finished < n; ) {
+    while (batch.completed.empty()) pthread_cond_wait(&batch.ready, &poolLatch);
+    ready.swap(batch.completed);
+    pthread_mutex_unlock(&poolLatch);
+
+    for (unsigned i = 0; i < ready.size(); i++) {
+      if ((err = report(*ready[i], done, arg)) < 0 && rc == 0) rc = err;
+    }
+    finished += ready.size();
+    ready.clear();
+
+    pthread_mutex_lock(&poolLatch);
+  }
+  pthread_mutex_unlock(&poolLatch);
+  pthread_cond_destroy(&batch.ready);
+
+  return rc;
+}
@@ -0,0 +1,82 @@
+#ifndef ASYNCIO_H
+#define ASYNCIO_H
+
+#include <sys/types.h>
+#include "Bruinbase.h"
+
+/**
+ * Batched disk I/O. All the requests of a batch are handed to the
+ * kernel at once, so that the device can work on many of them at the
+ * same time instead of waiting for each before the next one is issued.
+ *
+ * Requests go through io_uring when the kernel supports it. Every
+ * thread gets its own ring, which is set up the first time the thread
+ * runs a batch. Where io_uring is not available (an old kernel, or a
+ * sandbox that forbids it), the requests are handed to a small pool of
+ * threads that run pread()/pwrite().
+ *
+ * A batch runs to completion before run() returns, and the completion
+ * function is always called from the thread that called run(), so the
+ * caller does not need to synchronize with the I/O threads.
+ */
+class AsyncIO {
+ public:
+
+  static const int QUEUE_DEPTH = 64;  // max # of requests in flight per thread
+  static const int WORKER_COUNT = 8;  // # of threads in the fallback pool
+
+  struct Request {
+    int     fd;       // the file to read or write
+    char*   buffer;   // the memory to read into or write from
+    size_t  length;   // # of bytes to transfer
+    off_t   offset;   // the position in the file
+    bool    write;    // true for a write, false for a read
+    ssize_t result;   // set on completion: # of bytes transferred, or -1
+  };
+
+  /**
+   * called once for every request of a batch as it completes.
+   * @param req[IN] the completed request, with its result set
+   * @param arg[IN] the argument given to run()
+   */
+  typedef void (*Completion)(Request& req, void* arg);
+
+  /**
+   * run a batch of requests and wait until all of them are done.
+   * the requests are executed in no particular order, so a batch must
+   * not write the same bytes twice, or read bytes that it writes.
+   * a read that stops at the end of the file has a short result.
+   * @param reqs[IN/OUT] the requests
+   * @param n[IN] the # of requests
+   * @param done[IN] called for each request as it completes (may be NULL)
+   * @param arg[IN] passed to done
+   * @return error code. 0 if every request succeeded
+   */
+  static RC run(Request* reqs, int n, Completion done, void* arg);
+
+  /**
+   * turn the use of io_uring on or off. when it is off, or not
+   * supported by the kernel, batches are run by the thread pool.
+   * @param on[IN] true to use io_uring where it is available
+   */
+  static void setUring(bool on) { useUring = on; }
+
+  /**
+   * @return true if the batches of the calling thread go through io_uring
+   */
+  static bool isUring();
+
+ private:
+  struct Ring;  // the io_uring of a thread, defined in AsyncIO.cc
+
+  static bool useUring;  // use io_uring where it is available
+
+  static void  makeRingKey();
+  static Ring* setupRing();
+  static void  closeRing(void* ring);
+  static Ring* ringOfThread();
+  static RC runRing(Ring& ring, Request* reqs, int n, Completion done, void* arg);
+  static RC runPool(Request* reqs, int n, Completion done, void* arg);
+};
+
+#endif // ASYNCIO_H
@@ -0,0 +1,617 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "Bruinbase.h"
+#include "PageFile.h"
+#include "RecordFile.h"
+#include "BTreeIndex.h"
+#include "BTreeNode.h"
+
+/**
+ * a key of at most N characters, padded with zero bytes. keys compare
+ * by their bytes, the way strcmp() compares strings.
+ */
+template <int N>
+class FixedString {
+ public:
+  FixedString() { memset(chars, 0, N); }
+
+  /**
+   * @param s[IN] the characters of the key. those past N are cut off
+   */
+  FixedString(const char* s) { assign(s, strlen(s)); }
+  FixedString(const std::string& s) { assign(s.data(), s.size()); }
+
+  /**
+   * @return the characters of the key, without the padding
+   */
+  std::string str() const
+  {
+    int n = 0;
+    while (n < N && chars[n] != 0) n++;
+    return std::string(chars, n);
+  }
+
+  bool operator<(const FixedString& other) const { return memcmp(chars, other.chars, N) < 0; }
+
+ private:
+  char chars[N];
+
+  void assign(const char* s, size_t length)
+  {
+    memset(chars, 0, N);
+    memcpy(chars, s, (length < (size_t) N) ? length : N);
+  }
+};
+
+/**
+ * a node of a BTree<Key, PageSize>: a leaf if Value is RecordId, and a
+ * non-leaf node if it is PageId.
+ *
+ * the page starts with the # of keys and a PageId, which is the next
+ * leaf of a leaf and the leftmost child of a non-leaf node. the keys
+ * follow as one sorted array, and the value of each key as another, as
+ * in BTLeafNode and BTNonLeafNode. both arrays have room for a full
+ * node, so the offset of every entry is known at compile time, and the
+ * keys are compared with the operator< of Key, which the compiler
+ * inlines. a key that is in a leaf already goes after the entries with
+ * the same key.
+ */
+template <class Key, class Value, int PageSize>
+class BTNode {
+ public:
+  static const int HEADER_SIZE = sizeof(int) + sizeof(PageId);
+
+  // the most entries that a node holds
+  static const int MAX_KEYS = (PageSize - HEADER_SIZE) / (sizeof(Key) + sizeof(Value));
+
+  BTNode() : buffer(newPage) { memset(newPage, 0, PageSize); }
+
+  /**
+   * read the node from a page, which stays pinned while the node uses it.
+   * @param pid[IN] the page to read
+   * @param pf[IN] the file to read from
+   * @return error code. 0 if no error
+   */
+  RC read(PageId pid, const PageFile& pf)
+  {
+    if (pid < 0) return RC_INVALID_PID;
+    buffer = newPage;
+    RC rc = pf.pin(pid, page);
+    if (rc < 0) return rc;
+    buffer = page.data();
+    return 0;
+  }
+
+  /**
+   * write the node to a page.
+   * @param pid[IN] the page to write to
+   * @param pf[IN] the file to write to
+   * @return error code. 0 if no error
+   */
+  RC write(PageId pid, PageFile& pf)
+  {
+    if (page.isPageOf(pf, pid)) {
+      page.markDirty();
+      return page.write();
+    }
+    return pf.write(pid, buffer);
+  }
+
+  int getKeyCount() const
+  {
+    int numKeys;
+    memcpy(&numKeys, buffer, sizeof(int));
+    return numKeys;
+  }
+
+  /**
+   * @return the next leaf of a leaf, or the leftmost child of a non-leaf node
+   */
+  PageId getLink() const
+  {
+    PageId pid;
+    memcpy(&pid, buffer + sizeof(int), sizeof(PageId));
+    return pid;
+  }
+
+  void setLink(PageId pid)
+  {
+    memcpy(buffer + sizeof(int), &pid, sizeof(PageId));
+    page.markDirty();
+  }
+
+  /**
+   * @return the next leaf of a leaf, 0 if it is the last one
+   */
+  PageId getNextNodePtr() const { return getLink(); }
+
+  Key keyAt(int eid) const
+  {
+    Key key;
+    memcpy(&key, buffer + KEYS_OFFSET + eid * sizeof(Key), sizeof(Key));
+    return key;
+  }
+
+  Value valueAt(int eid) const
+  {
+    Value value;
+    memcpy(&value, buffer + VALUES_OFFSET + eid * sizeof(Value), sizeof(Value));
+    return value;
+  }
+
+  /**
+   * @return the # of keys of the node that are smaller than key
+   */
+  int countLess(const Key& key) const
+  {
+    int lo = 0;
+    int hi = getKeyCount();
+    while (lo < hi) {
+      int mid = lo + (hi - lo) / 2;
+      if (keyAt(mid) < key) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  /**
+   * @return the # of keys of the node that are not larger than key
+   */
+  int countLessOrEqual(const Key& key) const
+  {
+    int lo = 0;
+    int hi = getKeyCount();
+    while (lo < hi) {
+      int mid = lo + (hi - lo) / 2;
+      if (key < keyAt(mid)) {
+        hi = mid;
+      } else {
+        lo = mid + 1;
+      }
+    }
+    return lo;
+  }
+
+  /**
+   * find the first entry of a leaf with searchKey, or with the smallest
+   * key above it, as BTLeafNode::locate() does.
+   * @param searchKey[IN] the key to find
+   * @param eid[OUT] the entry, or getKeyCount() if every key is smaller
+   * @return 0 if searchKey is found. RC_NO_SUCH_RECORD if not
+   */
+  RC locate(const Key& searchKey, int& eid) const
+  {
+    eid = countLess(searchKey);
+    if (eid < getKeyCount() && !(searchKey < keyAt(eid))) return 0;
+    return RC_NO_SUCH_RECORD;
+  }
+
+  /**
+   * find the child of a non-leaf node to follow to insert searchKey,
+   * which goes after the entries with the same key.
+   * @param searchKey[IN] the key to insert
+   * @param pid[OUT] the child to follow
+   */
+  void locateChildPtr(const Key& searchKey, PageId& pid) const
+  {
+    pid = childAt(countLessOrEqual(searchKey));
+  }
+
+  /**
+   * find the child of a non-leaf node to follow to insert searchKey,
+   * and where that child is in the node.
+   * @param searchKey[IN] the key to insert
+   * @param pid[OUT] the child to follow
+   * @param eid[OUT] 0 for the leftmost child, i for the child behind
+   *                 the i'th key
+   */
+  void locateChildPtr(const Key& searchKey, PageId& pid, int& eid) const
+  {
+    eid = countLessOrEqual(searchKey);
+    pid = childAt(eid);
+  }
+
+  /**
+   * find the child of a non-leaf node to follow to the first entry of
+   * searchKey, which is in front of the keys equal to it.
+   * @param searchKey[IN] the key to find
+   * @param pid[OUT] the child to follow
+   */
+  void locateFirstChildPtr(const Key& searchKey, PageId& pid) const
+  {
+    pid = childAt(countLess(searchKey));
+  }
+
+  /**
+   * insert an entry in front of the eid entry.
+   * @param eid[IN] where the entry goes
+   * @param key[IN] the key of the entry
+   * @param value[IN] the value of the entry
+   * @return error code. RC_NODE_FULL if the node has no room for it
+   */
+  RC insert(int eid, const Key& key, const Value& value)
+  {
+    int numKeys = getKeyCount();
+    if (numKeys >= MAX_KEYS) return RC_NODE_FULL;
+
+    char* keys = buffer + KEYS_OFFSET;
+    char* values = buffer + VALUES_OFFSET;
+    memmove(keys + (eid + 1) * sizeof(Key), keys + eid * sizeof(Key),
+            (numKeys - eid) * sizeof(Key));
+    memmove(values + (eid + 1) * sizeof(Value), values + eid * sizeof(Value),
+            (numKeys - eid) * sizeof(Value));
+    memcpy(keys + eid * sizeof(Key), &key, sizeof(Key));
+    memcpy(values + eid * sizeof(Value), &value, sizeof(Value));
+    numKeys++;
+    memcpy(buffer, &numKeys, sizeof(int));
+    page.markDirty();
+    return 0;
+  }
+
+  /**
+   * read every entry of the node.
+   * @param keys[OUT] the keys, getKeyCount() of them
+   * @param values[OUT] their values
+   */
+  void readEntries(Key* keys, Value* values) const
+  {
+    int numKeys = getKeyCount();
+    memcpy(keys, buffer + KEYS_OFFSET, numKeys * sizeof(Key));
+    memcpy(values, buffer + VALUES_OFFSET, numKeys * sizeof(Value));
+  }
+
+  /**
+   * replace the entries of the node with sorted keys and their values.
+   * @param keys[IN] the sorted keys
+   * @param values[IN] their values
+   * @param numKeys[IN] the # of entries, at most MAX_KEYS
+   */
+  void setEntries(const Key* keys, const Value* values, int numKeys)
+  {
+    memcpy(buffer, &numKeys, sizeof(int));
+    memcpy(buffer + KEYS_OFFSET, keys, numKeys * sizeof(Key));
+    memcpy(buffer + VALUES_OFFSET, values, numKeys * sizeof(Value));
+    page.markDirty();
+  }
+
+ private:
+  static const int KEYS_OFFSET = HEADER_SIZE;
+  static const int VALUES_OFFSET = HEADER_SIZE + MAX_KEYS * sizeof(Key);
+
+  // the child of a non-leaf node in front of its eid key, or behind
+  // the last key if eid is the # of keys
+  PageId childAt(int eid) const
+  {
+    return (eid == 0) ? getLink() : valueAt(eid - 1);
+  }
+
+  // a split needs a key to move up and one on each side
+  typedef char PageHoldsThreeEntries[(MAX_KEYS >= 3) ? 1 : -1];
+
+  char*      buffer;             // the page of the node, or newPage
+  PageHandle page;               // the pinned page of the node after read()
+  char       newPage[PageSize];  // the content of a node not backed by a page yet
+};
+
+/**
+ * a B+tree index on keys of a fixed-size type, such as int64_t or
+ * FixedString<16>, in a file of pages of PageSize bytes.
+ *
+ * the nodes are BTNode pages, and the keys are copied and compared as
+ * Key values with no per-entry dispatch, so BTree<int64_t, 4096> works
+ * on 8-byte keys as directly as it would on ints. Key has to be
+ * copyable with memcpy() and ordered by operator<.
+ *
+ * BTreeIndex is the index of int keys that SqlEngine uses. its leaves
+ * pack their entries, hold the tuples of index-organized tables and
+ * keep hot keys in overflow pages. a BTree keeps every entry in full.
+ * both split nodes and walk to the first entry of a key with the steps
+ * of BTreeAlgo, so a key is taken any number of times, a lookup finds
+ * its first entry, and a split of a node that keys are appended to
+ * keeps BTreeIndex::getFillFactor() percent of it.
+ */
+template <class Key, int PageSize>
+class BTree {
+ public:
+  typedef BTNode<Key, RecordId, PageSize> LeafNode;
+  typedef BTNode<Key, PageId, PageSize> NonLeafNode;
+
+  BTree() : rootPid(0), height(0) {}
+
+  /**
+   * open the index file in read or write mode. under 'w' mode, the file
+   * is created with pages of PageSize bytes if it does not exist.
+   * @param indexname[IN] the name of the index file
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @return error code. 0 if no error. RC_INVALID_FILE_FORMAT if the
+   *         file is not a BTree of this key size and page size
+   */
+  RC open(const std::string& indexname, char mode);
+
+  /**
+   * close the index file.
+   * @return error code. 0 if no error
+   */
+  RC close() { return pf.close(); }
+
+  /**
+   * insert a (key, RecordId) pair to the index.
+   * @param key[IN] the key
+   * @param rid[IN] the RecordId of the record with the key
+   * @return error code. 0 if no error
+   */
+  RC insert(const Key& key, const RecordId& rid);
+
+  /**
+   * find the first entry with searchKey, or with the smallest key above
+   * it, and set the cursor to it.
+   * @param searchKey[IN] the key to find
+   * @param cursor[OUT] the cursor pointing to the entry
+   * @return 0 if searchKey is found. RC_NO_SUCH_RECORD if not
+   */
+  RC locate(const Key& searchKey, IndexCursor& cursor);
+
+  /**
+   * read the (key, rid) pair at the cursor, and move the cursor forward.
+   * @param cursor[IN/OUT] the cursor pointing to an entry
+   * @param key[OUT] the key of the entry
+   * @param rid[OUT] the RecordId of the entry
+   * @return error code. 0 if no error. RC_END_OF_TREE after the last entry
+   */
+  RC readForward(IndexCursor& cursor, Key& key, RecordId& rid);
+
+  /**
+   * @return the # of non-leaf levels above the leaves
+   */
+  int getTreeHeight() const { return height; }
+
+  /**
+   * @return the I/O of the index file since it was opened
+   */
+  IOStats getStats() const { return pf.getStats(); }
+
+ private:
+  // the layout of the nodes, kept in the header page of the index where
+  // BTreeIndex keeps its own, so that neither opens the other's files
+  static const int NODE_LAYOUT = 1001;
+
+  PageFile pf;      // the pages of the index
+  PageId   rootPid; // the root node, 0 if the tree is empty
+  int      height;  // the # of non-leaf levels
+
+  // page 0 holds rootPid and height, in this order
+
+  RC writeRoot();
+};
+
+template <class Key, int PageSize>
+RC BTree<Key, PageSize>::open(const std::string& indexname, char mode)
+{
+  // a new file takes the page size of the tree
+  RC rc = pf.open(indexname, mode, false, PageSize);
+  if (rc < 0) return rc;
+
+  // the layout and the key size are set when the file has no pages yet
+  char info[PageFile::USER_DATA_SIZE];
+  int layout, keySize;
+  pf.getUserData(info);
+  memcpy(&layout, info + sizeof(int), sizeof(int));
+  memcpy(&keySize, info + 2 * sizeof(int), sizeof(int));
+  if ((mode == 'w' || mode == 'W') && pf.hasHeader() && pf.endPid() == 0) {
+    char zero[PageSize];
+    memset(info, 0, sizeof(info));
+    memset(zero, 0, sizeof(zero));
+    layout = NODE_LAYOUT;
+    keySize = sizeof(Key);
+    memcpy(info + sizeof(int), &layout, sizeof(int));
+    memcpy(info + 2 * sizeof(int), &keySize, sizeof(int));
+    if ((rc = pf.setUserData(info)) < 0 || (rc = pf.write(0, zero)) < 0) {
+      pf.close();
+      return rc;
+    }
+  }
+  if (layout != NODE_LAYOUT || keySize != (int) sizeof(Key) || pf.getPageSize() != PageSize) {
+    pf.close();
+    return RC_INVALID_FILE_FORMAT;
+  }
+
+  char header[PageSize];
+  if ((rc = pf.read(0, header)) < 0) {
+    pf.close();
+    return rc;
+  }
+  memcpy(&rootPid, header, sizeof(PageId));
+  memcpy(&height, header + sizeof(PageId), sizeof(int));
+
+  if (mode == 'r' || mode == 'R') {
+    pf.advise(PageFile::RANDOM);
+  }
+  return 0;
+}
+
+template <class Key, int PageSize>
+RC BTree<Key, PageSize>::writeRoot()
+{
+  char header[PageSize];
+  memset(header, 0, sizeof(header));
+  memcpy(header, &rootPid, sizeof(PageId));
+  memcpy(header + sizeof(PageId), &height, sizeof(int));
+  return pf.write(0, header);
+}
+
+template <class Key, int PageSize>
+RC BTree<Key, PageSize>::insert(const Key& key, const RecordId& rid)
+{
+  RC rc;
+
+  // the first entry makes a leaf that is the root
+  if (rootPid == 0) {
+    LeafNode leaf;
+    leaf.insert(0, key, rid);
+    rootPid = pf.endPid();
+    height = 0;
+    if ((rc = leaf.write(rootPid, pf)) < 0) return rc;
+    return writeRoot();
+  }
+
+  // go down to the leaf, past the entries with the same key,
+  // remembering which child was followed at each level
+  std::vector<PageId> path;
+  std::vector<int> childEids;
+  PageId pid = rootPid;
+  for (int level = 0; level < height; level++) {
+    NonLeafNode node;
+    if ((rc = node.read(pid, pf)) < 0) return rc;
+    int childEid;
+    path.push_back(pid);
+    node.locateChildPtr(key, pid, childEid);
+    childEids.push_back(childEid);
+  }
+
+  LeafNode leaf;
+  if ((rc = leaf.read(pid, pf)) < 0) return rc;
+  int eid = leaf.countLessOrEqual(key);
+  if (leaf.insert(eid, key, rid) == 0) {
+    return leaf.write(pid, pf);
+  }
+
+  // split the full leaf with a new one behind it, as BTLeafNode does.
+  // only the last leaf has no next leaf, and keys appended to it fill
+  // the nodes as full as the fill factor asks.
+  const int MAX_KEYS = LeafNode::MAX_KEYS;
+  Key keys[MAX_KEYS + 1];
+  RecordId rids[MAX_KEYS + 1];
+  leaf.readEntries(keys, rids);
+  memmove(keys + eid + 1, keys + eid, (MAX_KEYS - eid) * sizeof(Key));
+  memmove(rids + eid + 1, rids + eid, (MAX_KEYS - eid) * sizeof(RecordId));
+  keys[eid] = key;
+  rids[eid] = rid;
+
+  bool rightmost = (leaf.getLink() == 0);
+  int fillFactor = rightmost ? BTreeIndex::getFillFactor() : 50;
+  int mid = BTreeAlgo::middle(MAX_KEYS + 1, eid, fillFactor);
+  mid = BTreeAlgo::atKeyBoundary(keys, MAX_KEYS + 1, mid, BTreeAlgo::AnySplitFits());
+  LeafNode sibling;
+  PageId siblingPid = pf.endPid();
+  sibling.setEntries(keys + mid, rids + mid, MAX_KEYS + 1 - mid);
+  sibling.setLink(leaf.getLink());
+  if ((rc = sibling.write(siblingPid, pf)) < 0) return rc;
+  leaf.setEntries(keys, rids, mid);
+  leaf.setLink(siblingPid);
+  if ((rc = leaf.write(pid, pf)) < 0) return rc;
+
+  // the first key of the new node goes up, right behind the child
+  // that was split, splitting the parents that are full as well.
+  // other keys equal to it may be on either side of that child.
+  Key upKey = keys[mid];
+  PageId upPid = siblingPid;
+  while (!path.empty()) {
+    PageId parentPid = path.back();
+    path.pop_back();
+    int at = childEids.back();
+    childEids.pop_back();
+    NonLeafNode parent;
+    if ((rc = parent.read(parentPid, pf)) < 0) return rc;
+    if (parent.insert(at, upKey, upPid) == 0) {
+      return parent.write(parentPid, pf);
+    }
+
+    const int MAX_PIDS = NonLeafNode::MAX_KEYS;
+    Key parentKeys[MAX_PIDS + 1];
+    PageId pids[MAX_PIDS + 1];
+    parent.readEntries(parentKeys, pids);
+    memmove(parentKeys + at + 1, parentKeys + at, (MAX_PIDS - at) * sizeof(Key));
+    memmove(pids + at + 1, pids + at, (MAX_PIDS - at) * sizeof(PageId));
+    parentKeys[at] = upKey;
+    pids[at] = upPid;
+
+    // the middle key moves up, and each side keeps at least one key
+    int middle = BTreeAlgo::middle(MAX_PIDS + 1, at, fillFactor);
+    if (middle > MAX_PIDS - 1) middle = MAX_PIDS - 1;
+    NonLeafNode node;
+    PageId nodePid = pf.endPid();
+    node.setLink(pids[middle]);
+    node.setEntries(parentKeys + middle + 1, pids + middle + 1, MAX_PIDS - middle);
+    if ((rc = node.write(nodePid, pf)) < 0) return rc;
+    parent.setEntries(parentKeys, pids, middle);
+    if ((rc = parent.write(parentPid, pf)) < 0) return rc;
+
+    upKey = parentKeys[middle];
+    upPid = nodePid;
+  }
+
+  // the root was split, so a new root goes above it
+  NonLeafNode root;
+  root.setLink(rootPid);
+  root.insert(0, upKey, upPid);
+  rootPid = pf.endPid();
+  height++;
+  if ((rc = root.write(rootPid, pf)) < 0) return rc;
+  return writeRoot();
+}
+
+template <class Key, int PageSize>
+RC BTree<Key, PageSize>::locate(const Key& searchKey, IndexCursor& cursor)
+{
+  cursor.pid = 0;
+  cursor.eid = 0;
+  cursor.overflow = 0;
+  cursor.oeid = 0;
+  if (rootPid == 0) return RC_NO_SUCH_RECORD;
+
+  // go down in front of the keys equal to searchKey, as
+  // BTreeIndex::locate() does
+  RC rc;
+  PageId pid = rootPid;
+  for (int level = 0; level < height; level++) {
+    NonLeafNode node;
+    if ((rc = node.read(pid, pf)) < 0) return rc;
+    node.locateFirstChildPtr(searchKey, pid);
+  }
+
+  LeafNode leaf;
+  int eid;
+  if ((rc = leaf.read(pid, pf)) < 0) return rc;
+  rc = BTreeAlgo::locateFirst(leaf, pid, searchKey, eid, pf);
+  if (rc < 0 && rc != RC_NO_SUCH_RECORD) return rc;
+
+  cursor.pid = pid;
+  cursor.eid = eid;
+  return rc;
+}
+
+template <class Key, int PageSize>
+RC BTree<Key, PageSize>::readForward(IndexCursor& cursor, Key& key, RecordId& rid)
+{
+  // move on to the next leaf past the last entry of one
+  LeafNode leaf;
+  while (true) {
+    if (cursor.pid <= 0) return RC_END_OF_TREE;
+    RC rc = leaf.read(cursor.pid, pf);
+    if (rc < 0) return rc;
+    if (cursor.eid < leaf.getKeyCount()) break;
+    cursor.pid = leaf.getLink();
+    cursor.eid = 0;
+  }
+
+  key = leaf.keyAt(cursor.eid);
+  rid = leaf.valueAt(cursor.eid);
+  if (cursor.eid + 1 >= leaf.getKeyCount()) {
+    cursor.pid = leaf.getLink();
+    cursor.eid = 0;
+  } else {
+    cursor.eid++;
+  }
+  return 0;
+}
+
+#endif // BTREE_H
@@ -13,6 +13,7 @@
 #include <cassert>
 #include <cstdio>
 #include <cstring>
+#include <vector>
 #include "BTreeIndex.h"
 #include "BTreeNode.h"
 
@@ -21,11 +22,51 @@
 
 using namespace std;
 
+// The page layout of the nodes, kept in the header page of an index.
+// 1: the keys of a node in one array, and the RecordIds or PageIds
+//    in another (see BTreeNode.h)
+// 2: the same, with the fields of the entries of the leaves packed
+//    as their differences from a base
+// 3: the same, with the RecordIds of hot keys in overflow pages
+static const int NODE_LAYOUT = 3;
+
+// A key is hot once its entries take this share of a full leaf
+static const int HOT_KEY_SHARE = 4;
+
+// Same as insertIntoLeaf(), for a full leaf that is split with sibling
+static RC splitLeaf(BTLeafNode& leaf, int key, const RecordId& rid, const string* value,
+                    BTLeafNode& sibling, int& siblingKey, int fillFactor)
+{
+    if (value != NULL) {
+        return leaf.insertTupleAndSplit(key, value->data(), value->size(), sibling, siblingKey,
+                                        fillFactor);
+    }
+    return leaf.insertAndSplit(key, rid, sibling, siblingKey, fillFactor);
+}
+
+int BTreeIndex::fillFactor = BTreeIndex::DEFAULT_FILL_FACTOR;
+
+/*
+ * Set how full a split leaves a node that keys are appended to.
+ * @param percent[IN] between MIN_FILL_FACTOR and 100
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::setFillFactor(int percent)
+{
+    if (percent < MIN_FILL_FACTOR || percent > 100) {
+        return RC_INVALID_ATTRIBUTE;
+    }
+    fillFactor = percent;
+    return 0;
+}
+
 /*
  * BTreeIndex constructor
  */
 BTreeIndex::BTreeIndex()
 {
+    tuples = false;
+
     // Cannot yet assume that PageFile is loaded;
     // open() handles that.
 
@@ -45,9 +86,10 @@ BTreeIndex::BTreeIndex()
  * Under 'w' mode, the index file should be created if it does not exist.
  * @param indexname[IN] the name of the index file
  * @param mode[IN] 'r' for read, 'w' for write
+ * @param newTuples[IN] true to keep (key, value) tuples in the leaves if the index is created
  * @return error code. 0 if no error
  */
-RC BTreeIndex::open(const string& indexname, char mode)
+RC BTreeIndex::open(const string& indexname, char mode, bool newTuples)
 {
 	// Open the index file
 	// Using the PageFile documentation for open()
@@ -59,6 +101,43 @@ RC BTreeIndex::open(const string& indexname, char mode)
         return rc;
     }
 
+    // What the leaves hold and the layout of the nodes are kept in the
+    // user data of the header page, which is zero (RecordIds, and the
+    // entries of the first builds) in indexes of earlier builds.
+    // Only an index that has no pages yet gets them set.
+    char info[PageFile::USER_DATA_SIZE];
+    int stored = 0;
+    int layout = 0;
+    pf.getUserData(info);
+    memcpy(&stored, info, sizeof(int));
+    memcpy(&layout, info + sizeof(int), sizeof(int));
+    if ((mode == 'w' || mode == 'W') && stored == 0 && layout == 0 &&
+        pf.hasHeader() && pf.endPid() == 0) {
+        stored = newTuples ? 1 : 0;
+        layout = NODE_LAYOUT;
+        memcpy(info, &stored, sizeof(int));
+        memcpy(info + sizeof(int), &layout, sizeof(int));
+        if ((rc = pf.setUserData(info)) < 0) {
+            pf.close();
+            return rc;
+        }
+    }
+    tuples = (stored != 0);
+
+    // The nodes of an index of another layout cannot be read.
+    // Such an index has to be loaded again.
+    if (layout != NODE_LAYOUT) {
+        pf.close();
+        tuples = false;
+        return RC_INVALID_FILE_FORMAT;
+    }
+
+    // Lookups jump from the root down to a single leaf,
+    // so reading ahead mostly fetches pages we never touch
+    if (mode == 'r' || mode == 'R') {
+        pf.advise(PageFile::RANDOM);
+    }
+
     return 0;
 }
 
@@ -71,6 +150,7 @@ RC BTreeIndex::close()
 	// Close the index file
 	// Using the PageFile documentation for close()
 	// Will create an index file if it does not exist, and will return proper error codes
+    tuples = false;
     return pf.close();
 }
 
@@ -82,11 +162,13 @@ RC BTreeIndex::close()
 int BTreeIndex::getTreeHeight() const
 {
     // STORAGE in Page 0: [rootPid, treeHeight, status, smallestKey, largestKey]
-    char buffer[1024];
-    int rc = pf.read(0, buffer);
+    // Pin page 0 rather than copying it out
+    PageHandle meta;
+    int rc = pf.pin(0, meta);
     if (rc < 0) {
         return rc;
     }
+    char* buffer = meta.data();
 
     int treeHeight = 0;
     int offset = sizeof(PageId);
@@ -113,11 +195,13 @@ int BTreeIndex::getTreeHeight() const
 RC BTreeIndex::setTreeHeight(int newHeight)
 {
     // STORAGE in Page 0: [rootPid, treeHeight]
-    char buffer[1024];
-    int rc = pf.read(0, buffer);
+    // Pin page 0 rather than copying it out
+    PageHandle meta;
+    int rc = pf.pin(0, meta);
     if (rc < 0) {
         return rc;
     }
+    char* buffer = meta.data();
 
     int offset = sizeof(PageId);
 
@@ -125,12 +209,8 @@ RC BTreeIndex::setTreeHeight(int newHeight)
     memcpy(&buffer[offset], &newHeight, sizeof(int));
 
     // Don't forget to write back to disk!
-    pf.write(0, buffer);
-    if (rc < 0) {
-        return rc;
-    }
-
-    return 0;
+    meta.markDirty();
+    return meta.release();
 }
 
 /**
@@ -141,11 +221,13 @@ RC BTreeIndex::setTreeHeight(int newHeight)
 int BTreeIndex::getInit() const
 {
     // STORAGE in Page 0: [rootPid, treeHeight, status, smallestKey, largestKey]
-    char buffer[1024];
-    int rc = pf.read(0, buffer);
+    // Pin page 0 rather than copying it out
+    PageHandle meta;
+    int rc = pf.pin(0, meta);
     if (rc < 0) {
         return rc;
     }
+    char* buffer = meta.data();
 
     int status = -1;
     // PageId and treeHeight is stored first
@@ -167,22 +249,20 @@ int BTreeIndex::getInit() const
 RC BTreeIndex::setInit(int status)
 {
     // STORAGE in Page 0: [rootPid, treeHeight, status, smallestKey, largestKey]
-    char buffer[1024];
-    int rc = pf.read(0, buffer);
+    // Pin page 0 rather than copying it out
+    PageHandle meta;
+    int rc = pf.pin(0, meta);
     if (rc < 0) {
         return rc;
     }
+    char* buffer = meta.data();
 
     int offset = sizeof(PageId) + sizeof(int);
     memcpy(&buffer[offset], &status, sizeof(int));
 
     // Don't forget to write the change back to disk!
-    pf.write(0, buffer);
-    if (rc < 0) {
-        return rc;
-    }
-
-    return 0;
+    meta.markDirty();
+    return meta.release();
 }
 
 /**
@@ -199,11 +279,13 @@ PageId BTreeIndex::getRootPid() const
         return 0;
     }
     // STORAGE in Page 0: [rootPid, treeHeight, status, smallestKey, largestKey]
-    char buffer[1024];
-    int rc = pf.read(0, buffer);
+    // Pin page 0 rather than copying it out
+    PageHandle meta;
+    int rc = pf.pin(0, meta);
     if (rc < 0) {
         return rc;
     }
+    char* buffer = meta.data();
 
     int rootPid = 0;
     // PageId is stored first
@@ -231,11 +313,13 @@ PageId BTreeIndex::getRootPid() const
 int BTreeIndex::getSmallestKey() const
 {
     // STORAGE in Page 0: [rootPid, treeHeight, status, smallestKey, largestKey]
-    char buffer[1024];
-    int rc = pf.read(0, buffer);
+    // Pin page 0 rather than copying it out
+    PageHandle meta;
+    int rc = pf.pin(0, meta);
     if (rc < 0) {
         return rc;
     }
+    char* buffer = meta.data();
 
     int smallestKey = -1;
     // PageId, treeHeight, and status are stored first
@@ -253,11 +337,13 @@ int BTreeIndex::getSmallestKey() const
 int BTreeIndex::getLargestKey() const
 {
     // STORAGE in Page 0: [rootPid, treeHeight, status, smallestKey, largestKey]
-    char buffer[1024];
-    int rc = pf.read(0, buffer);
+    // Pin page 0 rather than copying it out
+    PageHandle meta;
+    int rc = pf.pin(0, meta);
     if (rc < 0) {
         return rc;
     }
+    char* buffer = meta.data();
 
     int largestKey = -1;
     // PageId, treeHeight, and status are stored first
@@ -277,22 +363,20 @@ int BTreeIndex::getLargestKey() const
 RC BTreeIndex::setSmallestKey(int newSmallest)
 {
     // STORAGE in Page 0: [rootPid, treeHeight, status, smallestKey, largestKey]
-    char buffer[1024];
-    int rc = pf.read(0, buffer);
+    // Pin page 0 rather than copying it out
+    PageHandle meta;
+    int rc = pf.pin(0, meta);
     if (rc < 0) {
         return rc;
     }
+    char* buffer = meta.data();
 
     int offset = sizeof(PageId) + (2 * sizeof(int));
     memcpy(&buffer[offset], &newSmallest, sizeof(int));
 
     // Don't forget to write the change back to disk!
-    pf.write(0, buffer);
-    if (rc < 0) {
-        return rc;
-    }
-
-    return 0;
+    meta.markDirty();
+    return meta.release();
 }
 
 /**
@@ -304,22 +388,20 @@ RC BTreeIndex::setSmallestKey(int newSmallest)
 RC BTreeIndex::setLargestKey(int newLargest)
 {
     // STORAGE in Page 0: [rootPid, treeHeight, status, smallestKey, largestKey]
-    char buffer[1024];
-    int rc = pf.read(0, buffer);
+    // Pin page 0 rather than copying it out
+    PageHandle meta;
+    int rc = pf.pin(0, meta);
     if (rc < 0) {
         return rc;
     }
+    char* buffer = meta.data();
 
     int offset = sizeof(PageId) + (3 * sizeof(int));
     memcpy(&buffer[offset], &newLargest, sizeof(int));
 
     // Don't forget to write the change back to disk!
-    pf.write(0, buffer);
-    if (rc < 0) {
-        return rc;
-    }
-
-    return 0;
+    meta.markDirty();
+    return meta.release();
 }
 
 
@@ -332,11 +414,13 @@ RC BTreeIndex::setLargestKey(int newLargest)
 RC BTreeIndex::setRootPid(int newRootPid)
 {
     // STORAGE in Page 0: [rootPid, treeHeight]
-    char buffer[1024];
-    int rc = pf.read(0, buffer);
+    // Pin page 0 rather than copying it out
+    PageHandle meta;
+    int rc = pf.pin(0, meta);
     if (rc < 0) {
         return rc;
     }
+    char* buffer = meta.data();
 
     int offset = 0;
 
@@ -344,12 +428,8 @@ RC BTreeIndex::setRootPid(int newRootPid)
     memcpy(&buffer[offset], &newRootPid, sizeof(PageId));
 
     // Don't forget to write the change back to disk!
-    pf.write(0, buffer);
-    if (rc < 0) {
-        return rc;
-    }
-
-    return 0;
+    meta.markDirty();
+    return meta.release();
 }
 
  /**
@@ -358,11 +438,17 @@ RC BTreeIndex::setRootPid(int newRootPid)
   * @param curDepth[IN] the depth this recursive call is at
   * @param key[IN] the key we're inserting
   * @param rid[IN] the RecordId we're inserting
+  * @param value[IN] the value we're inserting (NULL unless the leaves hold tuples)
   * @param insertPid[IN] the PageId we're inserting (>= 1 when recursing on non-leaf; -1 otherwise)
   * @param visited[OUT] the stack of PageIds visited nodes, most recent on top
+  * @param childEids[OUT] the position of the child visited below each visited non-leaf node
+  * @param rightmost[IN] true if the nodes below were the rightmost of their levels,
+  *                      which the leaf tells by having no next sibling
   * @return error code if error. 0 if successful.
   */
-RC BTreeIndex::helperInsert(int curDepth, int key, const RecordId& rid, PageId insertPid, std::stack<PageId>& visited)
+RC BTreeIndex::helperInsert(int curDepth, int key, const RecordId& rid, const string* value,
+                            PageId insertPid, std::stack<PageId>& visited,
+                            std::stack<int>& childEids, bool rightmost)
 {
     // Idea: find() gives back a stack of visited nodes
     // (if the searchKey doesn't exist, find() gives back
@@ -387,16 +473,23 @@ RC BTreeIndex::helperInsert(int curDepth, int key, const RecordId& rid, PageId i
             return rc;
         }
 
+        // The new sibling goes right behind the child that split, which
+        // is in front of any other keys equal to its first key
+        int childEid = childEids.top();
+        childEids.pop();
+
         // Try insertion first (PageId as this is a non-leaf node)
-        rc = current.insert(key, insertPid);
+        rc = current.insert(key, insertPid, childEid);
         // Node full?
         if (rc == RC_NODE_FULL) {
 
-            // insertAndSplit() into a new sibling
-            BTNonLeafNode sibling;
+            // insertAndSplit() into a new sibling. Keys that are
+            // appended to the tree fill the nodes as full as asked.
+            BTNonLeafNode sibling(pf.getPageSize());
             int midKey = 0;
             PageId siblingPid = pf.endPid();
-            current.insertAndSplit(key, insertPid, sibling, midKey);
+            current.insertAndSplit(key, insertPid, sibling, midKey, rightmost ? fillFactor : 50,
+                                   childEid);
 
             // Write out updated sibling and current
             rc = current.write(curPid, pf);
@@ -409,7 +502,7 @@ RC BTreeIndex::helperInsert(int curDepth, int key, const RecordId& rid, PageId i
             }
 
             // Create a new root and initialize it
-            BTNonLeafNode new_root;
+            BTNonLeafNode new_root(pf.getPageSize());
             rc = new_root.initializeRoot(curPid, midKey, siblingPid);
             if (rc < 0) {
                 return rc;
@@ -439,10 +532,6 @@ RC BTreeIndex::helperInsert(int curDepth, int key, const RecordId& rid, PageId i
     // Else if at a leaf node (with insertPid ignored)
     else if (curDepth == getTreeHeight()) {
 
-        if (key == 2016123411) {
-            printf("CASE AT LEAF\n\n");
-        }
-
         // Pop off top of visited stack into leaf node
         BTLeafNode current;
         PageId curPid = visited.top();
@@ -452,21 +541,30 @@ RC BTreeIndex::helperInsert(int curDepth, int key, const RecordId& rid, PageId i
             return rc;
         }
 
-        if (key == 2016123411) {
-            printf("TRYING TO INSERT: key: %d pid: %d sid: %d \n\n", key, rid.pid, rid.sid);
-        }
-
-        // Try insertion (RecordId as this is a leaf node)
-        rc = current.insert(key, rid);
+        // Try insertion (RecordId or tuple as this is a leaf node)
+        rc = insertIntoLeaf(current, key, rid, value);
 
         // Overflow?
         if (rc == RC_NODE_FULL) {
-            // insertAndSplit() into a new sibling
+            // insertAndSplit() into a new sibling. Only the last leaf
+            // has no next sibling, and keys that are appended to it
+            // fill the leaves as full as asked.
             
-            BTLeafNode sibling;
+            BTLeafNode sibling(pf.getPageSize());
             int siblingKey = 0;
             PageId siblingPid = pf.endPid();
-            current.insertAndSplit(key, rid, sibling, siblingKey);
+            rightmost = (current.getNextNodePtr() == 0);
+            rc = splitLeaf(current, key, rid, value, sibling, siblingKey,
+                           rightmost ? fillFactor : 50);
+            if (rc < 0) {
+                return rc;
+            }
+
+            // Update sibling pointer/PageId before writing the nodes
+            // out, so that the leaf chain on disk goes
+            // current -> sibling -> whatever followed current before
+            sibling.setNextNodePtr(current.getNextNodePtr());
+            current.setNextNodePtr(siblingPid);
 
             // Write out updated sibling and current
             rc = current.write(curPid, pf);
@@ -478,10 +576,6 @@ RC BTreeIndex::helperInsert(int curDepth, int key, const RecordId& rid, PageId i
                 return rc;
             }
 
-            // Update sibling pointer/PageId
-            current.setNextNodePtr(siblingPid);
-            sibling.setNextNodePtr(0);
-
             RecordId siblingRid;
             int key_check;
             sibling.readEntry(0, key_check, siblingRid);
@@ -496,7 +590,8 @@ RC BTreeIndex::helperInsert(int curDepth, int key, const RecordId& rid, PageId i
             // possibly in a new root.
             //
             // NOTE: visited stack already modified by previous pop()
-            helperInsert(curDepth - 1, siblingKey, siblingRid, siblingPid, visited);
+            return helperInsert(curDepth - 1, siblingKey, siblingRid, NULL, siblingPid, visited,
+                                childEids, rightmost);
         }
         // Insertion attempt succeeded
         else {
@@ -517,8 +612,13 @@ RC BTreeIndex::helperInsert(int curDepth, int key, const RecordId& rid, PageId i
             return rc;
         }
 
+        // The new sibling goes right behind the child that split, which
+        // is in front of any other keys equal to its first key
+        int childEid = childEids.top();
+        childEids.pop();
+
         // Try insertion first (PageId as this is a non-leaf node)
-        rc = current.insert(key, insertPid);
+        rc = current.insert(key, insertPid, childEid);
 
 
         // Try insertion with passed-in key and insertPid
@@ -526,10 +626,11 @@ RC BTreeIndex::helperInsert(int curDepth, int key, const RecordId& rid, PageId i
         // Overflow?
         if (rc == RC_NODE_FULL) {
             // insertAndSplit() into a new sibling
-            BTNonLeafNode sibling;
+            BTNonLeafNode sibling(pf.getPageSize());
             int midKey = 0;
             PageId siblingPid = pf.endPid();
-            current.insertAndSplit(key, insertPid, sibling, midKey);
+            current.insertAndSplit(key, insertPid, sibling, midKey, rightmost ? fillFactor : 50,
+                                   childEid);
 
             // Write out updated sibling and current
             rc = current.write(curPid, pf);
@@ -547,7 +648,8 @@ RC BTreeIndex::helperInsert(int curDepth, int key, const RecordId& rid, PageId i
             // key = midKey
             //
             // NOTE: visited stack already modified by previous pop()
-            helperInsert(curDepth - 1, midKey, rid, siblingPid, visited);
+            return helperInsert(curDepth - 1, midKey, rid, NULL, siblingPid, visited, childEids,
+                                rightmost);
         }
         else {
 
@@ -562,6 +664,110 @@ RC BTreeIndex::helperInsert(int curDepth, int key, const RecordId& rid, PageId i
 }
 
 
+/*
+ * Insert into a leaf the RecordId, or the value if the leaves hold tuples.
+ * @param leaf[IN/OUT] the leaf the key goes to
+ * @param key[IN] the key we're inserting
+ * @param rid[IN] the RecordId we're inserting
+ * @param value[IN] the value we're inserting (NULL unless the leaves hold tuples)
+ * @return error code if error. RC_NODE_FULL if the leaf has to be split.
+ */
+RC BTreeIndex::insertIntoLeaf(BTLeafNode& leaf, int key, const RecordId& rid, const string* value)
+{
+    if (value != NULL) {
+        return leaf.insertTuple(key, value->data(), value->size());
+    }
+
+    // A hot key has a single entry, which locates its overflow pages
+    int eid;
+    int entryKey;
+    RecordId first;
+    bool found = (leaf.locate(key, eid) == 0);
+    if (found && leaf.readEntry(eid, entryKey, first) == 0 && first.sid == OVERFLOW_SID) {
+        return insertOverflow(first.pid, key, rid);
+    }
+
+    RC rc = leaf.insert(key, rid);
+    if (rc != RC_NODE_FULL || !found) {
+        return rc;
+    }
+
+    // A full leaf is split unless the key takes enough of it to be hot.
+    // Then its entries move to a new overflow page instead, and the
+    // space they leave makes the split unnecessary.
+    int count = 1;
+    while (eid + count < leaf.getKeyCount() &&
+           leaf.readEntry(eid + count, entryKey, first) == 0 && entryKey == key) {
+        count++;
+    }
+    if (count * HOT_KEY_SHARE < leaf.getKeyCount()) {
+        return RC_NODE_FULL;
+    }
+
+    vector<RecordId> rids;
+    for (int i = 0; i < count; i++) {
+        leaf.readEntry(eid + i, entryKey, first);
+        rids.push_back(first);
+    }
+    rids.push_back(rid);
+
+    RecordId overflow;
+    overflow.pid = pf.endPid();
+    overflow.sid = OVERFLOW_SID;
+    if ((rc = leaf.replaceEntries(eid, count, overflow)) < 0) {
+        return rc;
+    }
+
+    BTLeafNode head(pf.getPageSize());
+    head.insert(key, rids[0]);
+    head.setNextNodePtr(0);
+    if ((rc = head.write(overflow.pid, pf)) < 0) {
+        return rc;
+    }
+    for (unsigned i = 1; i < rids.size(); i++) {
+        if ((rc = insertOverflow(overflow.pid, key, rids[i])) < 0) {
+            return rc;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Insert a RecordId of a hot key to its overflow pages.
+ * @param head[IN] the first overflow page of the key
+ * @param key[IN] the key we're inserting
+ * @param rid[IN] the RecordId we're inserting
+ * @return error code if error. 0 if successful.
+ */
+RC BTreeIndex::insertOverflow(PageId head, int key, const RecordId& rid)
+{
+    BTLeafNode page;
+    RC rc = page.read(head, pf);
+    if (rc < 0) {
+        return rc;
+    }
+
+    rc = page.insert(key, rid);
+    if (rc == 0) {
+        return page.write(head, pf);
+    }
+    if (rc != RC_NODE_FULL) {
+        return rc;
+    }
+
+    // The leaf locates the first page of the chain, so when that one is
+    // full its RecordIds move to a new page behind it, and it starts
+    // over with the new one.
+    PageId moved = pf.endPid();
+    if ((rc = page.write(moved, pf)) < 0) {
+        return rc;
+    }
+    page.setKeyCount(0);
+    page.insert(key, rid);
+    page.setNextNodePtr(moved);
+    return page.write(head, pf);
+}
+
 /*
  * Insert (key, RecordId) pair to the index.
  * @param key[IN] the key for the value inserted into the index
@@ -570,13 +776,40 @@ RC BTreeIndex::helperInsert(int curDepth, int key, const RecordId& rid, PageId i
  */
 RC BTreeIndex::insert(int key, const RecordId& rid)
 {
-    //DEBUG
-    if (key == 4657) {
-        fprintf(stderr, "INSERT key: %d rid.pid: %d sid: %d \n", key, rid.pid, rid.sid);            
+    // A leaf with tuples has no room for RecordIds
+    if (tuples) {
+        return RC_INVALID_FILE_FORMAT;
     }
+    return insertEntry(key, rid, NULL);
+}
 
+/*
+ * Insert a (key, value) tuple to an index-organized table.
+ * @param key[IN] the key of the tuple
+ * @param value[IN] the value of the tuple
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::insert(int key, const string& value)
+{
+    if (!tuples) {
+        return RC_INVALID_FILE_FORMAT;
+    }
+    RecordId none;
+    none.pid = -1;
+    none.sid = -1;
+    return insertEntry(key, none, &value);
+}
 
-
+/*
+ * Insert a (key, RecordId) pair, or a (key, value) tuple if value
+ * is not NULL, into the B+ tree index
+ * @param key[IN] the key we're inserting
+ * @param rid[IN] the RecordId we're inserting
+ * @param value[IN] the value we're inserting (NULL unless the leaves hold tuples)
+ * @return error code if error. 0 if successful.
+ */
+RC BTreeIndex::insertEntry(int key, const RecordId& rid, const string* value)
+{
     // CASE 0: Root node does not yet exist
     //
     // Reserve page 0 for tree information,
@@ -587,11 +820,11 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
     if (getInit() <= 0) {
 
         // Initial rootPid and treeHeight are both 0
-        char buffer[1024];
+        char buffer[PageFile::MAX_PAGE_SIZE];
 
         // We cannot use the setter helpers, as
         // page 0 is not yet allocated.
-        memset(buffer, 0, sizeof(PageId) + sizeof(int));
+        memset(buffer, 0, pf.getPageSize());
 
         // printf("DEBUG: endPid after write of metadata buffer: %d\n", pf.endPid());
 
@@ -610,9 +843,9 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
 
         // Create leaf node and insert into page 1,
         // as no nodes at all existed until now
-        BTLeafNode leaf_root;
+        BTLeafNode leaf_root(pf.getPageSize());
         // fprintf(stderr, "DEBUG: Created first leaf node: %d\n", key);
-        rc = leaf_root.insert(key, rid);
+        rc = insertIntoLeaf(leaf_root, key, rid, value);
         if (rc < 0) {
             // DEBUG
             // printf("Empty tree case leaf_root.insert() failed!\n");
@@ -725,7 +958,7 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
         // printf("key count after: %d\n", leaf_root.getKeyCount());
 
         // Try insertion
-        rc = leaf_root.insert(key, rid);
+        rc = insertIntoLeaf(leaf_root, key, rid, value);
 
         // If our root node is full, we have leaf node overflow
         // We split into two leaf nodes, and create a parent non-leaf node
@@ -733,12 +966,19 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
         if (rc == RC_NODE_FULL) {
             // These will be filled out by insertAndSplit()
             // fprintf(stderr, "DEBUG: Root is full - insertandSplit: %d\n", key);
-            BTLeafNode sibling;
+            BTLeafNode sibling(pf.getPageSize());
             int siblingKey;
-            leaf_root.insertAndSplit(key, rid, sibling, siblingKey);
+            rc = splitLeaf(leaf_root, key, rid, value, sibling, siblingKey, fillFactor);
+            if (rc < 0) {
+                return rc;
+            }
 
-            // Write out sibling to a new page
+            // Set sibling pointer/PageId before the nodes are written out
             int siblingPid = pf.endPid();
+            sibling.setNextNodePtr(leaf_root.getNextNodePtr());
+            leaf_root.setNextNodePtr(siblingPid);
+
+            // Write out sibling to a new page
             rc = sibling.write(siblingPid, pf);
             // fprintf(stderr, "DEBUG: sibling node (right) now assigned to: %d\n", siblingPid);
             if (rc < 0) {
@@ -752,14 +992,10 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
                 return rc;
             }
 
-            // Set sibling pointer/PageId
-            leaf_root.setNextNodePtr(siblingPid);
-            sibling.setNextNodePtr(0);
-
             // Key inserted into parent is the first one in the new sibling
             // No need to have the new root be the first page,
             // which would be an expensive rearrangement.
-            BTNonLeafNode new_root;
+            BTNonLeafNode new_root(pf.getPageSize());
             // fprintf(stderr, "DEBUG: Created non leaf node: %d\n", siblingKey);
 
             // insertAndSplit() lets us know the key that should be stored in parent
@@ -790,19 +1026,15 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
     // CASE 2: Root node + children exist
     else {
 
-        // DEBUG
-        if (key == 2016123411) {
-            printf("CASE 2\n\n");
-        }
-
         // Modified find() will record PageId's of nodes visited
         // Lets us avoid duplicating traversal algorithm
         // Initial insertPid is -1, as it's only used when we have overflow
         // Initial curDepth is tree height, as find() should ended on a leaf node
         std::stack<PageId> visited;
+        std::stack<int> childEids;
         IndexCursor ignoreThis;
         bool isLocate = false;
-        find(key, ignoreThis, getTreeHeight(), getRootPid(), visited, isLocate);
+        find(key, ignoreThis, getTreeHeight(), getRootPid(), visited, childEids, isLocate);
         // DEBUG
         int size = visited.size();
         PageId first = visited.top();
@@ -810,7 +1042,7 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
         // fprintf(stderr, "DEBUG: Find() finishes with a value of: %d\n value: %d\n", size, first);
         int curDepth = getTreeHeight();
         int insertPid = -1;
-        int rc = helperInsert(curDepth, key, rid, insertPid, visited);
+        int rc = helperInsert(curDepth, key, rid, value, insertPid, visited, childEids, false);
         if (rc < 0) {
             return rc;
         }
@@ -874,7 +1106,8 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
 * @param cur_tree_height[IN] current tree height
 * @param cur_pid[IN] current page id of the current node
 */
-RC BTreeIndex::find(int searchKey, IndexCursor& cursor, int cur_tree_height, PageId cur_pid, std::stack<PageId>& visited, bool isLocate) {
+RC BTreeIndex::find(int searchKey, IndexCursor& cursor, int cur_tree_height, PageId cur_pid, std::stack<PageId>& visited,
+                    std::stack<int>& childEids, bool isLocate) {
 
   // Update stack of visited nodes
   visited.push(cur_pid);
@@ -932,7 +1165,15 @@ RC BTreeIndex::find(int searchKey, IndexCursor& cursor, int cur_tree_height, Pag
 
     	// look for the searchKey, set cursor.eid
       if (isLocate) {
-          rc = leafnode.locate(searchKey, cursor.eid);
+          cursor.overflow = 0;
+          cursor.oeid = 0;
+
+          // We came down in front of the keys equal to searchKey,
+          // so the entry may be the first one of a leaf that follows
+          rc = BTreeAlgo::locateFirst(leafnode, cur_pid, searchKey, cursor.eid, pf);
+          if (rc < 0 && rc != RC_NO_SUCH_RECORD) {
+              return rc;
+          }
           // fprintf(stderr, "DEBUG: tried to look for: %d\n", searchKey);
          //  if (rc != RC_NO_SUCH_RECORD && rc < 0) {
          //      printf("ERROR: the no such record occurred in leafnode.locate() [Line: %d]\n", __LINE__);
@@ -963,14 +1204,23 @@ RC BTreeIndex::find(int searchKey, IndexCursor& cursor, int cur_tree_height, Pag
 		PageId new_pid = -1;
         // locateChildPtr() gives the child pointer to follow,
         // given a searchKey. We do this to traverse the tree.
-		rc = nonleafnode.locateChildPtr(searchKey, new_pid);     
+        // A lookup goes to the first entry with searchKey, which may
+        // be in front of the key in the node, and an insert goes
+        // behind the entries that have its key already.
+        if (isLocate) {
+            rc = nonleafnode.locateFirstChildPtr(searchKey, new_pid);
+        } else {
+            int childEid;
+            rc = nonleafnode.locateChildPtr(searchKey, new_pid, childEid);
+            childEids.push(childEid);
+        }
 
 		if (rc < 0) {
             // DEBUG
             printf("ERROR: the nonleafnode.locateChildPtr() gave back an error code.\n");
 			return rc;
 		}
-		return find(searchKey, cursor, cur_tree_height - 1, new_pid, visited, isLocate);
+		return find(searchKey, cursor, cur_tree_height - 1, new_pid, visited, childEids, isLocate);
 	}
 	// Shouldn't get to this point, but if for some reason, the height is 0
 	else {
@@ -1001,9 +1251,14 @@ RC BTreeIndex::find(int searchKey, IndexCursor& cursor, int cur_tree_height, Pag
 RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
 {
 	// If it's empty, return RC_NO_SUCH_RECORD
-  if (getTreeHeight() == -1) {
+  // with a cursor that readForward() finds at the end
+  if (getInit() <= 0 || getTreeHeight() == -1) {
       // DEBUG
       // printf("ERROR: No such record happened at treeHeight check\n");
+      cursor.pid = 0;
+      cursor.eid = 0;
+      cursor.overflow = 0;
+      cursor.oeid = 0;
       return RC_NO_SUCH_RECORD;
   } else {
         // find() is our recursive helper above,
@@ -1011,12 +1266,205 @@ RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
         // TODO: Double-check this function's last arg,
         // which is now getting rootPid via helper
         std::stack<PageId> ignoreThis;
+        std::stack<int> ignoreEids;
         // Want error if searchKey not found
         bool isLocate = true;
         // DEBUG
         // printf("rootPid just before find() invocation [Line %d]: %d\n", __LINE__, getRootPid());
-        return find(searchKey, cursor, getTreeHeight(), getRootPid(), ignoreThis, isLocate);
+        return find(searchKey, cursor, getTreeHeight(), getRootPid(), ignoreThis, ignoreEids, isLocate);
+    }
+
+    return 0;
+}
+
+/*
+ * Move the cursor to the next entry that a leaf holds, and pin that leaf.
+ * locate() leaves the cursor past the last entry of a leaf when all of
+ * its keys are smaller, and the next leaf holds the entry then.
+ * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+ * @param leaf[OUT] the leaf of the entry
+ * @return error code. 0 if no error. RC_END_OF_TREE after the last entry
+ */
+RC BTreeIndex::readLeaf(IndexCursor& cursor, BTLeafNode& leaf)
+{
+    while (true) {
+        // The last leaf points to page 0, which holds no node
+        if (cursor.pid <= 0) {
+            return RC_END_OF_TREE;
+        }
+
+        int rc = leaf.read(cursor.pid, pf);
+        if (rc < 0) {
+            return rc;
+        }
+        if (cursor.eid < leaf.getKeyCount()) {
+            return 0;
+        }
+        cursor.pid = leaf.getNextNodePtr();
+        cursor.eid = 0;
+    }
+}
+
+/*
+ * Change the RecordIds of the index in one pass over its leaves.
+ * @param mapper[IN] the function that gives the new RecordId of an entry
+ * @param arg[IN] the argument to pass to mapper
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::updateRids(RidMapper mapper, void* arg)
+{
+    // The leaves of an index-organized table hold no RecordIds
+    if (tuples) {
+        return RC_INVALID_FILE_FORMAT;
+    }
+
+    BTLeafNode leaf;
+    IndexCursor cursor;
+    vector<int> keys;
+    vector<RecordId> rids;
+    vector<int> spilledKeys;
+    vector<RecordId> spilledRids;
+    vector<RecordId> overflowRids;
+    int rc;
+
+    // Start at the leftmost leaf and follow the sibling pointers.
+    // An empty tree leaves the cursor at page 0, which holds no leaf.
+    locate(INT_MIN, cursor);
+    while (cursor.pid > 0) {
+        if ((rc = leaf.read(cursor.pid, pf)) < 0) {
+            return rc;
+        }
+
+        bool changed = false;
+        keys.clear();
+        rids.clear();
+        for (int eid = 0; eid < leaf.getKeyCount(); eid++) {
+            int key;
+            RecordId rid, old;
+            if ((rc = leaf.readEntry(eid, key, rid)) < 0) {
+                return rc;
+            }
+
+            // The entry of a hot key stays as long as its overflow
+            // pages keep a RecordId
+            if (rid.sid == OVERFLOW_SID) {
+                int kept;
+                overflowRids.clear();
+                rc = updateOverflow(rid.pid, key, mapper, arg, overflowRids, kept);
+                if (rc < 0) {
+                    return rc;
+                }
+                for (unsigned i = 0; i < overflowRids.size(); i++) {
+                    spilledKeys.push_back(key);
+                    spilledRids.push_back(overflowRids[i]);
+                }
+                if (kept == 0) {
+                    changed = true;
+                    continue;
+                }
+                keys.push_back(key);
+                rids.push_back(rid);
+                continue;
+            }
+
+            old = rid;
+            if (!mapper(rid, arg)) {
+                changed = true;
+                continue;
+            }
+            changed = changed || rid != old;
+            keys.push_back(key);
+            rids.push_back(rid);
+        }
+
+        // Refill the leaf with the entries that are kept. They are
+        // still sorted, so each one goes right after the last.
+        // A leaf may be left empty; readLeaf() passes over it.
+        // New RecordIds may pack in more bytes than the old ones, and
+        // the entries that no longer fit are inserted once we are done.
+        if (changed) {
+            leaf.setKeyCount(0);
+            for (unsigned i = 0; i < keys.size(); i++) {
+                rc = leaf.insert(keys[i], rids[i]);
+                if (rc == RC_NODE_FULL) {
+                    spilledKeys.push_back(keys[i]);
+                    spilledRids.push_back(rids[i]);
+                } else if (rc < 0) {
+                    return rc;
+                }
+            }
+            if ((rc = leaf.write(cursor.pid, pf)) < 0) {
+                return rc;
+            }
+        }
+        cursor.pid = leaf.getNextNodePtr();
+    }
+
+    for (unsigned i = 0; i < spilledKeys.size(); i++) {
+        if ((rc = insert(spilledKeys[i], spilledRids[i])) < 0) {
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Change the RecordIds in the overflow pages of a hot key.
+ * @param head[IN] the first overflow page of the key
+ * @param key[IN] the key of the pages
+ * @param mapper[IN] the function that gives the new RecordId of an entry
+ * @param arg[IN] the argument to pass to mapper
+ * @param spilled[OUT] the RecordIds that no longer fit
+ * @param kept[OUT] the number of RecordIds left in the pages
+ * @return error code if error. 0 if successful.
+ */
+RC BTreeIndex::updateOverflow(PageId head, int key, RidMapper mapper, void* arg,
+                              vector<RecordId>& spilled, int& kept)
+{
+    BTLeafNode page;
+    vector<PageId> pages;
+    vector<RecordId> rids;
+    RC rc;
+
+    for (PageId pid = head; pid != 0; pid = page.getNextNodePtr()) {
+        if ((rc = page.read(pid, pf)) < 0) {
+            return rc;
+        }
+        pages.push_back(pid);
+        for (int eid = 0; eid < page.getKeyCount(); eid++) {
+            int pageKey;
+            RecordId rid;
+            if ((rc = page.readEntry(eid, pageKey, rid)) < 0) {
+                return rc;
+            }
+            if (mapper(rid, arg)) {
+                rids.push_back(rid);
+            }
+        }
+    }
+
+    // Refill the pages in order, and end the chain at the last one
+    // that is used. The pages behind it are left unused.
+    kept = 0;
+    unsigned next = 0;
+    for (unsigned i = 0; i < pages.size() && next < rids.size(); i++) {
+        if ((rc = page.read(pages[i], pf)) < 0) {
+            return rc;
+        }
+        page.setKeyCount(0);
+        while (next < rids.size() && page.insert(key, rids[next]) == 0) {
+            next++;
+        }
+        kept += page.getKeyCount();
+        if (next == rids.size()) {
+            page.setNextNodePtr(0);
+        }
+        if ((rc = page.write(pages[i], pf)) < 0) {
+            return rc;
+        }
     }
+    spilled.assign(rids.begin() + next, rids.end());
 
     return 0;
 }
@@ -1035,31 +1483,42 @@ RC BTreeIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid)
     // Use readEntry(), then update cursor.eid += 1
     // Spin up a new leaf node with the pointed-to contents
     BTLeafNode leaf;
-
-    // fprintf(stderr, "getting the cursor pid: %d\n", cursor.pid);
-
-    int rc = leaf.read(cursor.pid, pf);
+    int rc = readLeaf(cursor, leaf);
     if (rc < 0) {
-        // DEBUG
-        fprintf(stderr, "read cursor\n");
         return rc;
     }
 
-    // // DEBUG
-    // fprintf(stderr, "EID and Key Count: %d %d\n", cursor.eid, leaf.getKeyCount());
-
     // Get the wanted contents.
     rc = leaf.readEntry(cursor.eid, key, rid);
-
-    // // DEBUG
-    fprintf(stderr, "\nkey: %d rid.pid: %d sid: %d \n", key, rid.pid, rid.sid);            
-
     if (rc < 0) {
-        // DEBUG
-        fprintf(stderr, "read Entry\n");
         return rc;
     }
 
+    // The entry of a hot key locates its overflow pages, which are read
+    // one RecordId at a time. The cursor stays on the entry until the
+    // last one. No page of a chain is left empty.
+    if (rid.sid == OVERFLOW_SID) {
+        if (cursor.overflow == 0) {
+            cursor.overflow = rid.pid;
+            cursor.oeid = 0;
+        }
+        BTLeafNode page;
+        int pageKey;
+        if ((rc = page.read(cursor.overflow, pf)) < 0) {
+            return rc;
+        }
+        if ((rc = page.readEntry(cursor.oeid, pageKey, rid)) < 0) {
+            return rc;
+        }
+        cursor.oeid++;
+        if (cursor.oeid >= page.getKeyCount()) {
+            cursor.overflow = page.getNextNodePtr();
+            cursor.oeid = 0;
+        }
+        if (cursor.overflow != 0) {
+            return 0;
+        }
+    }
 
     // Update the IndexCursor 
     // If the eid reaches the last entry in the node, go to the sibling
@@ -1071,3 +1530,42 @@ RC BTreeIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid)
     }
     return 0;
 }
+
+/*
+ * Read the (key, value) tuple at the location specified by the index
+ * cursor of an index-organized table, and move forward the cursor to
+ * the next entry. The tuples of a range are next to each other in
+ * the leaves, so reading them one after another reads each leaf once.
+ * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+ * @param key[OUT] the key stored at the index cursor location
+ * @param value[OUT] the value stored at the index cursor location
+ * @return error code. 0 if no error. RC_END_OF_TREE after the last tuple
+ */
+RC BTreeIndex::readForward(IndexCursor& cursor, int& key, string& value)
+{
+    if (!tuples) {
+        return RC_INVALID_FILE_FORMAT;
+    }
+
+    BTLeafNode leaf;
+    int rc = readLeaf(cursor, leaf);
+    if (rc < 0) {
+        return rc;
+    }
+
+    const char* ptr;
+    int length;
+    rc = leaf.readTuple(cursor.eid, key, ptr, length);
+    if (rc < 0) {
+        return rc;
+    }
+    value.assign(ptr, length);
+
+    if ((cursor.eid + 1) >= leaf.getKeyCount()) {
+        cursor.pid = leaf.getNextNodePtr();
+        cursor.eid = 0;
+    } else {
+        cursor.eid += 1;
+    }
+    return 0;
+}
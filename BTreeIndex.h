@@ -11,15 +11,20 @@
 #define BTREEINDEX_H
 
 #include <stack>
+#include <vector>
 
 #include "Bruinbase.h"
 #include "PageFile.h"
 #include "RecordFile.h"
 
+class BTLeafNode;
+
 /**
  * The data structure to point to a particular entry at a b+tree leaf node.
  * An IndexCursor consists of pid (PageId of the leaf node) and
  * eid (the location of the index entry inside the node).
+ * While readForward() goes through the overflow pages of a hot key,
+ * overflow and oeid point to the next RecordId there.
  * IndexCursor is used for index lookup and traversal.
  */
 typedef struct {
@@ -27,14 +32,37 @@ typedef struct {
   PageId  pid;
   // The entry number inside the node
   int     eid;
+  // PageId of the overflow page being read, 0 if none
+  PageId  overflow;
+  // The entry number inside the overflow page
+  int     oeid;
 } IndexCursor;
 
 /**
  * Implements a B-Tree index for bruinbase.
  *
+ * A key may be inserted any number of times. Its entries sit next to
+ * each other in the leaves, with the key packed to a difference of
+ * 0 from the base. Once a key takes a quarter of a full leaf, its
+ * RecordIds move to a chain of overflow pages, laid out as leaves of
+ * that one key, and the leaf keeps a single entry for the key whose
+ * RecordId locates the chain: the PageId of its first page, with a
+ * sid of OVERFLOW_SID.
  */
 class BTreeIndex {
  public:
+  /**
+   * The function that updateRids() calls with each RecordId of the index.
+   * @param rid[IN/OUT] the RecordId of an entry, to be changed in place
+   * @param arg[IN] the argument given to updateRids()
+   * @return false to drop the entry from the index
+   */
+  typedef bool (*RidMapper)(RecordId& rid, void* arg);
+
+  static const int OVERFLOW_SID = -1;        // the sid of an entry of a hot key
+  static const int MIN_FILL_FACTOR = 50;      // a split into halves
+  static const int DEFAULT_FILL_FACTOR = 90;  // see setFillFactor()
+
   BTreeIndex();
 
   /**
@@ -42,9 +70,37 @@ class BTreeIndex {
    * Under 'w' mode, the index file should be created if it does not exist.
    * @param indexname[IN] the name of the index file
    * @param mode[IN] 'r' for read, 'w' for write
+   * @param tuples[IN] true to keep (key, value) tuples in the leaves of
+   *                   the index if it is created, which makes it an
+   *                   index-organized table. an existing index keeps the
+   *                   leaves it was created with
+   * @return error code. 0 if no error. RC_INVALID_FILE_FORMAT if the
+   *         nodes of the index have the layout of an earlier build
+   */
+  RC open(const std::string& indexname, char mode, bool tuples = false);
+
+  /**
+   * set how full a split leaves a node when the key goes after every key
+   * of the rightmost node of its level, as when a LOAD inserts keys in
+   * ascending order. the new node gets the rest, and the next keys too.
+   * other splits leave both nodes half full.
+   * @param percent[IN] the percentage of the entries to keep in the node,
+   *                    between MIN_FILL_FACTOR and 100
    * @return error code. 0 if no error
    */
-  RC open(const std::string& indexname, char mode);
+  static RC setFillFactor(int percent);
+
+  /**
+   * @return the percentage of the entries that a split keeps in a node
+   *         that keys are appended to
+   */
+  static int getFillFactor() { return fillFactor; }
+
+  /**
+   * @return true if the leaves of the index hold (key, value) tuples
+   *         rather than RecordIds
+   */
+  bool holdsTuples() const { return tuples; }
 
   /**
    * Close the index file.
@@ -60,6 +116,15 @@ class BTreeIndex {
    */
   RC insert(int key, const RecordId& rid);
 
+  /**
+   * Insert a (key, value) tuple to an index-organized table.
+   * @param key[IN] the key of the tuple
+   * @param value[IN] the value of the tuple
+   * @return error code. 0 if no error. RC_INVALID_FILE_FORMAT if
+   *         the leaves of the index hold RecordIds
+   */
+  RC insert(int key, const std::string& value);
+
   /**
    * Run the standard B+Tree key search algorithm and identify the
    * leaf node where searchKey may exist. If an index entry with
@@ -70,6 +135,8 @@ class BTreeIndex {
    * IndexCursor.eid = the index entry immediately after the largest
    * index key that is smaller than searchKey, and return the error
    * code RC_NO_SUCH_RECORD.
+   * If searchKey was inserted more than once, the cursor points to
+   * the first of its entries, and readForward() reads all of them.
    * Using the returned "IndexCursor", you will have to call readForward()
    * to retrieve the actual (key, rid) pair from the index.
    * @param key[IN] the key to find
@@ -82,7 +149,8 @@ class BTreeIndex {
 
   /**
    * Read the (key, rid) pair at the location specified by the index cursor,
-   * and move forward the cursor to the next entry.
+   * and move forward the cursor to the next entry. The RecordIds of a
+   * hot key are read one at a time from its overflow pages.
    * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
    * @param key[OUT] the key stored at the index cursor location
    * @param rid[OUT] the RecordId stored at the index cursor location
@@ -90,6 +158,42 @@ class BTreeIndex {
    */
   RC readForward(IndexCursor& cursor, int& key, RecordId& rid);
 
+  /**
+   * Read the (key, value) tuple at the location specified by the index
+   * cursor of an index-organized table, and move forward the cursor to
+   * the next entry.
+   * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+   * @param key[OUT] the key stored at the index cursor location
+   * @param value[OUT] the value stored at the index cursor location
+   * @return error code. 0 if no error. RC_END_OF_TREE after the last tuple
+   */
+  RC readForward(IndexCursor& cursor, int& key, std::string& value);
+
+  /**
+   * Move the cursor to the next entry if it is past the last entry of
+   * a leaf, and read that leaf, to go through its entries in place.
+   * The leaf stays pinned while the node uses it.
+   * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+   * @param leaf[OUT] the leaf of the entry at the cursor
+   * @return error code. 0 if no error. RC_END_OF_TREE after the last entry
+   */
+  RC readLeaf(IndexCursor& cursor, BTLeafNode& leaf);
+
+  /**
+   * Change the RecordIds of the index in one pass over its leaves,
+   * after the records of the table have moved. The keys stay as they are.
+   * @param mapper[IN] the function that gives the new RecordId of an entry
+   * @param arg[IN] the argument to pass to mapper
+   * @return error code. 0 if no error. RC_INVALID_FILE_FORMAT if
+   *         the leaves of the index hold tuples
+   */
+  RC updateRids(RidMapper mapper, void* arg);
+
+  /**
+   * @return the I/O of the index file since it was opened
+   */
+  IOStats getStats() const { return pf.getStats(); }
+
  /**
   * Recursive function to search through the nodes
   * to find the searchKey
@@ -98,9 +202,12 @@ class BTreeIndex {
   * @param cur_pid[IN] current page id of the current node
   * @param cursor[OUT] the cursor pointing to the index entry
   * @param visited[OUT] the stack of PageId's of visited nodes
+  * @param childEids[OUT] the position of the child that find() went down to
+  *                      from each visited non-leaf node, most recent on top
   * @return error code if error. 0 if successful.
   */
-  RC find(int searchKey, IndexCursor& cursor, int cur_tree_height, PageId cur_pid, std::stack<PageId>& visited, bool isLocate);
+  RC find(int searchKey, IndexCursor& cursor, int cur_tree_height, PageId cur_pid, std::stack<PageId>& visited,
+          std::stack<int>& childEids, bool isLocate);
 
  /**
   * Return the height of the tree, stored in page 0 of our internal PageFile
@@ -150,11 +257,66 @@ class BTreeIndex {
   * @param curDepth[IN] the depth this recursive call is at
   * @param key[IN] the key we're inserting
   * @param rid[IN] the RecordId we're inserting
+  * @param value[IN] the value we're inserting (NULL unless the leaves hold tuples)
   * @param insertPid[IN] the PageId we're inserting (>= 1 when recursing on non-leaf; -1 otherwise)
   * @param visited[OUT] the stack of PageId's of visited nodes, most recent on top
+  * @param childEids[OUT] the position of the child that was visited below each
+  *                       visited non-leaf node, most recent on top. A new
+  *                       sibling of the child goes right behind it.
+  * @param rightmost[IN] true if the nodes below were the rightmost of their levels,
+  *                      which the leaf tells by having no next sibling
+  * @return error code if error. 0 if successful.
+  */
+  RC helperInsert(int curDepth, int key, const RecordId& rid, const std::string* value,
+                  PageId insertPid, std::stack<PageId>& visited, std::stack<int>& childEids,
+                  bool rightmost);
+
+  /**
+  * Insert a (key, RecordId) pair, or a (key, value) tuple if value
+  * is not NULL, into the B+ tree index
+  * @param key[IN] the key we're inserting
+  * @param rid[IN] the RecordId we're inserting
+  * @param value[IN] the value we're inserting (NULL unless the leaves hold tuples)
   * @return error code if error. 0 if successful.
   */
-  RC helperInsert(int curDepth, int key, const RecordId& rid, PageId insertPid, std::stack<PageId>& visited);
+  RC insertEntry(int key, const RecordId& rid, const std::string* value);
+
+  /**
+  * Insert into a leaf the RecordId, or the value if the leaves hold
+  * tuples. A RecordId of a hot key goes to its overflow pages, and a
+  * full leaf moves the RecordIds of the key there if it is hot.
+  * @param leaf[IN/OUT] the leaf the key goes to
+  * @param key[IN] the key we're inserting
+  * @param rid[IN] the RecordId we're inserting
+  * @param value[IN] the value we're inserting (NULL unless the leaves hold tuples)
+  * @return error code if error. RC_NODE_FULL if the leaf has to be split.
+  */
+  RC insertIntoLeaf(BTLeafNode& leaf, int key, const RecordId& rid, const std::string* value);
+
+  /**
+  * Insert a RecordId of a hot key to its overflow pages.
+  * @param head[IN] the first overflow page of the key
+  * @param key[IN] the key we're inserting
+  * @param rid[IN] the RecordId we're inserting
+  * @return error code if error. 0 if successful.
+  */
+  RC insertOverflow(PageId head, int key, const RecordId& rid);
+
+  /**
+  * Change the RecordIds in the overflow pages of a hot key, as
+  * updateRids() does. The RecordIds that are kept are packed into
+  * the first pages of the chain, and the ones that no longer fit
+  * are handed back to be inserted later.
+  * @param head[IN] the first overflow page of the key
+  * @param key[IN] the key of the pages
+  * @param mapper[IN] the function that gives the new RecordId of an entry
+  * @param arg[IN] the argument to pass to mapper
+  * @param spilled[OUT] the RecordIds that no longer fit
+  * @param kept[OUT] the number of RecordIds left in the pages
+  * @return error code if error. 0 if successful.
+  */
+  RC updateOverflow(PageId head, int key, RidMapper mapper, void* arg,
+                    std::vector<RecordId>& spilled, int& kept);
 
   /**
   * Set new height of the tree, stored in page 0
@@ -189,6 +351,9 @@ class BTreeIndex {
   RC setInit(int status);
 
   PageFile pf;         /// the PageFile used to store the actual b+tree in disk
+  bool tuples;         /// true if the leaves hold (key, value) tuples
+
+  static int fillFactor;  /// how full a split leaves a node that keys are appended to
 
   // See if PageFile loaded yet
   // bool isInitialized;
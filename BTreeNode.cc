@@ -1,12 +1,25 @@
 #include <cassert> 
+#include <climits>
 #include <cstdio>
 #include <cstring>
 
-#include <cmath>
 #include "BTreeNode.h"
+#include "KeySearch.h"
 
 using namespace std;
 
+int BTreeAlgo::middle(int numKeys, int insertPoint, int fillFactor)
+{
+    int mid = numKeys / 2;
+    if (insertPoint == numKeys - 1 && fillFactor > 50) {
+        mid = numKeys * fillFactor / 100;
+        if (mid > numKeys - 1) {
+            mid = numKeys - 1;
+        }
+    }
+    return mid;
+}
+
 /*
  * Read the content of the node from the page pid in the PageFile pf
  * into our internal buffer. The PageFile pf is part of
@@ -20,10 +33,18 @@ RC BTLeafNode::read(PageId pid, const PageFile& pf)
     if (pid < 0) {
         return RC_INVALID_PID;
     }
-    // PageFile can read contents of a PageID into a buffer.
+    // PageFile pins the page in its buffer pool, and we work
+    // on the pinned frame directly instead of copying it.
     // It will also give the appropriate return code.
     // PageID is something managed in SqlEngine.
-    return pf.read(pid, buffer);
+    buffer = newPage;
+    pageSize = pf.getPageSize();
+    RC rc = pf.pin(pid, page);
+    if (rc < 0) {
+        return rc;
+    }
+    buffer = page.data();
+    return 0;
 }
     
 /*
@@ -36,6 +57,11 @@ RC BTLeafNode::write(PageId pid, PageFile& pf)
 { 
     // Write the contents of buffer to the page specified by PageID
     // Our internal buffer is where we modify the node contents.
+    // If it is the pinned page itself, there is nothing to copy.
+    if (page.isPageOf(pf, pid)) {
+        page.markDirty();
+        return page.write();
+    }
     return pf.write(pid, buffer); 
 }
 
@@ -54,189 +80,409 @@ int BTLeafNode::getKeyCount()
 
 RC BTLeafNode::setKeyCount(int numKeys)
 {
-    int numKeysCopy = numKeys;
-    memcpy(buffer, &numKeysCopy, sizeof(int));
+    int oldKeys = getKeyCount();
+    int entrySize = getWidth(KEY) + getWidth(PID) + getWidth(SID);
+    if (numKeys < 0 || numKeys > maxKeys() || HEADER_SIZE + numKeys * entrySize > pageSize) {
+        return RC_NODE_FULL;
+    }
+    if (oldKeys < 0 || oldKeys > maxKeys() || HEADER_SIZE + oldKeys * entrySize > pageSize) {
+        oldKeys = 0;
+    }
+
+    // The arrays of the fields start right after each other, so they
+    // move along with the count, and the entries past it are dropped.
+    // With fewer entries they move towards the header, the first one
+    // first, and the other way around with more.
+    int kept = (numKeys < oldKeys) ? numKeys : oldKeys;
+    for (int i = 0; i < FIELDS; i++) {
+        int field = (numKeys < oldKeys) ? i : FIELDS - 1 - i;
+        memmove(&buffer[fieldOffset(field, numKeys)], &buffer[fieldOffset(field, oldKeys)],
+                kept * getWidth(field));
+    }
+    memcpy(buffer, &numKeys, sizeof(int));
+    page.markDirty();
 
-    // TODO: Error cases? 
     return 0;
 }
 
+// Read the difference of the eid entry from the array of a field,
+// where each one takes width bytes
+static inline unsigned int loadDelta(const char* deltas, int width, int eid)
+{
+    if (width == 1) {
+        return (unsigned char) deltas[eid];
+    }
+    if (width == 2) {
+        unsigned short delta;
+        memcpy(&delta, &deltas[eid * 2], sizeof(delta));
+        return delta;
+    }
+    unsigned int delta;
+    memcpy(&delta, &deltas[eid * 4], sizeof(delta));
+    return delta;
+}
+
+// Write the difference of the eid entry to the array of a field
+static inline void storeDelta(char* deltas, int width, int eid, unsigned int delta)
+{
+    if (width == 1) {
+        deltas[eid] = (char) delta;
+    } else if (width == 2) {
+        unsigned short shortDelta = (unsigned short) delta;
+        memcpy(&deltas[eid * 2], &shortDelta, sizeof(shortDelta));
+    } else {
+        memcpy(&deltas[eid * 4], &delta, sizeof(delta));
+    }
+}
+
+// The fewest bytes that hold a difference
+static inline int widthOf(unsigned int delta)
+{
+    if (delta <= 0xff) {
+        return 1;
+    }
+    if (delta <= 0xffff) {
+        return 2;
+    }
+    return 4;
+}
+
+// The value of a field of the eid entry: the key, the pid or the sid
+static inline int fieldValue(const int* keys, const RecordId* rids, int eid, int field)
+{
+    if (field == 0) {
+        return keys[eid];
+    }
+    return (field == 1) ? rids[eid].pid : rids[eid].sid;
+}
+
+/*
+ * Return the offset of the array of a field in the buffer,
+ * when the node holds numKeys keys.
+ */
+int BTLeafNode::fieldOffset(int field, int numKeys)
+{
+    int offset = HEADER_SIZE;
+    for (int before = 0; before < field; before++) {
+        offset += numKeys * getWidth(before);
+    }
+    return offset;
+}
+
 /*
- * Insert a (key, rid) pair to the node. Assumes no duplicate keys inserted.
+ * Insert a (key, rid) pair to the node. A key that is in the node
+ * already goes after the entries with the same key.
  * @param key[IN] the key to insert
  * @param rid[IN] the RecordId to insert
  * @return 0 if successful. Return an error code if the node is full.
  */
 RC BTLeafNode::insert(int key, const RecordId& rid)
 {
-    // Leaf nodes hold (key, RecordID) entries, held in LeafEntry instances
-    // Alas, C++ does not support tagged initialization like C99
-    LeafEntry newEntry = { key, rid };
-    
-    // NOTE: The first sizeof(int) + sizeof(PageId) bytes are reserved
-    // for the key count and next sibling PageId
-    int offset = sizeof(int) + sizeof(PageId);
+    return insertEntry(key, rid, pageSize, false);
+}
+
+/*
+ * Insert the (key, rid) pair to the node, keeping the entries
+ * in front of limit. They are packed anew if need be.
+ * @param key[IN] the key to insert
+ * @param rid[IN] the RecordId to insert
+ * @param limit[IN] the offset that the entries have to end by
+ * @param wide[IN] keep every field of the entries in 4 bytes
+ * @return 0 if successful. RC_NODE_FULL if the entry does not fit.
+ */
+RC BTLeafNode::insertEntry(int key, const RecordId& rid, int limit, bool wide)
+{
     int numKeys = getKeyCount();
-    int bytesUsed = offset + (numKeys * sizeof(LeafEntry));
 
     // Check if node full, i.e., we don't have space
-    // for another LeafEntry. 
-    if ((PageFile::PAGE_SIZE - bytesUsed) < 0) {
+    // for another entry. 
+    if (numKeys >= maxKeys()) {
         return RC_NODE_FULL;
     }
 
-    // We need to keep the entries sorted by their keys
-    // This is basically the problem of insertion into 
-    // a sorted array (and keeping it sorted). 
-    // Conventionally, there are two approaches, with the
-    // second being a natural improvement on the first: 
-    //
-    // 1. Brute force. We scan linearly from the beginning 
-    //    to find the appropriate spot for the new element, 
-    //    then shift over all the succeeding elements to make
-    //    space for the new one. 
-    //
-    // 2. Smarter search. We use binary search to find the spot 
-    //    and then shift over for insertion. 
-    //
-    // However, there is actually a third approach: 
-    //
-    // 3. Shift as we go. Starting from the empty space just after
-    //    the last sorted element, we check if the new element can 
-    //    be inserted there. If not, we shift over the last element, 
-    //    and check if the new element can be inserted into the spot freed up.
-    //    We do so until until find a spot or hit the beginning of the array, 
-    //    which is the special case of pre-pending. This approach is very nice
-    //    for when we're making a fully-sorted list out of a nearly-sorted one. 
-    //    Since we'd begin with an initially empty array, most of the initial 
-    //    insertions would be instant, as we'd be appending the biggest number. 
-    //
-    // Of course, with any approach, we should first check if
-    // the array/buffer is full, if the new element is invalid 
-    // or a duplicate, etc. Here, we assume no duplicates, 
-    // and keys may be 0 or negative. 
-
-    // We just need numbers, rather than pointers, 
-    // as we have an array of chars, so we can move around
-    // in terms of buffer +/- number of bytes/chars. 
-    int indexFirst = sizeof(int) + sizeof(PageId);
-    int indexLast = indexFirst + (getKeyCount() * sizeof(LeafEntry));
-    int indexCur = indexLast; 
-
-    // The preceding value, initially the last sorted value
-    LeafEntry valPrev;
-
-    // Keep in mind that a[i] == *(a + i)
-    // so we need to take address-of to get 
-    // a pointer to a char rather than an actual char
-    memcpy(&valPrev, &buffer[indexLast - sizeof(LeafEntry)], sizeof(LeafEntry));
-
-    // Keep going while our new key is not in position
-    // or we haven't hit the beginning
-    while ( (key < valPrev.key) && (indexFirst < indexCur) ) {
-        memmove(&buffer[indexCur], &buffer[indexCur - sizeof(LeafEntry)], sizeof(LeafEntry));
-
-        // Update index and value to compare against, which moves us leftward
-        // Without this, only the first two insertions work, as the remaining
-        // ones always compare against the last element (as we would have forgotten
-        // to update valPrev), leading to inaccurate placement.
-        indexCur = indexCur - sizeof(LeafEntry);
-        memcpy(&valPrev, &buffer[indexCur - sizeof(LeafEntry)], sizeof(LeafEntry));   
-    }
-
-    // If we're here, we've found the insertion spot for our arguments.
-    // Note that LeafEntry is composed of two ints, so struct alignment
-    // by compiler is not an issue. 
-    LeafEntry newItem = { key, rid };
-    memcpy(&buffer[indexCur], &newItem, sizeof(LeafEntry));
+    // We need to keep the entries sorted by their keys, so we search
+    // for the spot of the new key among the keys, as locate() does.
+    // Keys may be 0 or negative. 
+    int eid = (key == INT_MAX) ? numKeys : countLess(key + 1);
+
+    // Does each field of the entry fit the base and the width
+    // that the node keeps the field in?
+    int values[FIELDS] = { key, rid.pid, rid.sid };
+    bool fits = (numKeys > 0);
+    int entrySize = 0;
+    for (int field = 0; field < FIELDS; field++) {
+        int width = getWidth(field);
+        if (width != 4 && (wide || values[field] < getBase(field) ||
+                           widthOf((unsigned int) values[field] - getBase(field)) > width)) {
+            fits = false;
+        }
+        entrySize += width;
+    }
+
+    // If not, as with the first entry, the node is packed anew with it
+    if (!fits) {
+        int keys[MAX_KEYS + 1];
+        RecordId rids[MAX_KEYS + 1];
+        readEntries(keys, rids);
+        memmove(keys + eid + 1, keys + eid, (numKeys - eid) * sizeof(int));
+        memmove(rids + eid + 1, rids + eid, (numKeys - eid) * sizeof(RecordId));
+        keys[eid] = key;
+        rids[eid] = rid;
+        return setEntries(keys, rids, numKeys + 1, limit, wide);
+    }
+    if (HEADER_SIZE + (numKeys + 1) * entrySize > limit) {
+        return RC_NODE_FULL;
+    }
+
+    // Make room for the entry in the array of each field. The arrays
+    // come one after another, so each one moves over by the widths of
+    // the ones in front of it, and the part behind the spot by one more
+    // width of its own. The last one moves the most, so it goes first.
+    // An entry that is appended, as in a sorted load, moves only them.
+    for (int field = FIELDS - 1; field >= 0; field--) {
+        int width = getWidth(field);
+        char* from = &buffer[fieldOffset(field, numKeys)];
+        char* to = &buffer[fieldOffset(field, numKeys + 1)];
+        memmove(to + (eid + 1) * width, from + eid * width, (numKeys - eid) * width);
+        memmove(to, from, eid * width);
+        storeDelta(to, width, eid, (unsigned int) values[field] - getBase(field));
+    }
 
     // Don't forget to update the key count!
-    setKeyCount(getKeyCount() + 1);
+    numKeys++;
+    memcpy(buffer, &numKeys, sizeof(int));
+    page.markDirty();
 
     return 0; 
 }
 
 /*
  * Insert the (key, rid) pair to the node
- * and split the node half and half with sibling.
+ * and split the node with sibling: half and half, or
+ * fillFactor percent of it here if the key goes last.
  * The first key of the sibling node is returned in siblingKey.
  * @param key[IN] the key to insert.
  * @param rid[IN] the RecordId to insert.
  * @param sibling[IN] the sibling node to split with. This node MUST be EMPTY when this function is called.
  * @param siblingKey[OUT] the first key in the sibling node after split.
+ * @param fillFactor[IN] the percentage of the entries to keep after an append
  * @return 0 if successful. Return an error code if there is an error.
  */
- // TODO: Unit-test!
 RC BTLeafNode::insertAndSplit(int key, const RecordId& rid, 
-                              BTLeafNode& sibling, int& siblingKey)
+                              BTLeafNode& sibling, int& siblingKey, int fillFactor)
 { 
-    int offset = sizeof(int) + sizeof(PageId); 
-    LeafEntry entry; 
-    entry.key = key;
-    entry.rid = rid;
-
-    int searchIndex = getKeyCount() - 1;
-    int midpoint = floor(getKeyCount() / 2);
-    bool pastMid = false; 
-
-    int indexFirst = sizeof(int) + sizeof(PageId);
-    int indexLast = indexFirst + (getKeyCount() * sizeof(LeafEntry));
-    int indexCur = indexLast;
-
-    // If we go past the midpoint while looking for our
-    // insertion spot, then we'll insert into the sibling node, 
-    // which will always receive the latter half of the current node. 
-    // Otherwise, we insert into the current node.
-    LeafEntry valPrev;
-    memcpy(&valPrev, &buffer[indexLast - sizeof(LeafEntry)], sizeof(LeafEntry));
-
-    // Same spot-finding algorithm as insert(), but without actually moving items
-    while ( (key < valPrev.key) && (indexFirst < indexCur) ) {
-        if (searchIndex <= midpoint) {
-            pastMid = true;
-        }
+    int numKeys = getKeyCount();
 
-        // Update index and value to compare against, which moves us leftward
-        searchIndex -= 1;
-        indexCur = indexCur - sizeof(LeafEntry);
-        memcpy(&valPrev, &buffer[indexCur - sizeof(LeafEntry)], sizeof(LeafEntry));   
+    // The node is full, so there is no room to insert first
+    // and split afterwards. Instead, gather the entries and
+    // the new one in sorted order, and split that.
+    int keys[MAX_KEYS + 1];
+    RecordId rids[MAX_KEYS + 1];
+    int insertPoint = (key == INT_MAX) ? numKeys : countLess(key + 1);
+
+    readEntries(keys, rids);
+    memmove(keys + insertPoint + 1, keys + insertPoint, (numKeys - insertPoint) * sizeof(int));
+    memmove(rids + insertPoint + 1, rids + insertPoint, (numKeys - insertPoint) * sizeof(RecordId));
+    keys[insertPoint] = key;
+    rids[insertPoint] = rid;
+    numKeys++;
+
+    // The first half stays here, and the sibling node
+    // receives the latter half. Both are packed anew, and
+    // either one fits however it packs (see maxKeys()).
+    // Keys that come in ascending order would leave every node
+    // half full for good, so an appended key leaves this node
+    // as full as asked, with the entries it held already.
+    // The entries of a key stay in one node if both halves
+    // still fit that way.
+    HalvesFit halvesFit = { this, keys, rids, numKeys };
+    int midIndex = BTreeAlgo::middle(numKeys, insertPoint, fillFactor);
+    midIndex = BTreeAlgo::atKeyBoundary(keys, numKeys, midIndex, halvesFit);
+    RC rc = setEntries(keys, rids, midIndex, pageSize, false);
+    if (rc < 0) {
+        return rc;
+    }
+    rc = sibling.setEntries(keys + midIndex, rids + midIndex, numKeys - midIndex,
+                            sibling.pageSize, false);
+    if (rc < 0) {
+        return rc;
     }
 
-    // Copy contents over to sibling node, which requires inserting
-    // everything from midpoint onward. 
-    LeafEntry copy;
-    int count = 0;
+    // Set siblingKey to be the first key after everything
+    siblingKey = keys[midIndex];
 
-    for (int copyIndex = offset + midpoint*sizeof(LeafEntry); copyIndex < indexLast; copyIndex += sizeof(LeafEntry)) {
-        memcpy(&copy, &buffer[copyIndex], sizeof(LeafEntry));
-        sibling.insert(copy.key, copy.rid);
-        count++;
+    return 0; 
+}
+
+/*
+ * Replace count entries from eid, which all have the same key,
+ * with a single entry of the key.
+ * @param eid[IN] the first entry to replace
+ * @param count[IN] the number of entries to replace
+ * @param rid[IN] the RecordId of the entry that replaces them
+ * @return 0 if successful. RC_NODE_FULL, with the node left as it
+ *         was, if the entry does not fit.
+ */
+RC BTLeafNode::replaceEntries(int eid, int count, const RecordId& rid)
+{
+    int numKeys = getKeyCount();
+    if (eid < 0 || count < 1 || eid + count > numKeys) {
+        return RC_NO_SUCH_RECORD;
     }
 
-    // Memset current node's latter half to 0, as those keys were moved
-    // memset(buffer + midpoint, 0, PageFile::PAGE_SIZE - midpoint);
-    
-    //set the key count of the original node
-    setKeyCount(getKeyCount()-count);
+    int keys[MAX_KEYS];
+    RecordId rids[MAX_KEYS];
+    readEntries(keys, rids);
+    rids[eid] = rid;
+    int rest = numKeys - eid - count;
+    memmove(keys + eid + 1, keys + eid + count, rest * sizeof(int));
+    memmove(rids + eid + 1, rids + eid + count, rest * sizeof(RecordId));
+    return setEntries(keys, rids, numKeys - count + 1, pageSize, false);
+}
+
+/*
+ * Read every entry of the node.
+ * @param keys[OUT] the keys, getKeyCount() of them
+ * @param rids[OUT] their RecordIds
+ */
+void BTLeafNode::readEntries(int* keys, RecordId* rids)
+{
+    int numKeys = getKeyCount();
+    int offset = HEADER_SIZE;
+
+    for (int field = 0; field < FIELDS; field++) {
+        int width = getWidth(field);
+        unsigned int base = getBase(field);
+        for (int eid = 0; eid < numKeys; eid++) {
+            int value = (int) (base + loadDelta(&buffer[offset], width, eid));
+            if (field == KEY) {
+                keys[eid] = value;
+            } else if (field == PID) {
+                rids[eid].pid = value;
+            } else {
+                rids[eid].sid = value;
+            }
+        }
+        offset += numKeys * width;
+    }
+}
+
+/*
+ * Replace the entries of the node with sorted keys and their RecordIds,
+ * packed in the fewest bytes that hold them.
+ * @param keys[IN] the sorted keys
+ * @param rids[IN] their RecordIds
+ * @param numKeys[IN] the number of entries
+ * @param limit[IN] the offset that the entries have to end by
+ * @param wide[IN] keep every field of the entries in 4 bytes
+ * @return 0 if successful. RC_NODE_FULL, with the node left as it
+ *         was, if the entries do not fit.
+ */
+RC BTLeafNode::setEntries(const int* keys, const RecordId* rids, int numKeys,
+                          int limit, bool wide)
+{
+    int base[FIELDS];
+    int width[FIELDS];
+    int entrySize = packFields(keys, rids, numKeys, wide, base, width);
+    if (numKeys > maxKeys() || HEADER_SIZE + numKeys * entrySize > limit) {
+        return RC_NODE_FULL;
+    }
 
-    //set the key count of the new node
-    // setKeyCount(count);    
+    memcpy(buffer, &numKeys, sizeof(int));
+    memcpy(&buffer[BASE_OFFSET], base, sizeof(base));
+    for (int field = 0; field < FIELDS; field++) {
+        buffer[WIDTH_OFFSET + field] = (char) width[field];
+    }
+    buffer[WIDTH_OFFSET + FIELDS] = 0;
 
+    for (int field = 0; field < FIELDS; field++) {
+        char* deltas = &buffer[fieldOffset(field, numKeys)];
+        for (int eid = 0; eid < numKeys; eid++) {
+            unsigned int value = fieldValue(keys, rids, eid, field);
+            storeDelta(deltas, width[field], eid, value - base[field]);
+        }
+    }
+    page.markDirty();
 
-    // Insert our argument (key, RecordId) pair into the appropriate node 
-    if (pastMid) {
-        insert(entry.key, entry.rid);
+    return 0;
+}
+
+/*
+ * Find the base and the width that each field of sorted entries is
+ * packed with. Each field is kept as its difference from its smallest
+ * value, in the fewest bytes that hold the largest difference. A field
+ * that needs all 4 bytes holds the values themselves.
+ * @param keys[IN] the sorted keys
+ * @param rids[IN] their RecordIds
+ * @param numKeys[IN] the number of entries
+ * @param wide[IN] keep every field of the entries in 4 bytes
+ * @param base[OUT] the base of each field
+ * @param width[OUT] the width of each field
+ * @return the bytes that an entry takes
+ */
+int BTLeafNode::packFields(const int* keys, const RecordId* rids, int numKeys, bool wide,
+                           int* base, int* width)
+{
+    int entrySize = 0;
+    for (int field = 0; field < FIELDS; field++) {
+        int low = (numKeys > 0) ? fieldValue(keys, rids, 0, field) : 0;
+        int high = low;
+        for (int eid = 1; eid < numKeys; eid++) {
+            int value = fieldValue(keys, rids, eid, field);
+            if (value < low) {
+                low = value;
+            }
+            if (value > high) {
+                high = value;
+            }
+        }
+        width[field] = wide ? 4 : widthOf((unsigned int) high - low);
+        base[field] = (width[field] == 4) ? 0 : low;
+        entrySize += width[field];
     }
-    else {
-        sibling.insert(entry.key, entry.rid);
+    return entrySize;
+}
+
+/*
+ * Tell if sorted entries fit in the node, packed as setEntries() would.
+ */
+bool BTLeafNode::fits(const int* keys, const RecordId* rids, int numKeys)
+{
+    int base[FIELDS];
+    int width[FIELDS];
+    int entrySize = packFields(keys, rids, numKeys, false, base, width);
+    return numKeys <= maxKeys() && HEADER_SIZE + numKeys * entrySize <= pageSize;
+}
+
+/*
+ * Return the number of keys in the node that are smaller than key.
+ */
+int BTLeafNode::countLess(int key)
+{
+    int numKeys = getKeyCount();
+    int width = getWidth(KEY);
+    const char* keys = &buffer[HEADER_SIZE];
+    if (numKeys <= 0) {
+        return 0;
     }
 
-    // Set siblingKey to be the first key after everything
-    LeafEntry result; 
-    sibling.readEntry(0, result.key, result.rid);
-    siblingKey = result.key;
+    // Keys in 4 bytes are the keys themselves
+    if (width == 4) {
+        return KeySearch::countLess(keys, numKeys, key);
+    }
 
-    return 0; 
+    // Otherwise we search the differences from the base. No key is
+    // smaller than the base, and all of them are smaller than a key
+    // that is further from the base than the width holds.
+    int base = getBase(KEY);
+    if (key <= base) {
+        return 0;
+    }
+    unsigned int delta = (unsigned int) key - base;
+    if (widthOf(delta) > width) {
+        return numKeys;
+    }
+    return KeySearch::countLessDelta(keys, width, numKeys, delta);
 }
 
 /**
@@ -252,56 +498,25 @@ RC BTLeafNode::insertAndSplit(int key, const RecordId& rid,
  */
 RC BTLeafNode::locate(int searchKey, int& eid)
 { 
-    // printf("LOOKING FOR KEY: %d\n", searchKey);
-    // printf("KEY COUNT - node: %d\n", getKeyCount());
-
-    // Linear search of entries for matching key
-    // Return its index within the node in the 'eid' parameter
-    int offset = sizeof(int) + sizeof(PageId); 
-    LeafEntry entry; 
-    int searchPoint = offset; 
-    int searchIndex = 0;
-
-    // DEBUG
-    PageId my_pid;
-    memcpy(&my_pid, &buffer[sizeof(int)], sizeof(PageId));
-
-    while (searchPoint < (offset + (getKeyCount() * sizeof(LeafEntry)))) {
-        memcpy(&entry, &buffer[searchPoint], sizeof(LeafEntry));
-
-        // // DEBUG
-        // if (searchKey == 4) {
-        //     printf("Inside of BTLeafNode::locate()\n");
-        //     printf("entry.key: %d\n", entry.key);
-        //     printf("searchKey arg: %d\n", searchKey);
-        // }
-        // Found the entry
-        if (entry.key == searchKey) {
-            eid = searchIndex;
-            return 0;
-        }
+    // Search the keys for the first one with key >= searchKey,
+    // and return its index within the node in the 'eid' parameter.
+    // Example: 1 3 5 7 8
+    // locate() with searchKey of 3 = 1
+    // locate() with searchKey of 4 = 2
+    // If every key is smaller, eid goes past the last entry.
+    int numKeys = getKeyCount();
+    eid = countLess(searchKey);
 
-        // Since we're proceeding left-to-right in a sorted list, 
-        // then a current entry key greater than our searchKey
-        // implies that our sought-for key is not in this node.
-        // Set eid to the index of the first node with key >= searchKey
-        // Example: 1 3 5 7 8
-        // locate() with searchKey of 3 = 1
-        // locate() with searchKey of 4 = 2
-        if (entry.key > searchKey) {
-            eid = searchIndex;
-            return RC_NO_SUCH_RECORD;
+    // Found the entry
+    if (eid < numKeys) {
+        int key = (int) ((unsigned int) getBase(KEY) +
+                         loadDelta(&buffer[HEADER_SIZE], getWidth(KEY), eid));
+        if (key == searchKey) {
+            return 0;
         }
-
-        searchPoint += sizeof(LeafEntry);
-        searchIndex += 1;
     }
-        
 
-    // Hit end of node without finding searchKey
-    // Set eid to index of highest item
-    eid = getKeyCount() - 1; 
-    return RC_NO_SUCH_RECORD; 
+    return RC_NO_SUCH_RECORD;
 }
 
 /*
@@ -316,22 +531,195 @@ RC BTLeafNode::readEntry(int eid, int& key, RecordId& rid)
 { 
     // Given an entry index number, read out its 
     // (key, RecordID) pair from this node
+    int numKeys = getKeyCount();
 
     // Negative or overly large entry index? 
-    if (eid < 0 || eid > (getKeyCount() - 1)) {
+    if (eid < 0 || eid > (numKeys - 1)) {
         // fprintf(stderr, "DEBUG: Invalid eid in BTLeafNode::readEntry() [Line: %d]\n", __LINE__);
         return RC_NO_SUCH_RECORD;
     }
 
-    int offset = sizeof(int) + sizeof(PageId);
-    LeafEntry entry; 
-    // TODO: Is this offset off by 1? 
-    memcpy(&entry, &buffer[offset + (eid * sizeof(LeafEntry))], sizeof(LeafEntry));
-    key = entry.key;
-    rid.pid = entry.rid.pid;
-    rid.sid = entry.rid.sid;
+    // Each field is at the same index of the array of the field,
+    // as its difference from the base of the field
+    int values[FIELDS];
+    int offset = HEADER_SIZE;
+    for (int field = 0; field < FIELDS; field++) {
+        int width = getWidth(field);
+        values[field] = (int) ((unsigned int) getBase(field) + loadDelta(&buffer[offset], width, eid));
+        offset += numKeys * width;
+    }
+    key = values[KEY];
+    rid.pid = values[PID];
+    rid.sid = values[SID];
 
-    return 0; 
+    return 0;
+}
+
+/*
+ * Return the offset of the first byte of the values of a node with tuples.
+ * The values are packed from the end of the buffer, so the free space
+ * of the node lies between the last entry and this offset.
+ */
+int BTLeafNode::getTupleStart()
+{
+    int numKeys = getKeyCount();
+    int start = pageSize;
+    int key;
+    RecordId where;
+
+    for (int eid = 0; eid < numKeys; eid++) {
+        readEntry(eid, key, where);
+        if (where.pid < start) {
+            start = where.pid;
+        }
+    }
+    return start;
+}
+
+/*
+ * Insert a (key, value) tuple to a leaf of an index-organized table.
+ * @param key[IN] the key to insert
+ * @param value[IN] the characters of the value
+ * @param length[IN] the length of the value
+ * @return 0 if successful. Return an error code if the node is full.
+ */
+RC BTLeafNode::insertTuple(int key, const char* value, int length)
+{
+    int bytesUsed = HEADER_SIZE + (getKeyCount() * ENTRY_SIZE);
+    int start = getTupleStart();
+
+    // The new entry and its value both have to fit in between
+    if ((start - bytesUsed) < ENTRY_SIZE + length) {
+        return RC_NODE_FULL;
+    }
+
+    // Put the value in front of the others, and let insertEntry()
+    // find the spot of an entry that points to it, with the fields
+    // in full so that insertTupleAndSplit() can count their bytes
+    start -= length;
+    memcpy(&buffer[start], value, length);
+    RecordId where;
+    where.pid = start;
+    where.sid = length;
+    return insertEntry(key, where, start, true);
+}
+
+/*
+ * Insert the (key, value) tuple to the node and split the node with
+ * sibling, so that both hold about the same number of bytes.
+ * @param key[IN] the key to insert.
+ * @param value[IN] the characters of the value
+ * @param length[IN] the length of the value
+ * @param sibling[IN] the sibling node to split with. This node MUST be EMPTY when this function is called.
+ * @param siblingKey[OUT] the first key in the sibling node after split.
+ * @param fillFactor[IN] the percentage of the bytes to keep after an append
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTLeafNode::insertTupleAndSplit(int key, const char* value, int length,
+                                   BTLeafNode& sibling, int& siblingKey, int fillFactor)
+{
+    struct Tuple {
+        int key;
+        const char* value;
+        int length;
+    };
+
+    int numKeys = getKeyCount();
+
+    // Both nodes get their values packed anew, so we work from a copy
+    // of the node, with the tuples and the new one in sorted order
+    char copy[PageFile::MAX_PAGE_SIZE];
+    memcpy(copy, buffer, pageSize);
+
+    Tuple tuples[PageFile::MAX_PAGE_SIZE / ENTRY_SIZE + 1];
+    int totalBytes = ENTRY_SIZE + length;
+    int insertPoint = numKeys;
+    for (int eid = 0; eid < numKeys; eid++) {
+        int entryKey;
+        RecordId where;
+        readEntry(eid, entryKey, where);
+        tuples[eid].key = entryKey;
+        tuples[eid].value = &copy[where.pid];
+        tuples[eid].length = where.sid;
+        totalBytes += ENTRY_SIZE + where.sid;
+        if (insertPoint == numKeys && key < entryKey) {
+            insertPoint = eid;
+        }
+    }
+    for (int eid = numKeys; eid > insertPoint; eid--) {
+        tuples[eid] = tuples[eid - 1];
+    }
+    tuples[insertPoint].key = key;
+    tuples[insertPoint].value = value;
+    tuples[insertPoint].length = length;
+    numKeys++;
+
+    // Values differ in length, so we split at half of the bytes,
+    // rather than at half of the tuples. An appended tuple leaves
+    // this node as full as asked, as in insertAndSplit().
+    int keptBytes = totalBytes / 2;
+    if (insertPoint == numKeys - 1 && fillFactor > 50) {
+        keptBytes = (int) ((long long) totalBytes * fillFactor / 100);
+    }
+    int midIndex = 0;
+    int leftBytes = 0;
+    while (midIndex < numKeys - 1 && leftBytes < keptBytes) {
+        leftBytes += ENTRY_SIZE + tuples[midIndex].length;
+        midIndex++;
+    }
+    if (midIndex == 0) {
+        midIndex = 1;
+    }
+
+    // The tuples of a key stay in one node if both halves still fit,
+    // as in insertAndSplit(). Otherwise a key that leaves span has
+    // its tuples on both sides of the split.
+    int keys[PageFile::MAX_PAGE_SIZE / ENTRY_SIZE + 1] = { 0 };
+    int bytes[PageFile::MAX_PAGE_SIZE / ENTRY_SIZE + 2];
+    bytes[0] = 0;
+    for (int i = 0; i < numKeys; i++) {
+        keys[i] = tuples[i].key;
+        bytes[i + 1] = bytes[i] + ENTRY_SIZE + tuples[i].length;
+    }
+    TupleHalvesFit halvesFit = { bytes, numKeys, pageSize - HEADER_SIZE };
+    midIndex = BTreeAlgo::atKeyBoundary(keys, numKeys, midIndex, halvesFit);
+
+    setKeyCount(0);
+    for (int i = 0; i < numKeys; i++) {
+        BTLeafNode& node = (i < midIndex) ? *this : sibling;
+        RC rc = node.insertTuple(tuples[i].key, tuples[i].value, tuples[i].length);
+        if (rc < 0) {
+            return rc;
+        }
+    }
+
+    siblingKey = tuples[midIndex].key;
+    return 0;
+}
+
+/*
+ * Read the (key, value) tuple from the eid entry of a node with tuples.
+ * @param eid[IN] the entry number to read the tuple from
+ * @param key[OUT] the key from the slot
+ * @param value[OUT] the characters of the value
+ * @param length[OUT] the length of the value
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTLeafNode::readTuple(int eid, int& key, const char*& value, int& length)
+{
+    RecordId where;
+    RC rc = readEntry(eid, key, where);
+    if (rc < 0) {
+        return rc;
+    }
+
+    // Don't trust an entry that points out of the page
+    if (where.pid < 0 || where.sid < 0 || where.pid + where.sid > pageSize) {
+        return RC_INVALID_FILE_FORMAT;
+    }
+    value = &buffer[where.pid];
+    length = where.sid;
+    return 0;
 }
 
 /*
@@ -364,6 +752,7 @@ RC BTLeafNode::setNextNodePtr(PageId pid)
     // for each +1 increment. We have chars though, so everything
     // is 1 byte.   
     memcpy(&buffer[sizeof(int)], &pid, sizeof(PageId));
+    page.markDirty();
     return 0; 
 }
 
@@ -382,7 +771,14 @@ RC BTNonLeafNode::read(PageId pid, const PageFile& pf)
     if (pid < 0) {
         return RC_INVALID_PID;
     }
-    return pf.read(pid, buffer);
+    buffer = newPage;
+    pageSize = pf.getPageSize();
+    RC rc = pf.pin(pid, page);
+    if (rc < 0) {
+        return rc;
+    }
+    buffer = page.data();
+    return 0;
 }
     
 /*
@@ -393,6 +789,10 @@ RC BTNonLeafNode::read(PageId pid, const PageFile& pf)
  */
 RC BTNonLeafNode::write(PageId pid, PageFile& pf)
 {
+    if (page.isPageOf(pf, pid)) {
+        page.markDirty();
+        return page.write();
+    }
     return pf.write(pid, buffer);
 }
 
@@ -411,8 +811,19 @@ int BTNonLeafNode::getKeyCount()
 
 RC BTNonLeafNode::setKeyCount(int numKeys)
 {
-    int numKeysCopy = numKeys;
-    memcpy(buffer, &numKeysCopy, sizeof(int));
+    int oldKeys = getKeyCount();
+    if (numKeys < 0 || HEADER_SIZE + numKeys * ENTRY_SIZE > pageSize) {
+        return RC_NODE_FULL;
+    }
+    if (oldKeys < 0 || HEADER_SIZE + oldKeys * ENTRY_SIZE > pageSize) {
+        oldKeys = 0;
+    }
+
+    // The PageIds start right after the last key, as in a leaf node
+    int kept = (numKeys < oldKeys) ? numKeys : oldKeys;
+    memmove(&buffer[pidOffset(0, numKeys)], &buffer[pidOffset(0, oldKeys)], kept * sizeof(PageId));
+    memcpy(buffer, &numKeys, sizeof(int));
+    page.markDirty();
 
     return 0;
 }
@@ -421,83 +832,104 @@ RC BTNonLeafNode::setKeyCount(int numKeys)
  * Insert a (key, pid) pair to the node.
  * @param key[IN] the key to insert
  * @param pid[IN] the PageId to insert
+ * @param eid[IN] the entry that the pair becomes (-1 for behind the keys equal to key)
  * @return 0 if successful. Return an error code if the node is full.
  */
-RC BTNonLeafNode::insert(int key, PageId pid)
+RC BTNonLeafNode::insert(int key, PageId pid, int eid)
 {
-    NonLeafEntry newEntry = { key, pid };
-    
-    int offset = sizeof(int) + sizeof(PageId);
     int numKeys = getKeyCount();
-    int bytesUsed = offset + (numKeys * sizeof(NonLeafEntry));
+    int bytesUsed = HEADER_SIZE + (numKeys * ENTRY_SIZE);
 
     // Check if node full, i.e., we don't have space
-    if ((PageFile::PAGE_SIZE - bytesUsed) < 0) {
+    if ((pageSize - bytesUsed) < ENTRY_SIZE) {
         return RC_NODE_FULL;
     }
 
-    int indexFirst = sizeof(int) + sizeof(PageId);
-    int indexLast = indexFirst + (getKeyCount() * sizeof(NonLeafEntry));
-    int indexCur = indexLast; 
-
-    NonLeafEntry valPrev;
-    memcpy(&valPrev, &buffer[indexLast - sizeof(NonLeafEntry)], sizeof(NonLeafEntry));
-
-    // Keep going while our new key is not in position
-    // or we haven't hit the beginning
-    while ( (key < valPrev.key) && (indexFirst < indexCur) ) {
-        memmove(&buffer[indexCur], &buffer[indexCur - sizeof(NonLeafEntry)], sizeof(NonLeafEntry));
-
-        indexCur = indexCur - sizeof(NonLeafEntry);
-        memcpy(&valPrev, &buffer[indexCur - sizeof(NonLeafEntry)], sizeof(NonLeafEntry));   
+    // Find the spot of the key, unless it is given, and make room for
+    // it and its PageId the same way as BTLeafNode::insert() does
+    if (eid < 0) {
+        eid = KeySearch::countLessOrEqual(&buffer[HEADER_SIZE], numKeys, key);
     }
+    char* pids = &buffer[pidOffset(0, numKeys)];
+    memmove(pids + sizeof(int) + (eid + 1) * sizeof(PageId), pids + eid * sizeof(PageId),
+            (numKeys - eid) * sizeof(PageId));
+    memmove(pids + sizeof(int), pids, eid * sizeof(PageId));
+    memmove(&buffer[HEADER_SIZE + (eid + 1) * sizeof(int)], &buffer[HEADER_SIZE + eid * sizeof(int)],
+            (numKeys - eid) * sizeof(int));
 
-    NonLeafEntry newItem = { key, pid };
-    memcpy(&buffer[indexCur], &newItem, sizeof(NonLeafEntry));
+    numKeys++;
+    memcpy(&buffer[HEADER_SIZE + eid * sizeof(int)], &key, sizeof(int));
+    memcpy(&buffer[pidOffset(eid, numKeys)], &pid, sizeof(PageId));
 
     // Don't forget to update the key count!
-    setKeyCount(getKeyCount() + 1);
+    memcpy(buffer, &numKeys, sizeof(int));
+    page.markDirty();
 
     return 0; 
 }
 
 /*
  * Insert the (key, pid) pair to the node
- * and split the node half and half with sibling.
+ * and split the node with sibling: half and half, or
+ * fillFactor percent of it here if the key goes last.
  * The middle key after the split is returned in midKey.
  * @param key[IN] the key to insert
  * @param pid[IN] the PageId to insert
  * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
  * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
+ * @param fillFactor[IN] the percentage of the entries to keep after an append
+ * @param eid[IN] the entry that the pair becomes (-1 for behind the keys equal to key)
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey)
+RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey,
+                                 int fillFactor, int eid)
 {
-    int offset = sizeof(int) + sizeof(PageId); 
-    int count = 0;
-
-    insert(key, pid);
-
-    int midIndex = offset + (floor(getKeyCount() / 2))*sizeof(NonLeafEntry);
-    int indexLast = offset + (getKeyCount() * sizeof(NonLeafEntry));
-
-    NonLeafEntry midkeyEntry;    
-    memcpy(&midkeyEntry, &buffer[midIndex], sizeof(NonLeafEntry));
-    midKey = midkeyEntry.key;
-
+    int numKeys = getKeyCount();
 
-    NonLeafEntry copy;
-    for (int copyIndex = midIndex; copyIndex < indexLast; copyIndex += sizeof(NonLeafEntry)) {
-        memcpy(&copy, &buffer[copyIndex], sizeof(NonLeafEntry));
-        sibling.insert(copy.key, copy.pid);           
-        count++; 
+    // The node is full, so there is no room to insert first
+    // and split afterwards. Instead, gather the entries and
+    // the new one in sorted order, and split that.
+    int keys[PageFile::MAX_PAGE_SIZE / ENTRY_SIZE + 1] = { 0 };
+    PageId pids[PageFile::MAX_PAGE_SIZE / ENTRY_SIZE + 1];
+    int insertPoint = eid;
+    if (insertPoint < 0) {
+        insertPoint = KeySearch::countLessOrEqual(&buffer[HEADER_SIZE], numKeys, key);
     }
 
-    setKeyCount(getKeyCount()-count);
+    memcpy(keys, &buffer[HEADER_SIZE], insertPoint * sizeof(int));
+    memcpy(pids, &buffer[pidOffset(0, numKeys)], insertPoint * sizeof(PageId));
+    keys[insertPoint] = key;
+    pids[insertPoint] = pid;
+    memcpy(keys + insertPoint + 1, &buffer[HEADER_SIZE + insertPoint * sizeof(int)],
+           (numKeys - insertPoint) * sizeof(int));
+    memcpy(pids + insertPoint + 1, &buffer[pidOffset(insertPoint, numKeys)],
+           (numKeys - insertPoint) * sizeof(PageId));
+    numKeys++;
+
+    // An appended key leaves this node as full as asked,
+    // as in BTLeafNode::insertAndSplit()
+    int midIndex = BTreeAlgo::middle(numKeys, insertPoint, fillFactor);
+    midKey = keys[midIndex];
+
+    // The first half stays here, and the middle entry
+    // and everything after it go to the sibling
+    setEntries(keys, pids, midIndex);
+    sibling.setEntries(keys + midIndex, pids + midIndex, numKeys - midIndex);
 
     return 0; 
 }
 
+/*
+ * Replace the entries of the node with sorted keys and their PageIds.
+ */
+void BTNonLeafNode::setEntries(const int* keys, const PageId* pids, int numKeys)
+{
+    memcpy(&buffer[HEADER_SIZE], keys, numKeys * sizeof(int));
+    memcpy(&buffer[pidOffset(0, numKeys)], pids, numKeys * sizeof(PageId));
+    memcpy(buffer, &numKeys, sizeof(int));
+    page.markDirty();
+}
+
 /*
  * Given the searchKey, find the child-node pointer to follow and
  * output it in pid. Recall that these PageId pointers lead to other 
@@ -508,41 +940,60 @@ RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, in
  */
 RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid)
 {
-    // Search entries from beginning of non-leaf node
+    int eid;
+    return locateChildPtr(searchKey, pid, eid);
+}
+
+/*
+ * The same, also giving the position of the child in eid:
+ * 0 for the leftmost one, and i for the one behind the i'th key.
+ * @param searchKey[IN] the searchKey that is being looked up.
+ * @param pid[OUT] the pointer to the child node to follow.
+ * @param eid[OUT] the position of the child
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid, int& eid)
+{
     // Example node keys: -1, 0, 3, 5, 7, 10
     // searchKey: 4.
-    // We'd want to return the PageId associated with 
-    // key 5, the first one such that searchKey <= to it
-    int offset = sizeof(int) + sizeof(PageId); 
-    NonLeafEntry entry; 
-    // int searchPoint = offset; 
-    // int lastEntry = offset + (getKeyCount() * sizeof(NonLeafEntry)); 
-    int firstPoint = offset; 
-    int searchPoint = offset + ((getKeyCount()-1) * sizeof(NonLeafEntry)); 
-
-    // We are going to start at the end, and make our way down
-    // right to left to find the right key
-
-    while (searchPoint >= firstPoint) {
-        memcpy(&entry, &buffer[searchPoint], sizeof(NonLeafEntry));
-
-        // Found an exact key match or one greater than our searchKey
-        // Handles the case where searchKey <= all current keys, 
-        // in which case we give back the PageId in the leftmost entry, 
-        // which would happen upon the first iteration of this loop.
-        if (searchKey >= entry.key) {
-            pid = entry.pid;
-            return 0;
-        }
+    // We'd want to return the PageId behind key 3,
+    // the last one such that searchKey >= it
+    int numKeys = getKeyCount();
+    eid = KeySearch::countLessOrEqual(&buffer[HEADER_SIZE], numKeys, searchKey);
 
-        searchPoint -= sizeof(NonLeafEntry);
+    // Edge case: all current keys are > searchKey.
+    // Return PageId of leftmost entry.
+    if (eid == 0) {
+        memcpy(&pid, &buffer[sizeof(int)], sizeof(PageId));
+        return 0;
     }
-        
-    // Edge case: hit the leftmost, and all current keys
-    // are > searchKey. Return PageId of leftmost entry.
-    PageId leftmost;
-    memcpy(&leftmost, &buffer[sizeof(int)], sizeof(PageId));
-    pid = leftmost;
+
+    memcpy(&pid, &buffer[pidOffset(eid - 1, numKeys)], sizeof(PageId));
+    return 0;
+}
+
+/*
+ * Given the searchKey, find the child-node pointer to follow to the
+ * first entry with searchKey, or with the smallest key above it.
+ * @param searchKey[IN] the searchKey that is being looked up.
+ * @param pid[OUT] the pointer to the child node to follow.
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::locateFirstChildPtr(int searchKey, PageId& pid)
+{
+    // A key equal to searchKey starts the child behind it, but the
+    // entries with searchKey may start in the child in front of it
+    // when a split went between them. So we follow the PageId in
+    // front of the first key that is not smaller than searchKey.
+    int numKeys = getKeyCount();
+    int eid = KeySearch::countLess(&buffer[HEADER_SIZE], numKeys, searchKey);
+
+    if (eid == 0) {
+        memcpy(&pid, &buffer[sizeof(int)], sizeof(PageId));
+        return 0;
+    }
+
+    memcpy(&pid, &buffer[pidOffset(eid - 1, numKeys)], sizeof(PageId));
     return 0;
 }
 
@@ -555,29 +1006,34 @@ RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid)
  */
 RC BTNonLeafNode::initializeRoot(PageId pid1, int key, PageId pid2)
 {
-    int bytesUsed = sizeof(int) + (getKeyCount() * sizeof(NonLeafEntry));   
-    if ((PageFile::PAGE_SIZE - bytesUsed) < 0) {
+    int numKeys = getKeyCount();
+    int bytesUsed = HEADER_SIZE + (numKeys * ENTRY_SIZE);
+    if ((pageSize - bytesUsed) < 0) {
         return RC_NODE_FULL;
     }
 
-    NonLeafEntry old;
+    int oldKey;
+    PageId oldPid;
 
-    if (getKeyCount() != 0) {
-        memcpy(&old, &buffer[sizeof(int)+sizeof(PageId)], sizeof(NonLeafEntry));
+    if (numKeys != 0) {
+        memcpy(&oldKey, &buffer[HEADER_SIZE], sizeof(int));
+        memcpy(&oldPid, &buffer[pidOffset(0, numKeys)], sizeof(PageId));
     }
 
-    NonLeafEntry newItem = { key, pid2 };
     PageId first_pid = pid1;
     memcpy(&buffer[sizeof(int)], &first_pid, sizeof(PageId));
-    memcpy(&buffer[sizeof(int)+sizeof(PageId)], &newItem, sizeof(NonLeafEntry));
 
     // Don't forget to update the key count!
     // Until we find out whether the root node is empty before initializing, I'll do a safe route:
-    if (getKeyCount() != 0) {
-        // insert adjusts the key count
-        insert(old.key, old.pid);
+    if (numKeys != 0) {
+        // The new entry takes the place of the first one,
+        // which is inserted again. insert adjusts the key count
+        memcpy(&buffer[HEADER_SIZE], &key, sizeof(int));
+        memcpy(&buffer[pidOffset(0, numKeys)], &pid2, sizeof(PageId));
+        page.markDirty();
+        insert(oldKey, oldPid);
     } else {
-        setKeyCount(1);
+        setEntries(&key, &pid2, 1);
     }
     // if the count is greater than 1, that means there's already keys inside.. should I move them? 
     // if I DO MOVE THEM: i would add 1 to the key count, re-insert that key into the node lol
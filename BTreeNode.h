@@ -15,15 +15,125 @@
 #include "RecordFile.h"
 #include "PageFile.h"
 
+/**
+ * BTreeAlgo: The steps of a B+tree split and lookup that do not depend on
+ * how a node lays out its keys. BTLeafNode and BTNonLeafNode use them,
+ * and so do the BTNode nodes of BTree.h. A Key only needs operator<.
+ */
+class BTreeAlgo {
+  public:
+
+   /**
+    * Return where to split the numKeys sorted entries of a full node and
+    * the new one, which went to insertPoint: in the middle, or after
+    * fillFactor percent of them if the new one went last, as when keys
+    * come in ascending order. At least the new one goes to the sibling.
+    * @param numKeys[IN] the number of entries, with the new one
+    * @param insertPoint[IN] where the new entry went
+    * @param fillFactor[IN] the percentage of the entries to keep after an append
+    * @return the number of entries that stay in the node
+    */
+    static int middle(int numKeys, int insertPoint, int fillFactor);
+
+   /**
+    * Move a split to the nearest spot between two keys where both halves
+    * fit, so that the entries of a key stay in one node and a lookup of
+    * the key reads one leaf. The split stays at mid if there is none.
+    * @param keys[IN] the sorted keys
+    * @param numKeys[IN] the number of keys
+    * @param mid[IN] where middle() splits them
+    * @param halvesFit[IN] halvesFit(at) tells if both halves fit when
+    *                      the split is at
+    * @return the number of entries that stay in the node
+    */
+    template <class Key, class Fits>
+    static int atKeyBoundary(const Key* keys, int numKeys, int mid, const Fits& halvesFit);
+
+   /**
+    * A lookup goes down in front of the keys equal to searchKey, since
+    * its entries may start in the child in front of one. So when every
+    * key of the leaf it gets to is smaller, the first entry of searchKey,
+    * or of the smallest key above it, is in a leaf that follows.
+    * Leaf needs locate(), getKeyCount(), getNextNodePtr() and read().
+    * @param leaf[IN/OUT] the leaf that the lookup got to, read from pid
+    * @param pid[IN/OUT] the PageId of the leaf
+    * @param searchKey[IN] the key to find
+    * @param eid[OUT] the entry of the key, or of the smallest key above it
+    * @param pf[IN] PageFile to read from
+    * @return 0 if searchKey is found. Return RC_NO_SUCH_RECORD if not,
+    *         or an error code if there is an error.
+    */
+    template <class Leaf, class Key>
+    static RC locateFirst(Leaf& leaf, PageId& pid, const Key& searchKey, int& eid,
+                          const PageFile& pf);
+
+   /**
+    * Tells that any split fits, as it does when every entry
+    * takes the same number of bytes.
+    */
+    struct AnySplitFits {
+        bool operator()(int) const { return true; }
+    };
+};
+
+template <class Key, class Fits>
+int BTreeAlgo::atKeyBoundary(const Key* keys, int numKeys, int mid, const Fits& halvesFit)
+{
+    int before = mid;
+    while (before > 0 && !(keys[before - 1] < keys[before])) {
+        before--;
+    }
+    int after = mid;
+    while (after > 0 && after < numKeys && !(keys[after - 1] < keys[after])) {
+        after++;
+    }
+
+    // The nearer spot goes first
+    int choices[2] = { before, after };
+    if (after - mid < mid - before) {
+        choices[0] = after;
+        choices[1] = before;
+    }
+    for (int i = 0; i < 2; i++) {
+        int at = choices[i];
+        if (at > 0 && at < numKeys && halvesFit(at)) {
+            return at;
+        }
+    }
+    return mid;
+}
+
+template <class Leaf, class Key>
+RC BTreeAlgo::locateFirst(Leaf& leaf, PageId& pid, const Key& searchKey, int& eid,
+                          const PageFile& pf)
+{
+    RC rc = leaf.locate(searchKey, eid);
+    while (eid == leaf.getKeyCount() && leaf.getNextNodePtr() != 0) {
+        pid = leaf.getNextNodePtr();
+        if ((rc = leaf.read(pid, pf)) < 0) {
+            return rc;
+        }
+        rc = leaf.locate(searchKey, eid);
+    }
+    return rc;
+}
+
 /**
  * BTLeafNode: The class representing a B+tree leaf node.
  */
 class BTLeafNode {
   public:
 
-    BTLeafNode()
+    /**
+     * Create an empty node for a page of the given size.
+     * A node that is read() takes the page size of its PageFile.
+     * @param pageSize[IN] the size of the page that will hold the node
+     */
+    explicit BTLeafNode(int pageSize = PageFile::getDefaultPageSize())
     {
-        memset(buffer, 0, PageFile::PAGE_SIZE);
+        buffer = newPage;
+        this->pageSize = pageSize;
+        memset(newPage, 0, pageSize);
     }
 
     /** 
@@ -46,15 +156,22 @@ class BTLeafNode {
    /**
     * Insert the (key, rid) pair to the node
     * and split the node half and half with sibling.
+    * If the pair goes after every entry, as when keys come in ascending
+    * order, the node keeps fillFactor percent of the entries instead,
+    * and leaves at least the new one to the sibling.
+    * The split goes between two keys near there if both halves fit,
+    * so that the entries of a key stay in one node.
     * The first key of the sibling node is returned in siblingKey.
     * Remember that all keys inside a B+tree node should be kept sorted.
     * @param key[IN] the key to insert.
     * @param rid[IN] the RecordId to insert.
     * @param sibling[IN] the sibling node to split with. This node MUST be EMPTY when this function is called.
     * @param siblingKey[OUT] the first key in the sibling node after split.
+    * @param fillFactor[IN] the percentage of the entries to keep after an append (50 to 100)
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC insertAndSplit(int key, const RecordId& rid, BTLeafNode& sibling, int& siblingKey);
+    RC insertAndSplit(int key, const RecordId& rid, BTLeafNode& sibling, int& siblingKey,
+                      int fillFactor = 50);
 
    /**
     * If searchKey exists in the node, set eid to the index entry
@@ -78,6 +195,58 @@ class BTLeafNode {
     */
     RC readEntry(int eid, int& key, RecordId& rid);
 
+   /**
+    * Replace count entries from eid, which all have the same key,
+    * with a single entry of the key, as when the RecordIds of the key
+    * move elsewhere and the entry locates them.
+    * @param eid[IN] the first entry to replace
+    * @param count[IN] the number of entries to replace
+    * @param rid[IN] the RecordId of the entry that replaces them
+    * @return 0 if successful. RC_NODE_FULL, with the node left as it
+    *         was, if the entry does not fit.
+    */
+    RC replaceEntries(int eid, int count, const RecordId& rid);
+
+   /**
+    * Insert a (key, value) tuple to a leaf of an index-organized table.
+    * The value is kept in the node itself, and its entry locates it
+    * there instead of holding a RecordId. A node holds either
+    * RecordIds or tuples, never both.
+    * @param key[IN] the key to insert
+    * @param value[IN] the characters of the value
+    * @param length[IN] the length of the value
+    * @return 0 if successful. Return an error code if the node is full.
+    */
+    RC insertTuple(int key, const char* value, int length);
+
+   /**
+    * Insert the (key, value) tuple to the node and split the node
+    * with sibling, so that both hold about the same number of bytes.
+    * If the tuple goes after every other, the node keeps about
+    * fillFactor percent of the bytes instead.
+    * The first key of the sibling node is returned in siblingKey.
+    * @param key[IN] the key to insert.
+    * @param value[IN] the characters of the value
+    * @param length[IN] the length of the value
+    * @param sibling[IN] the sibling node to split with. This node MUST be EMPTY when this function is called.
+    * @param siblingKey[OUT] the first key in the sibling node after split.
+    * @param fillFactor[IN] the percentage of the bytes to keep after an append (50 to 100)
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC insertTupleAndSplit(int key, const char* value, int length,
+                           BTLeafNode& sibling, int& siblingKey, int fillFactor = 50);
+
+   /**
+    * Read the (key, value) tuple from the eid entry of a node with tuples.
+    * The value is not null-terminated, and points into the node.
+    * @param eid[IN] the entry number to read the tuple from
+    * @param key[OUT] the key from the slot
+    * @param value[OUT] the characters of the value
+    * @param length[OUT] the length of the value
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC readTuple(int eid, int& key, const char*& value, int& length);
+
    /**
     * Return the pid of the next sibling node.
     * @return the PageId of the next sibling node 
@@ -100,6 +269,7 @@ class BTLeafNode {
 
     /**
     * Set the number of keys stored in the node.
+    * The entries past the new number are dropped.
     * @return 0 if successful. Return error code if there is an error.
     */
     RC setKeyCount(int numKeys);
@@ -107,6 +277,7 @@ class BTLeafNode {
  
    /**
     * Read the content of the node from the page pid in the PageFile pf.
+    * The page stays pinned in the buffer pool while the node uses it.
     * @param pid[IN] the PageId to read
     * @param pf[IN] PageFile to read from
     * @return 0 if successful. Return an error code if there is an error.
@@ -122,31 +293,189 @@ class BTLeafNode {
     RC write(PageId pid, PageFile& pf);
 
   private:
-    // TODO: Somehow mark this as a leaf node
-    struct LeafEntry {
-        int key; 
-        RecordId rid;
-    };
+    // The fields of an entry. Each is packed in an array of its own.
+    enum { KEY, PID, SID, FIELDS };
+
+    // Where the bases and the widths of the fields are in the buffer
+    static const int BASE_OFFSET = sizeof(int) + sizeof(PageId);
+    static const int WIDTH_OFFSET = BASE_OFFSET + FIELDS * sizeof(int);
 
-    // Now we can use "LeafEntry" to declare a new instance, 
-    // rather than "struct LeafEntry"
-    typedef struct LeafEntry LeafEntry;
+    // The bytes at the start of the buffer that are not entries
+    static const int HEADER_SIZE = WIDTH_OFFSET + sizeof(int);
+
+    // The most bytes that an entry takes, its key and its RecordId
+    static const int ENTRY_SIZE = sizeof(int) + sizeof(RecordId);
+
+    // The most entries that a node of any page size holds (see maxKeys())
+    static const int MAX_KEYS = 2 * (PageFile::MAX_PAGE_SIZE / ENTRY_SIZE);
 
    /**
-    * The main memory buffer for loading the content of the disk page 
-    * that contains the node. It is composed of (key, RecordID) pairs,
-    * stored as LeafEntry structs.
+    * The content of the disk page that contains the node. After read(),
+    * it points straight into the pinned buffer pool frame of the page;
+    * a node that has not been read yet uses newPage instead.
+    * It is composed of (key, RecordID) pairs.
     *
     * The first sizeof(int) bytes of the buffer are reserved for 
     * holding the number of keys in the buffer. The next sizeof(PageId) 
     * bytes after that will hold the PageId of the next sibling node. 
-    * The remaining bytes will fit 
-    * floor( (1024 - (sizeof(int) + sizeof(PageId)) / sizeof(LeafEntry) ) entries. 
-    * That is, we pack the entries into the space left over. Any wasted
-    * empty space at the end of the buffer/node is left as is. 
+    * The header goes on with the base of each field (the key, and the
+    * pid and the sid of the RecordId) as an int, and the width of each
+    * field as a byte, followed by a byte left unused.
+    *
+    * The keys come next, as one sorted array, so that a search compares
+    * them a vector at a time (see KeySearch). The pids follow right after
+    * the last key in an array of their own, in the same order, and then
+    * the sids. Each field is kept as its difference from the base of the
+    * field, which is its smallest value in the node, in 1, 2 or 4 bytes:
+    * the fewest that hold the largest difference. Clustered keys and
+    * RecordIds thus take 3 to 6 bytes an entry instead of 12.
+    * A field of width 4 has a base of 0 and holds the values themselves,
+    * so that keys of any range are searched as ints.
+    * The arrays move along as entries come and go, and are packed anew
+    * whenever an entry does not fit the widths of the node.
+    * Any wasted empty space at the end of the buffer/node is left as is.
+    *
+    * In a node with tuples, the values are packed from the end of the
+    * buffer towards the entries, and the RecordId of an entry holds the
+    * offset of its value in the buffer (pid) and its length (sid).
+    * The entries are thus kept sorted and searched the same way. They
+    * take the full 12 bytes, so that a split by bytes can count on it.
     */
-    char buffer[PageFile::PAGE_SIZE];       
-}; 
+    char* buffer;
+
+    // The pinned page of the node after read()
+    PageHandle page;
+
+    // The size of the page that holds the node
+    int pageSize;
+
+    // The content of a new node that is not backed by a page yet
+    char newPage[PageFile::MAX_PAGE_SIZE];
+
+   /**
+    * Return the offset of the first byte of the values of a node with tuples.
+    */
+    int getTupleStart();
+
+   /**
+    * Return the most entries that the node holds, however they pack.
+    * Either half of a full node fits in a page even at 12 bytes an
+    * entry, so a split never runs out of room.
+    */
+    int maxKeys()
+    {
+        return 2 * ((pageSize - HEADER_SIZE) / ENTRY_SIZE) - 1;
+    }
+
+   /**
+    * Return the base of a field of the entries.
+    */
+    int getBase(int field)
+    {
+        int base;
+        memcpy(&base, &buffer[BASE_OFFSET + field * sizeof(int)], sizeof(int));
+        return base;
+    }
+
+   /**
+    * Return the width of a field of the entries, in bytes.
+    */
+    int getWidth(int field)
+    {
+        return (unsigned char) buffer[WIDTH_OFFSET + field];
+    }
+
+   /**
+    * Return the offset of the array of a field in the buffer,
+    * when the node holds numKeys keys.
+    */
+    int fieldOffset(int field, int numKeys);
+
+   /**
+    * Return the number of keys in the node that are smaller than key.
+    */
+    int countLess(int key);
+
+   /**
+    * Insert the (key, rid) pair to the node, keeping the entries
+    * in front of limit. They are packed anew if need be.
+    * @param key[IN] the key to insert
+    * @param rid[IN] the RecordId to insert
+    * @param limit[IN] the offset that the entries have to end by
+    * @param wide[IN] keep every field of the entries in 4 bytes
+    * @return 0 if successful. RC_NODE_FULL if the entry does not fit.
+    */
+    RC insertEntry(int key, const RecordId& rid, int limit, bool wide);
+
+   /**
+    * Find the base and the width that each field of sorted entries is
+    * packed with.
+    * @param keys[IN] the sorted keys
+    * @param rids[IN] their RecordIds
+    * @param numKeys[IN] the number of entries
+    * @param wide[IN] keep every field of the entries in 4 bytes
+    * @param base[OUT] the base of each field
+    * @param width[OUT] the width of each field
+    * @return the bytes that an entry takes
+    */
+    static int packFields(const int* keys, const RecordId* rids, int numKeys, bool wide,
+                          int* base, int* width);
+
+   /**
+    * Tell if sorted entries fit in the node, packed as setEntries() would.
+    */
+    bool fits(const int* keys, const RecordId* rids, int numKeys);
+
+   /**
+    * Tell if both halves of sorted entries fit in the node when they
+    * are split at an entry, for BTreeAlgo::atKeyBoundary(). The first
+    * is for tuples, and the second for RecordIds.
+    */
+    struct TupleHalvesFit {
+        const int* bytes;     // the bytes of the tuples in front of each one
+        int        numKeys;
+        int        capacity;  // the bytes that the entries of a node may take
+
+        bool operator()(int at) const
+        {
+            return bytes[at] <= capacity && bytes[numKeys] - bytes[at] <= capacity;
+        }
+    };
+
+    struct HalvesFit {
+        BTLeafNode*     node;
+        const int*      keys;
+        const RecordId* rids;
+        int             numKeys;
+
+        bool operator()(int at) const
+        {
+            return node->fits(keys, rids, at) &&
+                   node->fits(keys + at, rids + at, numKeys - at);
+        }
+    };
+
+   /**
+    * Read every entry of the node.
+    * @param keys[OUT] the keys, getKeyCount() of them
+    * @param rids[OUT] their RecordIds
+    */
+    void readEntries(int* keys, RecordId* rids);
+
+   /**
+    * Replace the entries of the node with sorted keys and their RecordIds,
+    * packed in the fewest bytes that hold them.
+    * @param keys[IN] the sorted keys
+    * @param rids[IN] their RecordIds
+    * @param numKeys[IN] the number of entries
+    * @param limit[IN] the offset that the entries have to end by
+    * @param wide[IN] keep every field of the entries in 4 bytes
+    * @return 0 if successful. RC_NODE_FULL, with the node left as it
+    *         was, if the entries do not fit.
+    */
+    RC setEntries(const int* keys, const RecordId* rids, int numKeys,
+                  int limit, bool wide);
+};
 
 
 /**
@@ -154,9 +483,16 @@ class BTLeafNode {
  */
 class BTNonLeafNode {
   public:
-    BTNonLeafNode()
+    /**
+     * Create an empty node for a page of the given size.
+     * A node that is read() takes the page size of its PageFile.
+     * @param pageSize[IN] the size of the page that will hold the node
+     */
+    explicit BTNonLeafNode(int pageSize = PageFile::getDefaultPageSize())
     {
-        memset(buffer, 0, PageFile::PAGE_SIZE);
+        buffer = newPage;
+        this->pageSize = pageSize;
+        memset(newPage, 0, pageSize);
     }
 
     /** 
@@ -172,13 +508,19 @@ class BTNonLeafNode {
     * Remember that all keys inside a B+tree node should be kept sorted.
     * @param key[IN] the key to insert
     * @param pid[IN] the PageId to insert
+    * @param eid[IN] the entry that the pair becomes. When a child splits,
+    *                its new sibling goes right behind it, which may be in
+    *                front of keys equal to key (see locateChildPtr()).
+    *                -1 puts the pair behind the keys equal to key.
     * @return 0 if successful. Return an error code if the node is full.
     */
-    RC insert(int key, PageId pid);
+    RC insert(int key, PageId pid, int eid = -1);
 
    /**
     * Insert the (key, pid) pair to the node
     * and split the node half and half with sibling.
+    * If the pair goes after every entry, the node keeps fillFactor
+    * percent of the entries instead, as in BTLeafNode::insertAndSplit().
     * The sibling node MUST be empty when this function is called.
     * The middle key after the split is returned in midKey.
     * Remember that all keys inside a B+tree node should be kept sorted.
@@ -186,9 +528,12 @@ class BTNonLeafNode {
     * @param pid[IN] the PageId to insert
     * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
     * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
+    * @param fillFactor[IN] the percentage of the entries to keep after an append (50 to 100)
+    * @param eid[IN] the entry that the pair becomes, as in insert()
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey);
+    RC insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey,
+                      int fillFactor = 50, int eid = -1);
 
    /**
     * Given the searchKey, find the child-node pointer to follow and
@@ -200,6 +545,29 @@ class BTNonLeafNode {
     */
     RC locateChildPtr(int searchKey, PageId& pid);
 
+   /**
+    * The same, also giving the position of the child: 0 for the
+    * leftmost one, and i for the one behind the i'th key. A new
+    * sibling of the child, after a split, goes to the entry eid.
+    * @param searchKey[IN] the searchKey that is being looked up.
+    * @param pid[OUT] the pointer to the child node to follow.
+    * @param eid[OUT] the position of the child
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC locateChildPtr(int searchKey, PageId& pid, int& eid);
+
+   /**
+    * Given the searchKey, find the child-node pointer to follow to the
+    * first entry with searchKey, or with the smallest key above it.
+    * Unlike locateChildPtr(), which finds the child that a new entry
+    * goes to, it stops in front of a key equal to searchKey, since the
+    * entries of a key may start in one child and go on in the next.
+    * @param searchKey[IN] the searchKey that is being looked up.
+    * @param pid[OUT] the pointer to the child node to follow.
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC locateFirstChildPtr(int searchKey, PageId& pid);
+
    /**
     * Initialize the root node with (pid1, key, pid2).
     * @param pid1[IN] the first PageId to insert
@@ -217,12 +585,14 @@ class BTNonLeafNode {
 
     /**
     * Set the number of keys stored in the node.
+    * The entries past the new number are dropped.
     * @return 0 if successful. Return error code if there is an error.
     */
     RC setKeyCount(int numKeys);
 
    /**
     * Read the content of the node from the page pid in the PageFile pf.
+    * The page stays pinned in the buffer pool while the node uses it.
     * @param pid[IN] the PageId to read
     * @param pf[IN] PageFile to read from
     * @return 0 if successful. Return an error code if there is an error.
@@ -238,19 +608,46 @@ class BTNonLeafNode {
     RC write(PageId pid, PageFile& pf);
 
   private:
-    struct NonLeafEntry {
-        int key; 
-        PageId pid;
-    };
+    // The bytes at the start of the buffer that are not entries
+    static const int HEADER_SIZE = sizeof(int) + sizeof(PageId);
+
+    // The bytes that an entry takes, its key and the PageId behind it
+    static const int ENTRY_SIZE = sizeof(int) + sizeof(PageId);
+
+   /**
+    * The content of the disk page that contains the node. After read(),
+    * it points straight into the pinned buffer pool frame of the page;
+    * a node that has not been read yet uses newPage instead.
+    *
+    * The first sizeof(int) bytes hold the number of keys, and the next
+    * sizeof(PageId) bytes the leftmost PageId. The keys come next as one
+    * sorted array of ints, and the PageId behind each key follows right
+    * after the last key, in an array of their own, as in a leaf node.
+    */
+    char* buffer;
+
+    // The pinned page of the node after read()
+    PageHandle page;
+
+    // The size of the page that holds the node
+    int pageSize;
+
+    // The content of a new node that is not backed by a page yet
+    char newPage[PageFile::MAX_PAGE_SIZE];
+
+   /**
+    * Return the offset of the PageId behind the eid key in the buffer,
+    * when the node holds numKeys keys.
+    */
+    int pidOffset(int eid, int numKeys)
+    {
+        return HEADER_SIZE + numKeys * sizeof(int) + eid * sizeof(PageId);
+    }
 
-    // Now we can use "NonLeafEntry" to declare a new instance, 
-    // rather than "struct NonLeafEntry"
-    typedef struct NonLeafEntry NonLeafEntry;
    /**
-    * The main memory buffer for loading the content of the disk page 
-    * that contains the node.
+    * Replace the entries of the node with sorted keys and their PageIds.
     */
-    char buffer[PageFile::PAGE_SIZE];
+    void setEntries(const int* keys, const PageId* pids, int numKeys);
 }; 
 
 #endif /* BTREENODE_H */
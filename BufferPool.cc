@@ -0,0 +1,741 @@
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <sys/uio.h>
+#include "BufferPool.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+using std::map;
+using std::pair;
+using std::make_pair;
+using std::vector;
+
+// flush everything once more than this share of the frames is dirty
+static const int DIRTY_LIMIT_PERCENT = 50;
+
+BufferPool::BufferPool(int capacity)
+{
+  this->capacity = capacity;
+  capacityBytes = 0;
+  arenaCount = 0;
+  writeBack = true;
+  hitCount = 0;
+  missCount = 0;
+  writeBackCount = 0;
+  pthread_mutex_init(&fileLatch, NULL);
+}
+
+BufferPool::~BufferPool()
+{
+  // last chance to save the pages of files that were never closed
+  flushAll();
+
+  for (int a = 0; a < arenaCount; a++) {
+    tearDown(*arenas[a]);
+    delete arenas[a];
+  }
+  for (unsigned i = 0; i < files.size(); i++) delete files[i].stats;
+  pthread_mutex_destroy(&fileLatch);
+}
+
+RC BufferPool::setCapacity(int capacity)
+{
+  if (capacity <= 0) return RC_INVALID_ATTRIBUTE;
+  return resize(capacity, 0);
+}
+
+RC BufferPool::setCapacityMB(int megabytes)
+{
+  if (megabytes <= 0) return RC_INVALID_ATTRIBUTE;
+  return resize(0, (long long)megabytes << 20);
+}
+
+int BufferPool::getCapacity(int pageSize) const
+{
+  Arena* arena = arenaOf(pageSize);
+  return (arena != NULL) ? arena->capacity : framesFor(pageSize);
+}
+
+RC BufferPool::resize(int capacity, long long capacityBytes)
+{
+  RC rc;
+
+  // the cached pages are dropped, so save the dirty ones first
+  if ((rc = flushAll()) < 0) return rc;
+
+  this->capacity = capacity;
+  this->capacityBytes = capacityBytes;
+  for (int a = 0; a < arenaCount; a++) {
+    tearDown(*arenas[a]);
+    arenas[a]->capacity = framesFor(arenas[a]->frameSize);
+    setUp(*arenas[a]);
+  }
+  hitCount = 0;
+  missCount = 0;
+
+  return 0;
+}
+
+int BufferPool::framesFor(int pageSize) const
+{
+  if (capacity > 0) return capacity;
+  return (int)std::max(capacityBytes / pageSize, 1LL);
+}
+
+void BufferPool::setUp(Arena& arena)
+{
+  int capacity = arena.capacity;
+
+  arena.data = new char[(size_t)capacity * arena.frameSize];
+  arena.frames.resize(capacity);
+
+  // a small pool is not worth splitting. a page can only be cached in
+  // its own partition, so tiny partitions would run out of unpinned frames.
+  arena.partitionCount = 1;
+  while (arena.partitionCount * 2 <= MAX_PARTITIONS &&
+         capacity / (arena.partitionCount * 2) >= MIN_PARTITION_SIZE) {
+    arena.partitionCount *= 2;
+  }
+  arena.partitionSize = capacity / arena.partitionCount;
+  arena.partitions = new Partition[arena.partitionCount];
+
+  for (int p = 0; p < arena.partitionCount; p++) {
+    pthread_mutex_init(&arena.partitions[p].latch, NULL);
+    pthread_cond_init(&arena.partitions[p].loadDone, NULL);
+
+    // use roughly two buckets per frame so that chains stay short
+    int size = (p < arena.partitionCount - 1) ? arena.partitionSize
+                                              : capacity - p * arena.partitionSize;
+    int nbuckets = 1;
+    while (nbuckets < 2 * size) nbuckets <<= 1;
+    arena.partitions[p].buckets.assign(nbuckets, -1);
+
+    // the 2Q paper suggests a quarter of the frames for "in",
+    // and remembering as many evicted pages as half the frames
+    arena.partitions[p].inLimit = std::max(1, size / 4);
+    arena.partitions[p].ghostLimit = std::max(1, size / 2);
+  }
+
+  reset(arena);
+}
+
+void BufferPool::tearDown(Arena& arena)
+{
+  for (int p = 0; p < arena.partitionCount; p++) {
+    pthread_mutex_destroy(&arena.partitions[p].latch);
+    pthread_cond_destroy(&arena.partitions[p].loadDone);
+  }
+  delete [] arena.partitions;
+  delete [] arena.data;
+}
+
+RC BufferPool::setWriteBack(bool on)
+{
+  RC rc;
+
+  if (!on && (rc = flushAll()) < 0) return rc;
+  writeBack = on;
+  return 0;
+}
+
+int BufferPool::registerFile(dev_t dev, ino_t ino, int pageSize, off_t base)
+{
+  int fileId;
+  int oldPageSize = 0;
+  pair<dev_t, ino_t> key = make_pair(dev, ino);
+
+  pthread_mutex_lock(&fileLatch);
+  map<pair<dev_t, ino_t>, int>::const_iterator it = fileIds.find(key);
+  if (it != fileIds.end()) {
+    fileId = it->second;
+    oldPageSize = files[fileId].pageSize;
+  } else {
+    File file;
+    file.fd = -1;
+    file.stats = new IOStats;
+    fileId = (int)fileIds.size();
+    fileIds[key] = fileId;
+    files.push_back(file);
+  }
+
+  // the first file with this page size sets up its frames. the arena
+  // is complete before it is counted, so lookups need no latch.
+  if (arenaOf(pageSize) == NULL && arenaCount < MAX_ARENAS) {
+    Arena* arena = new Arena;
+    arena->frameSize = pageSize;
+    arena->capacity = framesFor(pageSize);
+    setUp(*arena);
+    arenas[arenaCount] = arena;
+    __atomic_store_n(&arenaCount, arenaCount + 1, __ATOMIC_RELEASE);
+  }
+
+  // a reused inode may belong to a file with a different layout
+  files[fileId].pageSize = pageSize;
+  files[fileId].base = base;
+  pthread_mutex_unlock(&fileLatch);
+
+  // the pages cached under another page size are those of a file
+  // that is gone
+  if (oldPageSize != 0 && oldPageSize != pageSize) {
+    Arena* old = arenaOf(oldPageSize);
+    if (old != NULL) dropFile(*old, fileId);
+  }
+
+  return fileId;
+}
+
+IOStats BufferPool::getFileStats(int fileId)
+{
+  pthread_mutex_lock(&fileLatch);
+  IOStats stats = *files[fileId].stats;
+  pthread_mutex_unlock(&fileLatch);
+  return stats;
+}
+
+void BufferPool::detachFile(int fileId, int fd)
+{
+  pthread_mutex_lock(&fileLatch);
+  if (files[fileId].fd == fd) files[fileId].fd = -1;
+  pthread_mutex_unlock(&fileLatch);
+}
+
+char* BufferPool::fetch(int fileId, int pageSize, PageId pid, bool& cached,
+                        bool sequential, bool ahead)
+{
+  Arena* arena = arenaOf(pageSize);
+  if (arena == NULL) return NULL;
+  Partition& part = partitionOf(*arena, fileId, pid);
+
+  pthread_mutex_lock(&part.latch);
+  int f = acquire(*arena, part, fileId, pid, sequential, ahead, cached);
+  if (f >= 0 && !cached) {
+    arena->frames[f].loading = true;
+    arena->frames[f].ahead = ahead;
+  }
+  pthread_mutex_unlock(&part.latch);
+
+  if (f < 0) return NULL;
+  __sync_fetch_and_add(cached ? &hitCount : &missCount, 1);
+  return arena->data + (size_t)f * arena->frameSize;
+}
+
+void BufferPool::loaded(char* frame, bool ok)
+{
+  int f;
+  Arena& arena = *arenaOfFrame(frame, f);
+  Partition& part = partitionOfFrame(arena, f);
+
+  pthread_mutex_lock(&part.latch);
+  arena.frames[f].loading = false;
+  if (!ok) drop(arena, f);
+  pthread_cond_broadcast(&part.loadDone);
+  pthread_mutex_unlock(&part.latch);
+}
+
+char* BufferPool::update(int fileId, int pageSize, PageId pid, int fd, bool dirty)
+{
+  bool cached;
+
+  Arena* arena = arenaOf(pageSize);
+  if (arena == NULL) return NULL;
+
+  // too many dirty pages. write all of them back in one go
+  // rather than one at a time as they are evicted.
+  if (dirty && arena->dirtyCount * 100 >= arena->capacity * DIRTY_LIMIT_PERCENT) {
+    if (flushAll() < 0) return NULL;
+  }
+
+  Partition& part = partitionOf(*arena, fileId, pid);
+
+  pthread_mutex_lock(&part.latch);
+  int f = acquire(*arena, part, fileId, pid, false, false, cached);
+  if (f >= 0) setDirty(*arena, f, fd, dirty);
+  pthread_mutex_unlock(&part.latch);
+
+  return (f < 0) ? NULL : arena->data + (size_t)f * arena->frameSize;
+}
+
+RC BufferPool::markDirty(char* frame, int fd)
+{
+  int f;
+  Arena& arena = *arenaOfFrame(frame, f);
+
+  if (arena.dirtyCount * 100 >= arena.capacity * DIRTY_LIMIT_PERCENT) {
+    if (flushAll() < 0) return RC_FILE_WRITE_FAILED;
+  }
+
+  Partition& part = partitionOfFrame(arena, f);
+
+  pthread_mutex_lock(&part.latch);
+  setDirty(arena, f, fd, true);
+  pthread_mutex_unlock(&part.latch);
+
+  return 0;
+}
+
+RC BufferPool::flushFile(int fileId)
+{
+  Arena* arena = arenaOfFile(fileId);
+  return (arena != NULL) ? flushArena(*arena, fileId) : 0;
+}
+
+RC BufferPool::flushArena(Arena& arena, int fileId)
+{
+  if (arena.dirtyCount == 0) return 0;
+
+  lockAll(arena);
+  RC rc = flushLocked(arena, fileId);
+  unlockAll(arena);
+
+  return rc;
+}
+
+RC BufferPool::flushAll()
+{
+  RC rc = 0;
+
+  int narenas = __atomic_load_n(&arenaCount, __ATOMIC_ACQUIRE);
+  for (int a = 0; a < narenas && rc == 0; a++) {
+    Arena& arena = *arenas[a];
+    if (arena.dirtyCount == 0) continue;
+
+    lockAll(arena);
+    pthread_mutex_lock(&fileLatch);
+    int nfiles = (int)files.size();
+    pthread_mutex_unlock(&fileLatch);
+
+    for (int fileId = 0; fileId < nfiles && rc == 0; fileId++) {
+      rc = flushLocked(arena, fileId);
+    }
+    unlockAll(arena);
+  }
+
+  return rc;
+}
+
+void BufferPool::unpin(char* frame)
+{
+  int f;
+  Arena& arena = *arenaOfFrame(frame, f);
+  Partition& part = partitionOfFrame(arena, f);
+
+  pthread_mutex_lock(&part.latch);
+  if (--arena.frames[f].pinCount == 0) part.pinned--;
+  pthread_mutex_unlock(&part.latch);
+}
+
+void BufferPool::invalidateFile(int fileId)
+{
+  Arena* arena = arenaOfFile(fileId);
+  if (arena != NULL) dropFile(*arena, fileId);
+}
+
+void BufferPool::dropFile(Arena& arena, int fileId)
+{
+  lockAll(arena);
+  for (int f = 0; f < arena.capacity; f++) {
+    if (arena.frames[f].fileId == fileId && arena.frames[f].pinCount == 0) drop(arena, f);
+  }
+  unlockAll(arena);
+}
+
+int BufferPool::acquire(Arena& arena, Partition& part, int fileId, PageId pid,
+                        bool sequential, bool ahead, bool& cached)
+{
+  vector<Frame>& frames = arena.frames;
+
+  for (;;) {
+    int f = find(arena, part, fileId, pid);
+    if (f >= 0) {
+      // a page that is referenced again becomes hot, and a hot page
+      // moves to the newest end of its queue. a reference to the page
+      // that was referenced last does not count: it is most likely the
+      // next record on the same page, not a real reuse. neither do
+      // references by sequential scans. the first reference to a page
+      // that was read ahead is where its life in "in" really starts.
+      if (frames[f].pinCount++ == 0) part.pinned++;
+      if (ahead) {
+        // not a reference at all
+      } else if (frames[f].ahead) {
+        frames[f].ahead = false;
+        if (frames[f].queue == IN_QUEUE) {
+          unlink(arena, part.in, f);
+          append(arena, part, IN_QUEUE, f);
+        }
+      } else if (frames[f].queue == HOT_QUEUE) {
+        unlink(arena, part.hot, f);
+        append(arena, part, HOT_QUEUE, f);
+      } else if (!sequential && part.lastRef != f) {
+        unlink(arena, part.in, f);
+        append(arena, part, HOT_QUEUE, f);
+      }
+      if (!sequential && !ahead) frames[f].sequential = false;
+      if (!ahead) part.lastRef = f;
+
+      // another thread is reading the page in. wait for it
+      while (frames[f].loading) pthread_cond_wait(&part.loadDone, &part.latch);
+      if (frames[f].fileId == fileId && frames[f].pid == pid) {
+        cached = true;
+        return f;
+      }
+
+      // the read failed and the page was dropped. try again
+      if (--frames[f].pinCount == 0) part.pinned--;
+      continue;
+    }
+
+    // pages read ahead may take no more than half of the frames,
+    // so that the pages that are actually asked for always find one
+    if (ahead && part.pinned * 2 >= part.free.size + part.in.size + part.hot.size) {
+      return -1;
+    }
+
+    int victimFileId;
+    if ((f = grab(arena, part, fileId, pid, sequential, victimFileId)) >= 0) {
+      frames[f].pinCount++;
+      part.pinned++;
+      if (!ahead) part.lastRef = f;
+      cached = false;
+      return f;
+    }
+    if (victimFileId < 0) return -1;
+
+    // the victim is dirty. write back its file without holding the
+    // latch (flushing takes every latch), then look for a frame again
+    pthread_mutex_unlock(&part.latch);
+    RC rc = flushArena(arena, victimFileId);
+    pthread_mutex_lock(&part.latch);
+    if (rc < 0) return -1;
+  }
+}
+
+int BufferPool::grab(Arena& arena, Partition& part, int fileId, PageId pid,
+                     bool sequential, int& victimFileId)
+{
+  vector<Frame>& frames = arena.frames;
+
+  victimFileId = -1;
+
+  int f = pickVictim(arena, part);
+  if (f < 0) return -1;
+  if (frames[f].dirty) {
+    victimFileId = frames[f].fileId;
+    return -1;
+  }
+  if (frames[f].fileId >= 0) {
+    // remember a page that leaves "in" without having been used much,
+    // so that it is known to be hot if it is referenced again soon
+    if (frames[f].queue == IN_QUEUE && !frames[f].sequential) {
+      remember(part, frames[f].fileId, frames[f].pid);
+    }
+    unlinkHash(arena, f);
+  }
+  unlink(arena, queueOf(arena, part, f), f);
+
+  frames[f].fileId = fileId;
+  frames[f].pid = pid;
+  frames[f].loading = false;
+  frames[f].sequential = sequential;
+  frames[f].ahead = false;
+
+  int b = hashOf(fileId, pid) & (part.buckets.size() - 1);
+  frames[f].hashNext = part.buckets[b];
+  part.buckets[b] = f;
+
+  // a page that is referenced again after it left "in" is hot
+  if (!sequential && forget(part, fileId, pid)) {
+    append(arena, part, HOT_QUEUE, f);
+  } else {
+    append(arena, part, IN_QUEUE, f);
+  }
+
+  return f;
+}
+
+int BufferPool::pickVictim(Arena& arena, Partition& part)
+{
+  int f;
+
+  if ((f = firstUnpinned(arena, part.free)) >= 0) return f;
+
+  // "in" is replaced first once it has more than its share of the
+  // frames, so pages that are used only once do not stay for long
+  if (part.in.size > part.inLimit && (f = firstUnpinned(arena, part.in)) >= 0) return f;
+  if ((f = firstUnpinned(arena, part.hot)) >= 0) return f;
+  return firstUnpinned(arena, part.in);
+}
+
+int BufferPool::firstUnpinned(const Arena& arena, const Queue& queue) const
+{
+  int f = queue.head;
+  while (f >= 0 && arena.frames[f].pinCount > 0) f = arena.frames[f].next;
+  return f;
+}
+
+void BufferPool::remember(Partition& part, int fileId, PageId pid)
+{
+  if (!part.ghosts.insert(PageKey(fileId, pid)).second) return;
+  part.ghostQueue.push_back(PageKey(fileId, pid));
+
+  // forget the oldest page once there are too many
+  if ((int)part.ghostQueue.size() > part.ghostLimit) {
+    part.ghosts.erase(part.ghostQueue.front());
+    part.ghostQueue.pop_front();
+  }
+}
+
+bool BufferPool::forget(Partition& part, int fileId, PageId pid)
+{
+  // the entry in ghostQueue is left behind, and goes away with age
+  return part.ghosts.erase(PageKey(fileId, pid)) > 0;
+}
+
+void BufferPool::setDirty(Arena& arena, int f, int fd, bool dirty)
+{
+  Frame& frame = arena.frames[f];
+
+  if (dirty) {
+    pthread_mutex_lock(&fileLatch);
+    files[frame.fileId].fd = fd;
+    pthread_mutex_unlock(&fileLatch);
+
+    if (!frame.dirty) __sync_fetch_and_add(&arena.dirtyCount, 1);
+    frame.dirty = true;
+  } else if (frame.dirty) {
+    // the caller has just written the page to disk
+    frame.dirty = false;
+    __sync_fetch_and_sub(&arena.dirtyCount, 1);
+  }
+}
+
+RC BufferPool::flushLocked(Arena& arena, int fileId)
+{
+  vector<Frame>& frames = arena.frames;
+
+  // collect the dirty pages of the file in pid order
+  vector<pair<PageId, int> > pages;
+  for (int f = 0; f < arena.capacity; f++) {
+    if (frames[f].dirty && frames[f].fileId == fileId) {
+      pages.push_back(make_pair(frames[f].pid, f));
+    }
+  }
+  if (pages.empty()) return 0;
+
+  pthread_mutex_lock(&fileLatch);
+  File file = files[fileId];
+  pthread_mutex_unlock(&fileLatch);
+
+  if (file.fd < 0) return RC_FILE_WRITE_FAILED;
+  std::sort(pages.begin(), pages.end());
+
+  // write each run of consecutive pages with a single system call
+  vector<int> run;
+  for (unsigned i = 0; i < pages.size(); i++) {
+    if (!run.empty() && (pages[i].first != frames[run.back()].pid + 1 ||
+                         (int)run.size() >= IOV_MAX)) {
+      RC rc = writeRun(arena, file, run);
+      if (rc < 0) return rc;
+      run.clear();
+    }
+    run.push_back(pages[i].second);
+  }
+  return writeRun(arena, file, run);
+}
+
+RC BufferPool::writeRun(Arena& arena, const File& file, const vector<int>& run)
+{
+  struct iovec iov[IOV_MAX];
+  ssize_t len = 0;
+
+  for (unsigned i = 0; i < run.size(); i++) {
+    iov[i].iov_base = arena.data + (size_t)run[i] * arena.frameSize;
+    iov[i].iov_len = file.pageSize;
+    len += file.pageSize;
+  }
+
+  off_t offset = file.base + (off_t)arena.frames[run[0]].pid * file.pageSize;
+  long long start = IOStats::now();
+  ssize_t written = ::pwritev(file.fd, iov, (int)run.size(), offset);
+  file.stats->countCall(start);
+  if (written != len) return RC_FILE_WRITE_FAILED;
+  file.stats->countWrite((int)run.size(), len);
+
+  for (unsigned i = 0; i < run.size(); i++) {
+    arena.frames[run[i]].dirty = false;
+  }
+  __sync_fetch_and_sub(&arena.dirtyCount, (int)run.size());
+  __sync_fetch_and_add(&writeBackCount, (int)run.size());
+
+  return 0;
+}
+
+BufferPool::Arena* BufferPool::arenaOf(int pageSize) const
+{
+  int narenas = __atomic_load_n(&arenaCount, __ATOMIC_ACQUIRE);
+  for (int a = 0; a < narenas; a++) {
+    if (arenas[a]->frameSize == pageSize) return arenas[a];
+  }
+  return NULL;
+}
+
+BufferPool::Arena* BufferPool::arenaOfFile(int fileId)
+{
+  pthread_mutex_lock(&fileLatch);
+  int pageSize = files[fileId].pageSize;
+  pthread_mutex_unlock(&fileLatch);
+  return arenaOf(pageSize);
+}
+
+BufferPool::Arena* BufferPool::arenaOfFrame(const char* frame, int& f) const
+{
+  int narenas = __atomic_load_n(&arenaCount, __ATOMIC_ACQUIRE);
+  for (int a = 0; a < narenas; a++) {
+    Arena* arena = arenas[a];
+    if (frame >= arena->data &&
+        frame < arena->data + (size_t)arena->capacity * arena->frameSize) {
+      f = (int)((frame - arena->data) / arena->frameSize);
+      return arena;
+    }
+  }
+  return NULL;
+}
+
+unsigned BufferPool::hashOf(int fileId, PageId pid) const
+{
+  return (unsigned)pid * 2654435761u ^ (unsigned)fileId * 40503u;
+}
+
+BufferPool::Partition& BufferPool::partitionOf(Arena& arena, int fileId, PageId pid)
+{
+  // the low bits pick the bucket, so take the partition from the high bits.
+  // partitionCount is a power of two, so the mask picks the bits.
+  return arena.partitions[(hashOf(fileId, pid) >> 24) & (arena.partitionCount - 1)];
+}
+
+BufferPool::Partition& BufferPool::partitionOfFrame(Arena& arena, int f)
+{
+  int p = f / arena.partitionSize;
+  return arena.partitions[(p < arena.partitionCount) ? p : arena.partitionCount - 1];
+}
+
+int BufferPool::find(const Arena& arena, const Partition& part, int fileId, PageId pid) const
+{
+  // buckets.size() is a power of two, so the mask picks the low bits
+  int b = hashOf(fileId, pid) & (part.buckets.size() - 1);
+  for (int f = part.buckets[b]; f >= 0; f = arena.frames[f].hashNext) {
+    if (arena.frames[f].fileId == fileId && arena.frames[f].pid == pid) return f;
+  }
+  return -1;
+}
+
+void BufferPool::unlinkHash(Arena& arena, int f)
+{
+  vector<Frame>& frames = arena.frames;
+  Partition& part = partitionOfFrame(arena, f);
+  int* link = &part.buckets[hashOf(frames[f].fileId, frames[f].pid) &
+                            (part.buckets.size() - 1)];
+  while (*link != f) link = &frames[*link].hashNext;
+  *link = frames[f].hashNext;
+  frames[f].hashNext = -1;
+}
+
+BufferPool::Queue& BufferPool::queueOf(Arena& arena, Partition& part, int f)
+{
+  switch (arena.frames[f].queue) {
+  case IN_QUEUE:  return part.in;
+  case HOT_QUEUE: return part.hot;
+  default:        return part.free;
+  }
+}
+
+void BufferPool::unlink(Arena& arena, Queue& queue, int f)
+{
+  vector<Frame>& frames = arena.frames;
+
+  if (frames[f].prev >= 0) frames[frames[f].prev].next = frames[f].next;
+  else queue.head = frames[f].next;
+
+  if (frames[f].next >= 0) frames[frames[f].next].prev = frames[f].prev;
+  else queue.tail = frames[f].prev;
+
+  frames[f].prev = frames[f].next = -1;
+  queue.size--;
+}
+
+void BufferPool::append(Arena& arena, Partition& part, int queue, int f)
+{
+  vector<Frame>& frames = arena.frames;
+
+  frames[f].queue = queue;
+  Queue& q = queueOf(arena, part, f);
+
+  frames[f].prev = q.tail;
+  frames[f].next = -1;
+  if (q.tail >= 0) frames[q.tail].next = f;
+  else q.head = f;
+  q.tail = f;
+  q.size++;
+}
+
+void BufferPool::drop(Arena& arena, int f)
+{
+  Frame& frame = arena.frames[f];
+
+  if (frame.dirty) __sync_fetch_and_sub(&arena.dirtyCount, 1);
+  frame.dirty = false;
+  unlinkHash(arena, f);
+  frame.fileId = -1;
+  frame.pid = -1;
+
+  // a free frame is the first one to be reused
+  Partition& part = partitionOfFrame(arena, f);
+  unlink(arena, queueOf(arena, part, f), f);
+  append(arena, part, FREE_QUEUE, f);
+}
+
+void BufferPool::reset(Arena& arena)
+{
+  for (int p = 0; p < arena.partitionCount; p++) {
+    Partition& part = arena.partitions[p];
+    part.buckets.assign(part.buckets.size(), -1);
+    part.free.head = part.free.tail = -1;
+    part.in.head = part.in.tail = -1;
+    part.hot.head = part.hot.tail = -1;
+    part.free.size = part.in.size = part.hot.size = 0;
+    part.ghostQueue.clear();
+    part.ghosts.clear();
+    part.lastRef = -1;
+    part.pinned = 0;
+  }
+  for (int f = 0; f < arena.capacity; f++) {
+    Frame& frame = arena.frames[f];
+    frame.fileId = -1;
+    frame.pid = -1;
+    frame.hashNext = -1;
+    frame.dirty = false;
+    frame.loading = false;
+    frame.sequential = false;
+    frame.ahead = false;
+    frame.pinCount = 0;
+    append(arena, partitionOfFrame(arena, f), FREE_QUEUE, f);
+  }
+  arena.dirtyCount = 0;
+}
+
+void BufferPool::lockAll(Arena& arena)
+{
+  // always in the same order, so that two flushes cannot deadlock
+  for (int p = 0; p < arena.partitionCount; p++) {
+    pthread_mutex_lock(&arena.partitions[p].latch);
+  }
+}
+
+void BufferPool::unlockAll(Arena& arena)
+{
+  for (int p = arena.partitionCount - 1; p >= 0; p--) {
+    pthread_mutex_unlock(&arena.partitions[p].latch);
+  }
+}
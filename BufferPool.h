@@ -0,0 +1,342 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+#include <pthread.h>
+#include <sys/types.h>
+#include "Bruinbase.h"
+#include "IOStats.h"
+
+typedef int PageId;
+
+/**
+ * A fixed-capacity pool of page frames shared by every PageFile.
+ * Frames are found through a chained hash table keyed by (file, pid),
+ * so a lookup is O(1) regardless of the pool size.
+ *
+ * Pages are replaced with the 2Q policy, so that a scan that touches
+ * every page once cannot push out the pages that are used over and
+ * over (e.g., the upper levels of a B+tree). A page read for the first
+ * time goes to the "in" queue, which is replaced in FIFO order once it
+ * holds more than about a quarter of the frames. A page that is
+ * referenced again, while it is in "in" or shortly after it left it,
+ * is hot, and goes to the "hot" queue, which is replaced in
+ * least-recently-used order. Pages read with the sequential hint of
+ * fetch() are never promoted to "hot".
+ *
+ * Files are identified by their (device, inode) pair rather than by
+ * the file descriptor, so cached pages survive a close() and are
+ * reused when the same table or index is opened again.
+ * The frames of each page size are kept in an arena of their own,
+ * which is set up when the first file with that page size is
+ * registered, so a cached page takes no more memory than its size.
+ * A page is cached in the arena of the page size of its file.
+ *
+ * A frame can be pinned, which keeps its page in the pool (and its
+ * address stable) until it is unpinned. Pinned frames are never evicted.
+ *
+ * In write-back mode (the default) a written page is only copied into
+ * its frame and marked dirty. Dirty pages are written to disk in pid
+ * order, one batch per file, when the file is flushed, when a dirty
+ * page has to be evicted, or when too many frames are dirty.
+ *
+ * The pool can be used by several threads at once. The frames are
+ * split into partitions, each with its own hash table, LRU list and
+ * latch, and a page always lives in the partition its (file, pid) hashes
+ * to, so threads working on different pages rarely wait for each other.
+ * Disk reads are done by the caller without holding any latch. The pool
+ * does not serialize accesses to the content of a frame: threads that
+ * modify the same page have to coordinate among themselves.
+ */
+class BufferPool {
+ public:
+
+  static const int DEFAULT_CAPACITY = 1024;  // default # of frames of each page size
+  static const int MAX_PARTITIONS = 16;      // max # of latched partitions
+  static const int MIN_PARTITION_SIZE = 64;  // min # of frames per partition
+  static const int MAX_ARENAS = 8;           // max # of different page sizes
+
+  /**
+   * create a buffer pool.
+   * @param capacity[IN] the number of page frames of each page size
+   */
+  explicit BufferPool(int capacity);
+  ~BufferPool();
+
+  /**
+   * resize the pool. every cached page is dropped, so no page may be
+   * pinned, and no other thread may use the pool, when it is resized.
+   * @param capacity[IN] the new number of page frames of each page size
+   * @return error code. 0 if no error
+   */
+  RC setCapacity(int capacity);
+
+  /**
+   * resize the pool to (approximately) the given amount of memory for
+   * each page size, counting the bytes of the pages that fit in it.
+   * every cached page is dropped.
+   * @param megabytes[IN] the memory to spend on the frames of a page size
+   * @return error code. 0 if no error
+   */
+  RC setCapacityMB(int megabytes);
+
+  /**
+   * @param pageSize[IN] a page size
+   * @return the number of page frames for pages of that size
+   */
+  int getCapacity(int pageSize) const;
+
+  /**
+   * turn write-back caching on or off. when it is turned off,
+   * every dirty page is written to disk first.
+   * @param on[IN] true for write-back, false for write-through
+   * @return error code. 0 if no error
+   */
+  RC setWriteBack(bool on);
+
+  /**
+   * @return true if written pages are cached as dirty pages
+   */
+  bool isWriteBack() const { return writeBack; }
+
+  /**
+   * map an open file to the id under which its pages are cached,
+   * and record where its pages are, so that they can be written back.
+   * the frames for its page size are set up if they are not yet.
+   * @param dev[IN] the device of the file
+   * @param ino[IN] the inode of the file
+   * @param pageSize[IN] the size of the pages of the file
+   * @param base[IN] the position of page 0 in the file
+   * @return the file id
+   */
+  int registerFile(dev_t dev, ino_t ino, int pageSize, off_t base);
+
+  /**
+   * get a page from the pool and pin its frame. if the page is not
+   * cached, the least recently used unpinned frame is taken over for
+   * it and cached is set to false: the caller then reads the page into
+   * the frame and calls loaded(). other threads that want the same page
+   * in the meantime wait until it has been loaded.
+   * if the evicted page is dirty, its file is flushed first.
+   * @param fileId[IN] the file id returned by registerFile()
+   * @param pageSize[IN] the page size the file was registered with
+   * @param pid[IN] the page to get
+   * @param cached[OUT] true if the frame already holds the page
+   * @param sequential[IN] true if the page is read by a sequential scan,
+   *                       and will probably not be used again soon
+   * @param ahead[IN] true if the page is read ahead of its use. this
+   *                  does not count as a reference to the page, and
+   *                  fails rather than pin more than half of the frames
+   * @return the pinned frame, or NULL if every frame is pinned
+   *         or a dirty page could not be written back
+   */
+  char* fetch(int fileId, int pageSize, PageId pid, bool& cached,
+              bool sequential = false, bool ahead = false);
+
+  /**
+   * finish loading a page whose frame was returned by fetch() with
+   * cached set to false. the frame stays pinned.
+   * @param frame[IN] the frame of the page
+   * @param ok[IN] false if the page could not be read. the page is
+   *               then dropped from the pool
+   */
+  void loaded(char* frame, bool ok);
+
+  /**
+   * get and pin the frame for a page that the caller is about to
+   * overwrite. the page is cached if it is not in the pool yet.
+   * @param fileId[IN] the file id returned by registerFile()
+   * @param pageSize[IN] the page size the file was registered with
+   * @param pid[IN] the page being written
+   * @param fd[IN] an open descriptor of the file, used to write back
+   *               the page later on
+   * @param dirty[IN] true if the new content is not on disk yet
+   * @return the pinned frame of the page, or NULL if no frame could
+   *         be freed up for it
+   */
+  char* update(int fileId, int pageSize, PageId pid, int fd, bool dirty);
+
+  /**
+   * mark a pinned frame dirty, after its content has been modified.
+   * @param frame[IN] the frame of the page
+   * @param fd[IN] an open descriptor of the file, used to write back
+   *               the page later on
+   * @return error code. 0 if no error
+   */
+  RC markDirty(char* frame, int fd);
+
+  /**
+   * write every dirty page of a file to disk.
+   * @param fileId[IN] the file id returned by registerFile()
+   * @return error code. 0 if no error
+   */
+  RC flushFile(int fileId);
+
+  /**
+   * write every dirty page in the pool to disk (checkpoint).
+   * @return error code. 0 if no error
+   */
+  RC flushAll();
+
+  /**
+   * @param fileId[IN] the file id returned by registerFile()
+   * @return the pages of the file written back by the pool so far
+   */
+  IOStats getFileStats(int fileId);
+
+  /**
+   * forget the descriptor of a file that is being closed.
+   * the file must have been flushed.
+   * @param fileId[IN] the file id returned by registerFile()
+   * @param fd[IN] the descriptor being closed
+   */
+  void detachFile(int fileId, int fd);
+
+  /**
+   * release the pin taken by fetch() or update().
+   * @param frame[IN] the frame to unpin
+   */
+  void unpin(char* frame);
+
+  /**
+   * drop every cached page of a file that is not pinned.
+   * @param fileId[IN] the file id returned by registerFile()
+   */
+  void invalidateFile(int fileId);
+
+  /**
+   * @return the total # of lookups answered from the pool
+   */
+  int getHitCount() const  { return hitCount; }
+
+  /**
+   * @return the total # of lookups that missed the pool
+   */
+  int getMissCount() const { return missCount; }
+
+  /**
+   * @return the total # of pages written back to disk
+   */
+  int getWriteBackCount() const { return writeBackCount; }
+
+ private:
+  struct Frame {
+    int    fileId;    // file id of the cached page (-1 if the frame is free)
+    PageId pid;       // page id of the cached page
+    int    hashNext;  // next frame in the same hash bucket
+    int    prev;      // previous frame in the queue (towards the victim end)
+    int    next;      // next frame in the queue (towards the newest end)
+    int    queue;     // the queue that the frame is in
+    bool   dirty;     // true if the page has to be written back
+    bool   loading;   // true while the page is being read into the frame
+    bool   sequential; // true if the page has only been read by scans
+    bool   ahead;     // true if the page was read ahead and not used yet
+    int    pinCount;  // # of pins on the frame. pinned frames stay in the pool
+  };
+
+  enum { FREE_QUEUE, IN_QUEUE, HOT_QUEUE };
+
+  struct Queue {
+    int     head;     // the next victim (-1 if empty)
+    int     tail;     // the newest frame (-1 if empty)
+    int     size;     // # of frames in the queue
+  };
+
+  typedef std::pair<int, PageId> PageKey;
+
+  struct Partition {
+    pthread_mutex_t  latch;     // protects the frames of the partition
+    pthread_cond_t   loadDone;  // signaled when a page has been loaded
+    std::vector<int> buckets;   // head frame of each hash chain (-1 if empty)
+    Queue   free;     // frames without a page
+    Queue   in;       // pages referenced once, in FIFO order
+    Queue   hot;      // pages referenced again, in LRU order
+    int     inLimit;  // the share of the frames kept for "in"
+    int     lastRef;  // the frame referenced last
+    int     pinned;   // # of pinned frames
+    std::deque<PageKey> ghostQueue;  // pages evicted from "in", oldest first
+    std::set<PageKey>   ghosts;      // the same pages, for lookups
+    int     ghostLimit;  // max # of remembered pages
+  };
+
+  //
+  // the frames of one page size
+  //
+  struct Arena {
+    int     frameSize;  // size of a frame, which is the page size
+    int     capacity;   // # of frames
+    char*   data;       // capacity * frameSize bytes of frame memory
+    std::vector<Frame> frames;
+
+    Partition* partitions;
+    int     partitionCount;  // # of partitions (a power of two)
+    int     partitionSize;   // # of frames per partition (the last one may have more)
+
+    int     dirtyCount; // # of dirty frames
+  };
+
+  struct File {
+    int    fd;        // descriptor used to write back the pages (-1 if none)
+    int    pageSize;  // size of the pages of the file
+    off_t  base;      // position of page 0 in the file
+    IOStats* stats;   // the write-backs of the file
+  };
+
+  int       capacity;       // # of frames of each page size (0 if set in bytes)
+  long long capacityBytes;  // bytes of frames of each page size (if capacity is 0)
+
+  Arena*  arenas[MAX_ARENAS];  // the arenas that have been set up
+  int     arenaCount;          // # of arenas
+
+  pthread_mutex_t fileLatch;  // protects fileIds, files and adding arenas
+  std::map<std::pair<dev_t, ino_t>, int> fileIds;  // (dev, ino) -> file id
+  std::vector<File> files;   // the registered files, indexed by file id
+
+  bool    writeBack;  // cache written pages instead of writing them through
+
+  int     hitCount;
+  int     missCount;
+  int     writeBackCount;
+
+  RC   resize(int capacity, long long capacityBytes);
+  int  framesFor(int pageSize) const;
+  Arena* arenaOf(int pageSize) const;
+  Arena* arenaOfFile(int fileId);
+  Arena* arenaOfFrame(const char* frame, int& f) const;
+  void setUp(Arena& arena);
+  void tearDown(Arena& arena);
+  unsigned hashOf(int fileId, PageId pid) const;
+  Partition& partitionOf(Arena& arena, int fileId, PageId pid);
+  Partition& partitionOfFrame(Arena& arena, int f);
+  int  find(const Arena& arena, const Partition& part, int fileId, PageId pid) const;
+  int  acquire(Arena& arena, Partition& part, int fileId, PageId pid,
+               bool sequential, bool ahead, bool& cached);
+  int  grab(Arena& arena, Partition& part, int fileId, PageId pid,
+            bool sequential, int& victimFileId);
+  int  pickVictim(Arena& arena, Partition& part);
+  int  firstUnpinned(const Arena& arena, const Queue& queue) const;
+  void remember(Partition& part, int fileId, PageId pid);
+  bool forget(Partition& part, int fileId, PageId pid);
+  void setDirty(Arena& arena, int f, int fd, bool dirty);
+  void unlinkHash(Arena& arena, int f);
+  Queue& queueOf(Arena& arena, Partition& part, int f);
+  void unlink(Arena& arena, Queue& queue, int f);
+  void append(Arena& arena, Partition& part, int queue, int f);
+  void drop(Arena& arena, int f);
+  void dropFile(Arena& arena, int fileId);
+  void reset(Arena& arena);
+  void lockAll(Arena& arena);
+  void unlockAll(Arena& arena);
+  RC   flushArena(Arena& arena, int fileId);
+  RC   flushLocked(Arena& arena, int fileId);
+  RC   writeRun(Arena& arena, const File& file, const std::vector<int>& run);
+
+  // a pool owns its frame memory and cannot be copied
+  BufferPool(const BufferPool&);
+  BufferPool& operator=(const BufferPool&);
+};
+
+#endif // BUFFERPOOL_H
@@ -0,0 +1,92 @@
+#include <cstring>
+#include <time.h>
+#include "IOStats.h"
+
+void IOStats::clear()
+{
+  memset(this, 0, sizeof(*this));
+}
+
+void IOStats::countRead(int pages, long long bytes)
+{
+  __sync_fetch_and_add(&reads, pages);
+  __sync_fetch_and_add(&bytesRead, bytes);
+}
+
+void IOStats::countWrite(int pages, long long bytes)
+{
+  __sync_fetch_and_add(&writes, pages);
+  __sync_fetch_and_add(&bytesWritten, bytes);
+}
+
+void IOStats::countLookup(bool hit)
+{
+  __sync_fetch_and_add(hit ? &hits : &misses, 1);
+}
+
+void IOStats::countCall(long long start)
+{
+  long long micros = now() - start;
+  int bucket = 0;
+
+  // the bucket is one more than the index of the highest bit
+  while (micros > 0 && bucket < LATENCY_BUCKETS - 1) {
+    micros >>= 1;
+    bucket++;
+  }
+  __sync_fetch_and_add(&calls, 1);
+  __sync_fetch_and_add(&latency[bucket], 1);
+}
+
+long long IOStats::now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+IOStats& IOStats::operator+=(const IOStats& s)
+{
+  reads += s.reads;
+  writes += s.writes;
+  hits += s.hits;
+  misses += s.misses;
+  bytesRead += s.bytesRead;
+  bytesWritten += s.bytesWritten;
+  calls += s.calls;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) latency[i] += s.latency[i];
+  return *this;
+}
+
+IOStats& IOStats::operator-=(const IOStats& s)
+{
+  reads -= s.reads;
+  writes -= s.writes;
+  hits -= s.hits;
+  misses -= s.misses;
+  bytesRead -= s.bytesRead;
+  bytesWritten -= s.bytesWritten;
+  calls -= s.calls;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) latency[i] -= s.latency[i];
+  return *this;
+}
+
+void IOStats::print(FILE* out, const char* name) const
+{
+  fprintf(out, "     %s: read %d pages (%lld KB), wrote %d pages (%lld KB), %d hits, %d misses, %d I/O calls",
+          name, reads, bytesRead / 1024, writes, bytesWritten / 1024, hits, misses, calls);
+
+  // the latency histogram, leaving out the empty buckets
+  if (calls > 0) {
+    fprintf(out, ", latency");
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+      if (latency[i] == 0) continue;
+      if (i == LATENCY_BUCKETS - 1) {
+        fprintf(out, " >=%lldus:%d", 1LL << (i - 1), latency[i]);
+      } else {
+        fprintf(out, " <%lldus:%d", 1LL << i, latency[i]);
+      }
+    }
+  }
+  fprintf(out, "\n");
+}
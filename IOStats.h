@@ -0,0 +1,77 @@
+#ifndef IOSTATS_H
+#define IOSTATS_H
+
+#include <cstdio>
+
+/**
+ * I/O and cache counters of a file, or of a query.
+ * A PageFile keeps one for the time that it is open, so that the pages
+ * read for a table can be told apart from those read for its index.
+ * The counters are updated atomically, so several threads may use the
+ * same file at the same time.
+ */
+struct IOStats {
+  // bucket 0 counts the I/O calls that took less than a microsecond,
+  // bucket i those that took [2^(i-1), 2^i) microseconds, and the last
+  // bucket the slower ones
+  static const int LATENCY_BUCKETS = 24;
+
+  int       reads;        // # of pages read from the disk (or the mapping)
+  int       writes;       // # of pages written to the disk
+  int       hits;         // # of page lookups answered by the buffer pool
+  int       misses;       // # of page lookups that went to the disk
+  long long bytesRead;    // # of bytes read from the disk
+  long long bytesWritten; // # of bytes written to the disk
+  int       calls;        // # of I/O system calls (a batch counts as one)
+  int       latency[LATENCY_BUCKETS];  // # of I/O calls by their latency
+
+  IOStats() { clear(); }
+
+  /**
+   * set every counter to zero.
+   */
+  void clear();
+
+  /**
+   * count pages read from the disk.
+   * @param pages[IN] the # of pages
+   * @param bytes[IN] the # of bytes
+   */
+  void countRead(int pages, long long bytes);
+
+  /**
+   * count pages written to the disk.
+   * @param pages[IN] the # of pages
+   * @param bytes[IN] the # of bytes
+   */
+  void countWrite(int pages, long long bytes);
+
+  /**
+   * count a page lookup in the buffer pool.
+   * @param hit[IN] true if the page was cached
+   */
+  void countLookup(bool hit);
+
+  /**
+   * count an I/O call that has just returned.
+   * @param start[IN] the time the call was made, taken with now()
+   */
+  void countCall(long long start);
+
+  /**
+   * @return the current time in microseconds, for countCall()
+   */
+  static long long now();
+
+  IOStats& operator+=(const IOStats& s);
+  IOStats& operator-=(const IOStats& s);
+
+  /**
+   * print the counters on one line.
+   * @param out[IN] the stream to print to
+   * @param name[IN] what the counters are for (e.g., the file name)
+   */
+  void print(FILE* out, const char* name) const;
+};
+
+#endif // IOSTATS_H
@@ -0,0 +1,240 @@
+#include <climits>
+#include <cstring>
+#include "KeySearch.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define KEYSEARCH_X86
+#endif
+
+// # of bytes of keys that the binary search narrows the keys down to:
+// two cache lines, which the vector kernels compare in a handful of
+// instructions with no branches to mispredict
+static const int BLOCK = 128;
+
+KeySearch::Kernel KeySearch::kernel = KeySearch::bestKernel();
+
+// get the i'th key
+static inline int keyAt(const char* keys, int i)
+{
+  int key;
+  memcpy(&key, keys + i * sizeof(int), sizeof(int));
+  return key;
+}
+
+// count the keys of a block that are smaller than key, one at a time.
+// the keys are sorted, so the count ends at the first one that is not.
+static int countScalar(const char* keys, int n, int key)
+{
+  int i = 0;
+  while (i < n && keyAt(keys, i) < key) i++;
+  return i;
+}
+
+// count the differences of a block that are smaller than delta.
+// T is the unsigned type of a difference.
+template <class T>
+static int countDeltasScalar(const char* deltas, int n, unsigned int delta)
+{
+  int i = 0;
+  T d;
+  for (; i < n; i++) {
+    memcpy(&d, deltas + i * sizeof(T), sizeof(T));
+    if (d >= delta) break;
+  }
+  return i;
+}
+
+#ifdef KEYSEARCH_X86
+// the same, four keys at a time. a compare sets the lanes of the keys
+// that are smaller, and those are a prefix of the lanes, so the count
+// of the set bits of the movemask is how many of them are smaller.
+__attribute__((target("sse2")))
+static int countSSE2(const char* keys, int n, int key)
+{
+  __m128i k = _mm_set1_epi32(key);
+  int i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(keys + i * sizeof(int)));
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(k, v)));
+    if (mask != 0xf) return i + __builtin_popcount(mask);
+  }
+  return i + countScalar(keys + i * sizeof(int), n - i, key);
+}
+
+// the same, eight keys at a time
+__attribute__((target("avx2")))
+static int countAVX2(const char* keys, int n, int key)
+{
+  __m256i k = _mm256_set1_epi32(key);
+  int i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(keys + i * sizeof(int)));
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, v)));
+    if (mask != 0xff) return i + __builtin_popcount(mask);
+  }
+  return i + countSSE2(keys + i * sizeof(int), n - i, key);
+}
+
+// the differences are unsigned, and the compares of SSE2 and AVX2 are
+// signed. flipping the top bit of both sides turns one into the other.
+// a compare of 1-byte lanes sets a bit of the movemask for each lane.
+__attribute__((target("sse2")))
+static int countBytesSSE2(const char* deltas, int n, unsigned int delta)
+{
+  __m128i flip = _mm_set1_epi8((char) 0x80);
+  __m128i k = _mm_set1_epi8((char) (delta ^ 0x80));
+  int i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(deltas + i)), flip);
+    int mask = _mm_movemask_epi8(_mm_cmpgt_epi8(k, v));
+    if (mask != 0xffff) return i + __builtin_popcount(mask);
+  }
+  return i + countDeltasScalar<unsigned char>(deltas + i, n - i, delta);
+}
+
+// the same for 2-byte lanes, which set two bits of the movemask each
+__attribute__((target("sse2")))
+static int countShortsSSE2(const char* deltas, int n, unsigned int delta)
+{
+  __m128i flip = _mm_set1_epi16((short) 0x8000);
+  __m128i k = _mm_set1_epi16((short) (delta ^ 0x8000));
+  int i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(deltas + i * 2)), flip);
+    int mask = _mm_movemask_epi8(_mm_cmpgt_epi16(k, v));
+    if (mask != 0xffff) return i + __builtin_popcount(mask) / 2;
+  }
+  return i + countDeltasScalar<unsigned short>(deltas + i * 2, n - i, delta);
+}
+
+// the same, 32 bytes at a time
+__attribute__((target("avx2")))
+static int countBytesAVX2(const char* deltas, int n, unsigned int delta)
+{
+  __m256i flip = _mm256_set1_epi8((char) 0x80);
+  __m256i k = _mm256_set1_epi8((char) (delta ^ 0x80));
+  int i = 0;
+
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(deltas + i)), flip);
+    unsigned int mask = _mm256_movemask_epi8(_mm256_cmpgt_epi8(k, v));
+    if (mask != 0xffffffffu) return i + __builtin_popcount(mask);
+  }
+  return i + countBytesSSE2(deltas + i, n - i, delta);
+}
+
+// the same, 16 shorts at a time
+__attribute__((target("avx2")))
+static int countShortsAVX2(const char* deltas, int n, unsigned int delta)
+{
+  __m256i flip = _mm256_set1_epi16((short) 0x8000);
+  __m256i k = _mm256_set1_epi16((short) (delta ^ 0x8000));
+  int i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(deltas + i * 2)), flip);
+    unsigned int mask = _mm256_movemask_epi8(_mm256_cmpgt_epi16(k, v));
+    if (mask != 0xffffffffu) return i + __builtin_popcount(mask) / 2;
+  }
+  return i + countShortsSSE2(deltas + i * 2, n - i, delta);
+}
+#endif
+
+int KeySearch::countLess(const char* keys, int n, int key)
+{
+  int lo = 0;
+  int hi = n;
+
+  // the keys before lo are smaller than key, and the keys from hi on are not
+  while (hi - lo > BLOCK / (int) sizeof(int)) {
+    int mid = lo + (hi - lo) / 2;
+    if (keyAt(keys, mid) < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  const char* block = keys + lo * sizeof(int);
+  switch (kernel) {
+#ifdef KEYSEARCH_X86
+  case AVX2:
+    return lo + countAVX2(block, hi - lo, key);
+  case SSE2:
+    return lo + countSSE2(block, hi - lo, key);
+#endif
+  default:
+    return lo + countScalar(block, hi - lo, key);
+  }
+}
+
+// get the i'th difference of width bytes
+static inline unsigned int deltaAt(const char* deltas, int width, int i)
+{
+  if (width == 1) return (unsigned char) deltas[i];
+  unsigned short d;
+  memcpy(&d, deltas + i * 2, sizeof(d));
+  return d;
+}
+
+int KeySearch::countLessDelta(const char* deltas, int width, int n, unsigned int delta)
+{
+  int lo = 0;
+  int hi = n;
+
+  // a block holds twice as many differences of 2 bytes as keys, and
+  // four times as many of 1 byte
+  while (hi - lo > BLOCK / width) {
+    int mid = lo + (hi - lo) / 2;
+    if (deltaAt(deltas, width, mid) < delta) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  const char* block = deltas + lo * width;
+  switch (kernel) {
+#ifdef KEYSEARCH_X86
+  case AVX2:
+    return lo + ((width == 1) ? countBytesAVX2(block, hi - lo, delta)
+                              : countShortsAVX2(block, hi - lo, delta));
+  case SSE2:
+    return lo + ((width == 1) ? countBytesSSE2(block, hi - lo, delta)
+                              : countShortsSSE2(block, hi - lo, delta));
+#endif
+  default:
+    return lo + ((width == 1) ? countDeltasScalar<unsigned char>(block, hi - lo, delta)
+                              : countDeltasScalar<unsigned short>(block, hi - lo, delta));
+  }
+}
+
+int KeySearch::countLessOrEqual(const char* keys, int n, int key)
+{
+  // no key is larger than the largest int
+  if (key == INT_MAX) return n;
+  return countLess(keys, n, key + 1);
+}
+
+bool KeySearch::setKernel(Kernel k)
+{
+  // a CPU with AVX2 has SSE2 as well
+  if (k > bestKernel()) return false;
+  kernel = k;
+  return true;
+}
+
+KeySearch::Kernel KeySearch::bestKernel()
+{
+#ifdef KEYSEARCH_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return AVX2;
+  if (__builtin_cpu_supports("sse2")) return SSE2;
+#endif
+  return SCALAR;
+}
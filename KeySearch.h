@@ -0,0 +1,75 @@
+#ifndef KEYSEARCH_H
+#define KEYSEARCH_H
+
+/**
+ * searches the sorted array of keys of a B+tree node. a binary search
+ * narrows the keys down to a block of a few cache lines, and the keys of
+ * the block are then compared a vector at a time with a compare and a
+ * movemask, with AVX2 or SSE2 instructions when the CPU has them. the
+ * kernel is chosen when the program starts, and falls back to comparing
+ * one key at a time.
+ */
+class KeySearch {
+ public:
+
+  // the ways to compare the keys of a block
+  enum Kernel {
+    SCALAR,  // one key at a time
+    SSE2,    // four keys at a time
+    AVX2     // eight keys at a time
+  };
+
+  /**
+   * count the keys that are smaller than a key, which is the position of
+   * the first key that is not smaller (n if all of them are).
+   * @param keys[IN] n sorted ints, not necessarily aligned
+   * @param n[IN] the # of keys
+   * @param key[IN] the key to search for
+   * @return the # of keys smaller than key
+   */
+  static int countLess(const char* keys, int n, int key);
+
+  /**
+   * count the keys that are not larger than a key, which is the position
+   * of the first key that is larger (n if none is).
+   * @param keys[IN] n sorted ints, not necessarily aligned
+   * @param n[IN] the # of keys
+   * @param key[IN] the key to search for
+   * @return the # of keys smaller than or equal to key
+   */
+  static int countLessOrEqual(const char* keys, int n, int key);
+
+  /**
+   * count the differences that are smaller than a difference, in the
+   * sorted array of differences of the keys from a base that a packed
+   * leaf node keeps (see BTLeafNode).
+   * @param deltas[IN] n sorted unsigned differences, not necessarily aligned
+   * @param width[IN] the bytes of a difference, 1 or 2
+   * @param n[IN] the # of differences
+   * @param delta[IN] the difference to search for. it fits in width bytes
+   * @return the # of differences smaller than delta
+   */
+  static int countLessDelta(const char* deltas, int width, int n, unsigned int delta);
+
+  /**
+   * @return the kernel in use
+   */
+  static Kernel getKernel() { return kernel; }
+
+  /**
+   * choose the kernel to compare keys with.
+   * @param k[IN] the kernel
+   * @return true if the CPU can run it. the kernel is left as it is if not
+   */
+  static bool setKernel(Kernel k);
+
+ private:
+  static Kernel kernel;  // the kernel in use
+
+  /**
+   * @return the fastest kernel that the CPU can run
+   */
+  static Kernel bestKernel();
+};
+
+#endif // KEYSEARCH_H
@@ -0,0 +1,151 @@
+#include <cstring>
+#include "PageCodec.h"
+
+//
+// a compressed page is a sequence of blocks. a block starts with a token
+// byte: its high four bits are the # of literals, and its low four bits
+// the length of the copy minus MIN_MATCH. a field of 15 is continued in
+// the bytes that follow, each adding up to 255. then come the literals,
+// and the two-byte distance back to the bytes to copy. the last block
+// has literals only.
+//
+static const int MIN_MATCH = 4;      // the shortest copy
+static const int TAIL = 5;           // # of bytes at the end that are always literals
+static const int HASH_BITS = 12;     // the size of the table of recent positions
+static const int MAX_DISTANCE = 65535;
+
+// hash the four bytes at p
+static inline unsigned hashOf(const unsigned char* p)
+{
+  unsigned v;
+  memcpy(&v, p, sizeof(v));
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// write a length field continued from its token, and return the new end.
+// return NULL if it does not fit before end.
+static unsigned char* putLength(unsigned char* out, unsigned char* end, int length)
+{
+  for (; length >= 255; length -= 255) {
+    if (out >= end) return NULL;
+    *out++ = 255;
+  }
+  if (out >= end) return NULL;
+  *out++ = (unsigned char)length;
+  return out;
+}
+
+// write a block, and return the new end. return NULL if it does not fit.
+static unsigned char* putBlock(unsigned char* out, unsigned char* end,
+                               const unsigned char* literals, int count,
+                               int distance, int match)
+{
+  int lit = count < 15 ? count : 15;
+  int len = (match < MIN_MATCH) ? 0 : (match - MIN_MATCH < 15 ? match - MIN_MATCH : 15);
+
+  if (out >= end) return NULL;
+  *out++ = (unsigned char)((lit << 4) | len);
+  if (lit == 15 && (out = putLength(out, end, count - 15)) == NULL) return NULL;
+  if (end - out < count) return NULL;
+  memcpy(out, literals, count);
+  out += count;
+
+  // the last block has no copy
+  if (match < MIN_MATCH) return out;
+
+  if (end - out < 2) return NULL;
+  *out++ = (unsigned char)(distance & 0xff);
+  *out++ = (unsigned char)(distance >> 8);
+  if (len == 15 && (out = putLength(out, end, match - MIN_MATCH - 15)) == NULL) return NULL;
+  return out;
+}
+
+int PageCodec::compress(const char* source, int length, char* dest, int capacity)
+{
+  const unsigned char* src = (const unsigned char*)source;
+  unsigned char* out = (unsigned char*)dest;
+  unsigned char* end = out + capacity;
+  int table[1 << HASH_BITS];
+  int anchor = 0;   // the first byte not written yet
+  int i = 0;
+
+  for (int k = 0; k < (1 << HASH_BITS); k++) table[k] = -1;
+
+  // look for a copy at every position, leaving the tail to the literals
+  while (i + MIN_MATCH <= length - TAIL) {
+    unsigned h = hashOf(src + i);
+    int candidate = table[h];
+    table[h] = i;
+
+    if (candidate < 0 || i - candidate > MAX_DISTANCE ||
+        memcmp(src + candidate, src + i, MIN_MATCH) != 0) {
+      i++;
+      continue;
+    }
+
+    // extend the copy as far as it goes
+    int match = MIN_MATCH;
+    while (i + match < length - TAIL && src[candidate + match] == src[i + match]) match++;
+
+    out = putBlock(out, end, src + anchor, i - anchor, i - candidate, match);
+    if (out == NULL) return 0;
+    i += match;
+    anchor = i;
+  }
+
+  out = putBlock(out, end, src + anchor, length - anchor, 0, 0);
+  if (out == NULL) return 0;
+  return (int)(out - (unsigned char*)dest);
+}
+
+bool PageCodec::decompress(const char* source, int length, char* dest, int size)
+{
+  const unsigned char* in = (const unsigned char*)source;
+  const unsigned char* inEnd = in + length;
+  unsigned char* out = (unsigned char*)dest;
+  unsigned char* outEnd = out + size;
+
+  while (in < inEnd) {
+    int token = *in++;
+
+    // copy the literals
+    int count = token >> 4;
+    if (count == 15) {
+      int b;
+      do {
+        if (in >= inEnd) return false;
+        b = *in++;
+        count += b;
+      } while (b == 255);
+    }
+    if (inEnd - in < count || outEnd - out < count) return false;
+    memcpy(out, in, count);
+    in += count;
+    out += count;
+
+    // the last block ends the page
+    if (in == inEnd) break;
+
+    // copy the bytes from earlier in the page. the two ranges may
+    // overlap, so that a short run repeats itself.
+    if (inEnd - in < 2) return false;
+    int distance = in[0] | (in[1] << 8);
+    in += 2;
+    int match = (token & 15);
+    if (match == 15) {
+      int b;
+      do {
+        if (in >= inEnd) return false;
+        b = *in++;
+        match += b;
+      } while (b == 255);
+    }
+    match += MIN_MATCH;
+    if (distance == 0 || distance > out - (unsigned char*)dest || outEnd - out < match) return false;
+    const unsigned char* from = out - distance;
+    for (int k = 0; k < match; k++) out[k] = from[k];
+    out += match;
+  }
+
+  return out == outEnd;
+}
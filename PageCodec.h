@@ -0,0 +1,36 @@
+#ifndef PAGECODEC_H
+#define PAGECODEC_H
+
+/**
+ * A small LZ77 codec for pages, in the style of LZ4: a compressed page
+ * is a sequence of literal runs, each followed by a copy of bytes that
+ * appeared earlier in the page. It gives up some ratio for speed, so
+ * that a page decompresses in a fraction of the time it takes to read
+ * it, and it does well on the zero padding and the short ASCII values
+ * that fill table pages.
+ */
+class PageCodec {
+ public:
+
+  /**
+   * compress a page.
+   * @param src[IN] the page
+   * @param length[IN] the size of the page (at most 64KB)
+   * @param dst[OUT] the compressed page
+   * @param capacity[IN] the # of bytes available in dst
+   * @return the size of the compressed page. 0 if it does not fit into dst
+   */
+  static int compress(const char* src, int length, char* dst, int capacity);
+
+  /**
+   * decompress a page.
+   * @param src[IN] the compressed page
+   * @param length[IN] the size of the compressed page
+   * @param dst[OUT] the page
+   * @param size[IN] the size of the page
+   * @return true if src decompresses into exactly size bytes
+   */
+  static bool decompress(const char* src, int length, char* dst, int size);
+};
+
+#endif // PAGECODEC_H
@@ -9,38 +9,206 @@
 
 #include "Bruinbase.h"
 #include "PageFile.h"
+#include "AsyncIO.h"
+#include "PageCodec.h"
+#include <algorithm>
+#include <cstddef>
 #include <cstring>
+#include <set>
+#include <vector>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 using std::string;
+using std::vector;
 
 int PageFile::readCount = 0;
 int PageFile::writeCount = 0;
-int PageFile::cacheClock = 1;
-struct PageFile::cacheStruct PageFile::readCache[PageFile::CACHE_COUNT];
+bool PageFile::mmapReads = true;
+int PageFile::defaultPageSize = PageFile::DEFAULT_PAGE_SIZE;
+BufferPool PageFile::bufferPool(BufferPool::DEFAULT_CAPACITY);
+
+//
+// the header page at the beginning of a file
+//
+struct FileHeader {
+  char magic[8];  // FILE_MAGIC
+  int  pageSize;  // the size of every page of the file, including this one
+  char userData[PageFile::USER_DATA_SIZE];  // kept for the user of the file
+  int  codec;     // CODEC_NONE or CODEC_LZ
+  int  mapCount;  // # pages in the page map of a compressed file
+  long long mapOffset;  // the position of the page map of a compressed file
+};
+
+static const char FILE_MAGIC[8] = { 'B', 'R', 'U', 'I', 'N', 'P', 'F', '1' };
+
+// how the pages of a file are stored
+static const int CODEC_NONE = 0;  // as they are
+static const int CODEC_LZ = 1;    // compressed with PageCodec
+
+// the images of the pages of a compressed file are aligned to this
+static const int EXTENT_ALIGNMENT = 64;
+
+//
+// the place of a compressed page in the file
+//
+struct Extent {
+  long long offset;  // the position of the image of the page
+  int length;        // the size of the image. pageSize if stored as is, 0 for a zero page
+  int room;          // the # of bytes reserved for the image
+};
+
+//
+// the page map of a compressed file, kept in memory while the file is open
+//
+struct PageFile::PageMap {
+  pthread_mutex_t latch;   // protects the fields below
+  vector<Extent> extents;  // the place of every page
+  vector<Extent> unused;   // the space of images that have been moved
+  long long dataEnd;       // the end of the last page image
+  bool dirty;              // true if the map has changed since it was written
+};
+
+// check whether a page size is supported
+static bool isValidPageSize(int size)
+{
+  return size >= PageFile::MIN_PAGE_SIZE && size <= PageFile::MAX_PAGE_SIZE &&
+         (size & (size - 1)) == 0;
+}
+
+// write the header page of a new file
+static RC writeHeader(int fd, int pageSize, int codec)
+{
+  char page[PageFile::MAX_PAGE_SIZE];
+  FileHeader header;
+
+  memset(page, 0, pageSize);
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+  header.pageSize = pageSize;
+  header.codec = codec;
+  header.mapOffset = pageSize;
+  memcpy(page, &header, sizeof(header));
+
+  return (::pwrite(fd, page, pageSize, 0) == pageSize) ? 0 : RC_FILE_WRITE_FAILED;
+}
+
+// read the header page of a file.
+// return false if the file does not start with a header.
+static bool readHeader(int fd, FileHeader& header)
+{
+  if (::pread(fd, &header, sizeof(header), 0) != sizeof(header)) return false;
+  if (memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) return false;
+  return isValidPageSize(header.pageSize);
+}
+
+// read the page map of a compressed file, and check that every page
+// image lies within the file
+static bool readPageMap(int fd, const FileHeader& header, off_t fileSize, vector<Extent>& extents)
+{
+  long long size = (long long)header.mapCount * sizeof(Extent);
+
+  if (header.mapCount < 0 || header.mapOffset < header.pageSize ||
+      header.mapOffset + size > fileSize) return false;
+  extents.resize(header.mapCount);
+  if (size > 0 && ::pread(fd, &extents[0], size, header.mapOffset) != size) return false;
+
+  for (int i = 0; i < header.mapCount; i++) {
+    const Extent& e = extents[i];
+    if (e.length < 0 || e.length > header.pageSize || e.length > e.room) return false;
+    if (e.length > 0 && (e.offset < header.pageSize || e.offset + e.room > header.mapOffset)) return false;
+  }
+  return true;
+}
+
+// mark a page of a batch read loaded as soon as its read completes,
+// so that the threads waiting for the page can go on
+static void pageLoaded(AsyncIO::Request& req, void* pool)
+{
+  ((BufferPool*)pool)->loaded(req.buffer, req.result == (ssize_t)req.length);
+}
+
+PageHandle::PageHandle()
+{
+  pf = NULL;
+  pid = -1;
+  frame = NULL;
+  dirty = false;
+}
+
+bool PageHandle::isPageOf(const PageFile& pf, PageId pid) const
+{
+  return frame != NULL && this->pid == pid && this->pf->fileId == pf.fileId;
+}
+
+RC PageHandle::write()
+{
+  if (frame == NULL || !dirty) return 0;
+  dirty = false;
+  return pf->unpin(pid, frame, true, false);
+}
+
+RC PageHandle::release()
+{
+  if (frame == NULL) return 0;
+
+  RC rc = pf->unpin(pid, frame, dirty, true);
+  pf = NULL;
+  pid = -1;
+  frame = NULL;
+  dirty = false;
+  return rc;
+}
 
 PageFile::PageFile() 
 { 
   fd = -1; 
   epid = 0; 
+  fileId = -1;
+  pageSize = defaultPageSize;
+  base = 0;
+  memset(userData, 0, sizeof(userData));
+  pattern = NORMAL;
+  lastRead = -2;
+  map = NULL;
+  mapLength = 0;
+  pageMap = NULL;
 }
 
 PageFile::PageFile(const string& filename, char mode)
 {
   fd = -1;
   epid = 0;
+  fileId = -1;
+  pageSize = defaultPageSize;
+  base = 0;
+  memset(userData, 0, sizeof(userData));
+  pattern = NORMAL;
+  lastRead = -2;
+  map = NULL;
+  mapLength = 0;
+  pageMap = NULL;
   open(filename.c_str(), mode);
 }
 
-RC PageFile::open(const string& filename, char mode)
+RC PageFile::open(const string& filename, char mode, bool compress, int newPageSize)
 {
   RC   rc;
   int  oflag;
   struct stat statbuf;
+  FileHeader header;
 
   if (fd > 0) return RC_FILE_OPEN_FAILED;
+  if (newPageSize == 0) {
+    newPageSize = defaultPageSize;
+  } else if (!isValidPageSize(newPageSize)) {
+    return RC_INVALID_ATTRIBUTE;
+  }
+  stats.clear();
 
   // set the unix file flag depending on the file mode
   switch (mode) {
@@ -63,30 +231,222 @@ RC PageFile::open(const string& filename, char mode)
   // get the size of the file to set the end pid
   rc = ::fstat(fd, &statbuf);
   if (rc < 0) { ::close(fd); fd = -1; return RC_FILE_OPEN_FAILED; }
-  epid = statbuf.st_size / PAGE_SIZE;
+
+  // a new file starts with a header page that records its page size.
+  // a file without a header has 1KB pages from the very beginning.
+  memset(userData, 0, sizeof(userData));
+  memset(&header, 0, sizeof(header));
+  if (statbuf.st_size == 0) {
+    pageSize = newPageSize;
+    base = pageSize;
+    if (oflag != O_RDONLY) {
+      header.codec = compress ? CODEC_LZ : CODEC_NONE;
+      if (writeHeader(fd, pageSize, header.codec) < 0) {
+        ::close(fd); fd = -1; return RC_FILE_OPEN_FAILED;
+      }
+      statbuf.st_size = base;
+    }
+    header.mapOffset = base;
+  } else if (readHeader(fd, header)) {
+    pageSize = header.pageSize;
+    base = pageSize;
+    memcpy(userData, header.userData, sizeof(userData));
+  } else {
+    pageSize = LEGACY_PAGE_SIZE;
+    base = 0;
+  }
+
+  // the pages of a compressed file are found through its page map.
+  // new pages are written where the map is, and the map is written
+  // again after them when the file is flushed.
+  if (header.codec == CODEC_LZ) {
+    pageMap = new PageMap;
+    if (!readPageMap(fd, header, statbuf.st_size, pageMap->extents)) {
+      delete pageMap; pageMap = NULL;
+      ::close(fd); fd = -1; return RC_INVALID_FILE_FORMAT;
+    }
+    pthread_mutex_init(&pageMap->latch, NULL);
+    pageMap->dataEnd = header.mapOffset;
+    pageMap->dirty = false;
+  } else if (header.codec != CODEC_NONE) {
+    ::close(fd); fd = -1; return RC_INVALID_FILE_FORMAT;
+  }
+
+  // pages stay cached after close(), so look up the id under which
+  // this file's pages may already be in the buffer pool. an empty file
+  // may be a new file that reuses the inode of a deleted one, so make
+  // sure that nothing stale is left behind in that case.
+  fileId = bufferPool.registerFile(statbuf.st_dev, statbuf.st_ino, pageSize, base);
+  if (statbuf.st_size <= base) bufferPool.invalidateFile(fileId);
+  poolStats = bufferPool.getFileStats(fileId);
+
+  // map a read-only file, so that its pages are served by the
+  // OS page cache without a system call (and a copy) per page.
+  // the mapping does not see dirty pages in the buffer pool, so
+  // write them to the file first.
+  if (oflag == O_RDONLY && mmapReads) {
+    if (bufferPool.flushFile(fileId) < 0 || ::fstat(fd, &statbuf) < 0) {
+      ::close(fd); fd = -1; return RC_FILE_OPEN_FAILED;
+    }
+  }
+  if (pageMap != NULL) {
+    epid = (PageId)pageMap->extents.size();
+  } else {
+    epid = (statbuf.st_size > base) ? (statbuf.st_size - base) / pageSize : 0;
+  }
+
+  if (oflag == O_RDONLY && mmapReads && epid > 0 && pageMap == NULL) {
+    mapLength = (size_t)offsetOf(epid);
+    void* addr = ::mmap(NULL, mapLength, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      // fall back on reading through the buffer pool
+      mapLength = 0;
+    } else {
+      map = (char*)addr;
+    }
+  }
 
   return 0;
 }
 
+void PageFile::getUserData(void* data) const
+{
+  memcpy(data, userData, sizeof(userData));
+}
+
+RC PageFile::setUserData(const void* data)
+{
+  if (fd <= 0 || base == 0 || map != NULL) return RC_FILE_WRITE_FAILED;
+
+  // the user data is written to the header page right away
+  if (::pwrite(fd, data, sizeof(userData), offsetof(FileHeader, userData)) != sizeof(userData)) {
+    return RC_FILE_WRITE_FAILED;
+  }
+  memcpy(userData, data, sizeof(userData));
+  return 0;
+}
+
 RC PageFile::close()
 {
+  RC rc;
+
   if (fd <= 0) return RC_FILE_CLOSE_FAILED;
 
+  // write back the dirty pages of the file before the descriptor goes away
+  if ((rc = flush()) < 0) return rc;
+  bufferPool.detachFile(fileId, fd);
+
+  if (pageMap != NULL) {
+    pthread_mutex_destroy(&pageMap->latch);
+    delete pageMap;
+    pageMap = NULL;
+  }
+
+  // keep the counters of the file, including its write-backs,
+  // until it is opened again
+  stats = getStats();
+
+  // unmap a read-only file
+  if (map != NULL) {
+    ::munmap(map, mapLength);
+    map = NULL;
+    mapLength = 0;
+  }
+
   // close the file
   if (::close(fd) < 0) return RC_FILE_CLOSE_FAILED;
 
-  // evict all cached pages for this file
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].lastAccessed != 0) {
-       readCache[i].fd = 0;
-       readCache[i].pid = 0;
-       readCache[i].lastAccessed = 0;
-    }
-  }
+  // the cached pages of the file are kept in the buffer pool,
+  // so that they can be reused if the file is opened again.
 
   // set the fd and epid to the initial state
   fd = -1; 
   epid = 0;
+  fileId = -1;
+  pattern = NORMAL;
+  lastRead = -2;
+  return 0;
+}
+
+RC PageFile::flush()
+{
+  RC rc;
+
+  if (fd <= 0) return RC_FILE_WRITE_FAILED;
+  if ((rc = bufferPool.flushFile(fileId)) < 0) return rc;
+  return (pageMap != NULL) ? writePageMap() : 0;
+}
+
+RC PageFile::writePageMap()
+{
+  RC rc = 0;
+  FileHeader header;
+  const size_t start = offsetof(FileHeader, mapCount);
+  const ssize_t length = sizeof(header) - start;
+
+  pthread_mutex_lock(&pageMap->latch);
+  if (pageMap->dirty) {
+    long long size = (long long)pageMap->extents.size() * sizeof(Extent);
+    memset(&header, 0, sizeof(header));
+    header.mapCount = (int)pageMap->extents.size();
+    header.mapOffset = pageMap->dataEnd;
+
+    // the map goes after the last page image, and the header is
+    // pointed at it only once it is on the disk
+    if ((size > 0 && ::pwrite(fd, &pageMap->extents[0], size, pageMap->dataEnd) != size) ||
+        ::ftruncate(fd, pageMap->dataEnd + size) < 0 ||
+        ::pwrite(fd, (char*)&header + start, length, start) != length) {
+      rc = RC_FILE_WRITE_FAILED;
+    } else {
+      pageMap->dirty = false;
+    }
+  }
+  pthread_mutex_unlock(&pageMap->latch);
+  return rc;
+}
+
+RC PageFile::advise(AccessPattern pattern)
+{
+  int advice;
+
+  if (fd <= 0) return RC_FILE_READ_FAILED;
+  this->pattern = pattern;
+
+  if (map != NULL) {
+    switch (pattern) {
+    case SEQUENTIAL: advice = MADV_SEQUENTIAL; break;
+    case RANDOM:     advice = MADV_RANDOM; break;
+    default:         advice = MADV_NORMAL; break;
+    }
+    if (::madvise(map, mapLength, advice) < 0) return RC_FILE_READ_FAILED;
+  } else {
+    switch (pattern) {
+    case SEQUENTIAL: advice = POSIX_FADV_SEQUENTIAL; break;
+    case RANDOM:     advice = POSIX_FADV_RANDOM; break;
+    default:         advice = POSIX_FADV_NORMAL; break;
+    }
+    if (::posix_fadvise(fd, 0, 0, advice) != 0) return RC_FILE_READ_FAILED;
+  }
+
+  return 0;
+}
+
+IOStats PageFile::getStats() const
+{
+  IOStats s = stats;
+
+  // add the pages written back by the buffer pool since the file was opened
+  if (fileId >= 0) {
+    s += bufferPool.getFileStats(fileId);
+    s -= poolStats;
+  }
+  return s;
+}
+
+RC PageFile::setDefaultPageSize(int size)
+{
+  if (!isValidPageSize(size)) return RC_INVALID_ATTRIBUTE;
+  defaultPageSize = size;
   return 0;
 }
 
@@ -95,86 +455,503 @@ PageId PageFile::endPid() const
   return epid;
 }
 
-RC PageFile::seek(PageId pid) const
+void PageFile::extend(PageId pid)
 {
-  return (::lseek(fd, pid * PAGE_SIZE, SEEK_SET) < 0) ? RC_FILE_SEEK_FAILED : 0;
+  // several threads may append pages at once, so only ever move
+  // the end pid forward
+  PageId e;
+  while ((e = epid) <= pid && !__sync_bool_compare_and_swap(&epid, e, pid + 1));
 }
 
 RC PageFile::write(PageId pid, const void* buffer)
 {
   RC rc;
+  char* frame;
+
   if (pid < 0) return RC_INVALID_PID; 
 
-  // seek to the location of the page
-  if ((rc = seek(pid)) < 0) return rc;
+  // a mapped file is read-only
+  if (map != NULL) return RC_FILE_WRITE_FAILED;
 
-  // write the buffer to the disk page
-  if (::write(fd, buffer, PAGE_SIZE) < 0) return RC_FILE_WRITE_FAILED;
+  // the buffer pool writes back whole pages at their place in the
+  // file, so the pages of a compressed file are always written through
+  if (bufferPool.isWriteBack() && pageMap == NULL) {
+    // keep the page in the buffer pool as a dirty page.
+    // the pool writes it to the disk later.
+    frame = bufferPool.update(fileId, pageSize, pid, fd, true);
+    if (frame == NULL) return RC_FILE_WRITE_FAILED;
+    memcpy(frame, buffer, pageSize);
 
-  // if the page is in read cache, invalidate it
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].pid == pid &&
-        readCache[i].lastAccessed != 0) {
-       readCache[i].fd = 0;
-       readCache[i].pid = 0;
-       readCache[i].lastAccessed = 0;
-       break;
+    // mark the page dirty again, in case it was flushed
+    // by another thread before the new content was in
+    rc = bufferPool.markDirty(frame, fd);
+    bufferPool.unpin(frame);
+    if (rc < 0) return rc;
+  } else {
+    // write the buffer to the disk page
+    if (pageMap != NULL) {
+      if ((rc = writeCompressed(pid, buffer)) < 0) return rc;
+    } else {
+      long long start = IOStats::now();
+      ssize_t len = ::pwrite(fd, buffer, pageSize, offsetOf(pid));
+      stats.countCall(start);
+      if (len < 0) return RC_FILE_WRITE_FAILED;
+      stats.countWrite(1, pageSize);
     }
+
+    // keep the new content in the buffer pool, so that the page
+    // does not have to be read back from the disk
+    frame = bufferPool.update(fileId, pageSize, pid, fd, false);
+    if (frame != NULL) {
+      memcpy(frame, buffer, pageSize);
+      bufferPool.unpin(frame);
+    }
+
+    // increase page write count
+    __sync_fetch_and_add(&writeCount, 1);
   }
 
   // if the written pid >= end pid, update the end pid
-  if (pid >= epid) epid = pid + 1;
-
-  // increase page write count
-  writeCount++;
+  extend(pid);
 
   return 0;
 }
 
 RC PageFile::read(PageId pid, void* buffer) const
 {
-  RC rc;
+  RC   rc;
+  bool cached;
 
   if (pid < 0 || pid >= epid) return RC_INVALID_PID; 
 
+  // copy the page out of the mapping of a read-only file.
+  // we do not know whether the access faults the page in from the
+  // disk, so we count it as a page read.
+  if (map != NULL) {
+    memcpy(buffer, map + offsetOf(pid), pageSize);
+    __sync_fetch_and_add(&readCount, 1);
+    stats.countRead(1, pageSize);
+    return 0;
+  }
+
   //
-  // if the page is in cache, read it from there
+  // if the page is in the buffer pool, read it from there.
+  // otherwise read it into a frame of the buffer pool first
+  // and copy it to the buffer
   //
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].pid == pid && 
-        readCache[i].lastAccessed != 0) {
-       memcpy(buffer, readCache[i].buffer, PAGE_SIZE);
-       readCache[i].lastAccessed = ++cacheClock;
-       return 0;
+  char* frame = bufferPool.fetch(fileId, pageSize, pid, cached, pattern == SEQUENTIAL);
+  if (frame == NULL) return RC_FILE_READ_FAILED;
+  stats.countLookup(cached);
+  if (!cached && (rc = load(pid, frame)) < 0) {
+    bufferPool.unpin(frame);
+    return rc;
+  }
+  memcpy(buffer, frame, pageSize);
+  bufferPool.unpin(frame);
+
+  return 0;
+}
+
+RC PageFile::pin(PageId pid, PageHandle& page) const
+{
+  RC   rc;
+  bool cached;
+
+  page.release();
+  if (pid < 0 || pid >= epid) return RC_INVALID_PID; 
+
+  // a page of a mapped file is used right where it is mapped
+  if (map != NULL) {
+    __sync_fetch_and_add(&readCount, 1);
+    stats.countRead(1, pageSize);
+    page.pf = const_cast<PageFile*>(this);
+    page.pid = pid;
+    page.frame = map + offsetOf(pid);
+    page.dirty = false;
+    return 0;
+  }
+
+  char* frame = bufferPool.fetch(fileId, pageSize, pid, cached, pattern == SEQUENTIAL);
+  if (frame == NULL) return RC_FILE_READ_FAILED;
+  stats.countLookup(cached);
+  if (!cached && (rc = load(pid, frame)) < 0) {
+    bufferPool.unpin(frame);
+    return rc;
+  }
+
+  page.pf = const_cast<PageFile*>(this);
+  page.pid = pid;
+  page.frame = frame;
+  page.dirty = false;
+  return 0;
+}
+
+RC PageFile::load(PageId pid, char* frame) const
+{
+  char*  frames[READ_AHEAD_SIZE / MIN_PAGE_SIZE];
+  struct iovec iov[READ_AHEAD_SIZE / MIN_PAGE_SIZE];
+  bool   sequential = (pattern == SEQUENTIAL);
+  int    n = 1;
+
+  // the pages of a compressed file are not where offsetOf() says, and
+  // each has to be decompressed on its own
+  if (pageMap != NULL) {
+    RC rc = readCompressed(pid, frame);
+    bufferPool.loaded(frame, rc == 0);
+    return rc;
+  }
+
+  frames[0] = frame;
+
+  // when the file is scanned, or the page follows the one that was
+  // read last (unless the accesses are known to be random), read the
+  // pages after it as well with the same system call. stop at the
+  // first page that is cached already, and do not take more than a
+  // quarter of the buffer pool.
+  PageId last = __atomic_load_n(&lastRead, __ATOMIC_RELAXED);
+  if (sequential || (pattern == NORMAL && pid == last + 1)) {
+    int limit = READ_AHEAD_SIZE / pageSize;
+    if (limit > epid - pid) limit = epid - pid;
+    int quarter = bufferPool.getCapacity(pageSize) / 4;
+    if (limit > quarter) limit = quarter;
+
+    for (; n < limit; n++) {
+      bool cached;
+      char* next = bufferPool.fetch(fileId, pageSize, pid + n, cached, sequential, true);
+      if (next == NULL) break;
+      if (cached) {
+        bufferPool.unpin(next);
+        break;
+      }
+      frames[n] = next;
+    }
+  }
+  __atomic_store_n(&lastRead, pid + n - 1, __ATOMIC_RELAXED);
+
+  for (int i = 0; i < n; i++) {
+    iov[i].iov_base = frames[i];
+    iov[i].iov_len = pageSize;
+  }
+  long long start = IOStats::now();
+  ssize_t len = ::preadv(fd, iov, n, offsetOf(pid));
+  stats.countCall(start);
+
+  // the requested page is handed to the caller, who still holds its pin.
+  // a page read ahead is only kept if it was read in full.
+  bufferPool.loaded(frames[0], len >= 0);
+  for (int i = 1; i < n; i++) {
+    bufferPool.loaded(frames[i], len >= (ssize_t)(i + 1) * pageSize);
+    bufferPool.unpin(frames[i]);
+  }
+  if (len < 0) return RC_FILE_READ_FAILED;
+
+  // increase the page read count
+  int pages = (int)(len / pageSize);
+  __sync_fetch_and_add(&readCount, (pages > 1) ? pages : 1);
+  stats.countRead((pages > 1) ? pages : 1, len);
+
+  return 0;
+}
+
+RC PageFile::readCompressed(PageId pid, char* frame) const
+{
+  char   image[MAX_PAGE_SIZE];
+  Extent e;
+
+  pthread_mutex_lock(&pageMap->latch);
+  e = pageMap->extents[pid];
+  pthread_mutex_unlock(&pageMap->latch);
+
+  // a page that has never been written is all zero, like the hole
+  // it would leave in a file that is not compressed
+  if (e.length == 0) {
+    memset(frame, 0, pageSize);
+    return 0;
+  }
+
+  // a page that did not compress is stored as it is
+  char* dst = (e.length == pageSize) ? frame : image;
+  long long start = IOStats::now();
+  ssize_t len = ::pread(fd, dst, e.length, e.offset);
+  stats.countCall(start);
+  if (len != e.length) return RC_FILE_READ_FAILED;
+  if (dst == image && !PageCodec::decompress(image, e.length, frame, pageSize)) {
+    return RC_INVALID_FILE_FORMAT;
+  }
+
+  __sync_fetch_and_add(&readCount, 1);
+  stats.countRead(1, e.length);
+  return 0;
+}
+
+RC PageFile::writeCompressed(PageId pid, const void* buffer)
+{
+  char image[MAX_PAGE_SIZE];
+  RC   rc = 0;
+
+  // keep the page as it is if it does not get any smaller
+  int length = PageCodec::compress((const char*)buffer, pageSize, image, pageSize - 1);
+  const char* src = image;
+  if (length == 0) {
+    length = pageSize;
+    src = (const char*)buffer;
+  }
+
+  // writers of the file take turns, so that two new images never get
+  // the same place
+  pthread_mutex_lock(&pageMap->latch);
+  vector<Extent>& extents = pageMap->extents;
+  vector<Extent>& unused = pageMap->unused;
+  if (pid >= (PageId)extents.size()) {
+    Extent zero = { 0, 0, 0 };
+    extents.resize(pid + 1, zero);
+  }
+  Extent e = extents[pid];
+  if (length > e.room) {
+    // the last image of the file (e.g., the page being appended to)
+    // grows where it is. the space of any other image is given to the
+    // next image that fits into it, as long as the file is open.
+    if (e.room > 0 && e.offset + e.room == pageMap->dataEnd) {
+      pageMap->dataEnd = e.offset;
+    } else if (e.room > 0) {
+      unused.push_back(e);
+    }
+    e.room = (length + EXTENT_ALIGNMENT - 1) / EXTENT_ALIGNMENT * EXTENT_ALIGNMENT;
+    unsigned i;
+    for (i = 0; i < unused.size() && unused[i].room < e.room; i++);
+    if (i < unused.size()) {
+      e.offset = unused[i].offset;
+      e.room = unused[i].room;
+      unused[i] = unused.back();
+      unused.pop_back();
+    } else {
+      e.offset = pageMap->dataEnd;
+      pageMap->dataEnd += e.room;
     }
   }
+  e.length = length;
+
+  long long start = IOStats::now();
+  ssize_t len = ::pwrite(fd, src, length, e.offset);
+  stats.countCall(start);
+  if (len != length) {
+    rc = RC_FILE_WRITE_FAILED;
+  } else {
+    extents[pid] = e;
+    pageMap->dirty = true;
+    stats.countWrite(1, length);
+  }
+  pthread_mutex_unlock(&pageMap->latch);
+
+  return rc;
+}
+
+RC PageFile::readBatch(const PageId* pids, int n, PageCallback callback, void* arg) const
+{
+  vector<PageId> sorted(pids, pids + n);
+  vector<PageId> pages;
+  vector<char*>  frames;
+  vector<AsyncIO::Request> reqs;
+  int limit = std::max(bufferPool.getCapacity(pageSize) / 4, 1);
+  RC rc = 0;
+
+  // pages that are read for later are of no use if they are pushed out
+  // of the buffer pool before they are used, so read only as many of
+  // them as one chunk holds, taking the ones that are used first
+  if (callback == NULL && map == NULL) {
+    std::set<PageId> chosen;
+    for (int i = 0; i < n && (int)chosen.size() < limit; i++) chosen.insert(pids[i]);
+    sorted.assign(chosen.begin(), chosen.end());
+  }
 
-  // seek to the page
-  if ((rc = seek(pid)) < 0) return rc;
-  
-  // find the cache slot to evict
-  int toEvict = 0; 
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].lastAccessed == 0) {
-      toEvict = i;
-      break;
+  // read every page once, in the order of the file
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+  if (sorted.empty()) return 0;
+  if (sorted.front() < 0 || sorted.back() >= epid) return RC_INVALID_PID;
+
+  // let the kernel read the pages of a mapped file all at once.
+  // neighboring pages are asked for with one range.
+  if (map != NULL) {
+    off_t mask = (off_t)::sysconf(_SC_PAGESIZE) - 1;
+    for (unsigned i = 0, j; i < sorted.size(); i = j) {
+      for (j = i + 1; j < sorted.size() && sorted[j] == sorted[j - 1] + 1; j++);
+      off_t start = offsetOf(sorted[i]) & ~mask;
+      ::madvise(map + start, offsetOf(sorted[j - 1] + 1) - start, MADV_WILLNEED);
     }
-    if (readCache[i].lastAccessed < readCache[toEvict].lastAccessed) {
-      toEvict = i;
+    if (callback != NULL) {
+      for (unsigned i = 0; i < sorted.size(); i++) {
+        callback(sorted[i], map + offsetOf(sorted[i]), arg);
+      }
+      __sync_fetch_and_add(&readCount, (int)sorted.size());
+      stats.countRead((int)sorted.size(), (long long)sorted.size() * pageSize);
     }
+    return 0;
   }
-  readCache[toEvict].fd = fd;
-  readCache[toEvict].pid = pid;
-  readCache[toEvict].lastAccessed = ++cacheClock;
- 
-  // read the page to cache first and copy it to the buffer
-  if (::read(fd, readCache[toEvict].buffer, PAGE_SIZE) < 0) {
-    return RC_FILE_READ_FAILED;
+
+  // pin the pages a chunk at a time, no more than can be read at once.
+  // the pages of a chunk that are not cached are read with one batch.
+  // the pages are pinned in pid order, like read-ahead does, so that
+  // two threads cannot wait for each other's pages.
+  limit = std::min(limit, (int)AsyncIO::QUEUE_DEPTH);
+  for (unsigned i = 0; i < sorted.size(); ) {
+    pages.clear();
+    frames.clear();
+    reqs.clear();
+    while (i < sorted.size() && (int)pages.size() < limit) {
+      bool cached;
+      char* frame = bufferPool.fetch(fileId, pageSize, sorted[i], cached,
+                                     pattern == SEQUENTIAL, callback == NULL);
+      if (frame == NULL) break;
+      stats.countLookup(cached);
+      if (!cached && pageMap != NULL) {
+        // the pages of a compressed file are read one by one
+        if ((rc = load(sorted[i], frame)) < 0) {
+          bufferPool.unpin(frame);
+          if (callback != NULL) return rc;
+          i++;
+          continue;
+        }
+      } else if (!cached) {
+        AsyncIO::Request req = { fd, frame, (size_t)pageSize, offsetOf(sorted[i]), false, 0 };
+        reqs.push_back(req);
+      }
+      pages.push_back(sorted[i]);
+      frames.push_back(frame);
+      i++;
+    }
+    // every frame is pinned. pages that were only going to be read
+    // ahead of their use are simply left on the disk.
+    if (pages.empty()) return (callback == NULL) ? rc : RC_FILE_READ_FAILED;
+
+    if (!reqs.empty()) {
+      long long start = IOStats::now();
+      AsyncIO::run(&reqs[0], (int)reqs.size(), pageLoaded, &bufferPool);
+      stats.countCall(start);
+    }
+
+    // hand the pages over only once every read of the chunk is done,
+    // so that the callback may read other pages itself
+    int loaded = 0;
+    for (unsigned k = 0, r = 0; k < pages.size(); k++) {
+      bool ok = true;
+      if (r < reqs.size() && reqs[r].buffer == frames[k]) {
+        ok = (reqs[r++].result == pageSize);
+        if (ok) loaded++;
+      }
+      if (!ok) {
+        if (rc == 0) rc = RC_FILE_READ_FAILED;
+      } else if (callback != NULL) {
+        callback(pages[k], frames[k], arg);
+      }
+      bufferPool.unpin(frames[k]);
+    }
+    __sync_fetch_and_add(&readCount, loaded);
+    stats.countRead(loaded, (long long)loaded * pageSize);
   }
-  memcpy(buffer, readCache[toEvict].buffer, PAGE_SIZE);
 
-  // increase the page read count
-  readCount++;
+  return rc;
+}
+
+RC PageFile::writeBatch(const PageId* pids, const void* const* buffers, int n)
+{
+  RC rc;
+
+  if (n <= 0) return 0;
+  if (map != NULL) return RC_FILE_WRITE_FAILED;
+
+  vector<PageId> sorted(pids, pids + n);
+  std::sort(sorted.begin(), sorted.end());
+  if (sorted.front() < 0) return RC_INVALID_PID;
+  if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) return RC_INVALID_PID;
+
+  // in write-back mode the pages only go to the buffer pool,
+  // which writes them back in pid order later on.
+  // the pages of a compressed file are compressed one by one.
+  if (bufferPool.isWriteBack() || pageMap != NULL) {
+    for (int i = 0; i < n; i++) {
+      if ((rc = write(pids[i], buffers[i])) < 0) return rc;
+    }
+    return 0;
+  }
+
+  vector<AsyncIO::Request> reqs(n);
+  for (int i = 0; i < n; i++) {
+    AsyncIO::Request req = { fd, (char*)buffers[i], (size_t)pageSize, offsetOf(pids[i]), true, 0 };
+    reqs[i] = req;
+  }
+  long long start = IOStats::now();
+  rc = AsyncIO::run(&reqs[0], n, NULL, NULL);
+  stats.countCall(start);
+
+  // keep the new content of the written pages in the buffer pool,
+  // so that they do not have to be read back from the disk
+  for (int i = 0; i < n; i++) {
+    if (reqs[i].result != pageSize) continue;
+    char* frame = bufferPool.update(fileId, pageSize, pids[i], fd, false);
+    if (frame != NULL) {
+      memcpy(frame, buffers[i], pageSize);
+      bufferPool.unpin(frame);
+    }
+    __sync_fetch_and_add(&writeCount, 1);
+    stats.countWrite(1, pageSize);
+    extend(pids[i]);
+  }
+
+  return rc;
+}
 
+RC PageFile::pinNew(PageId pid, PageHandle& page)
+{
+  page.release();
+  if (pid < 0) return RC_INVALID_PID; 
+  if (map != NULL) return RC_FILE_WRITE_FAILED;
+
+  // a clean frame is enough for now. the page becomes dirty (and
+  // possibly extends the file) when the handle is written or released.
+  char* frame = bufferPool.update(fileId, pageSize, pid, fd, false);
+  if (frame == NULL) return RC_FILE_WRITE_FAILED;
+  memset(frame, 0, pageSize);
+
+  page.pf = this;
+  page.pid = pid;
+  page.frame = frame;
+  page.dirty = true;
   return 0;
 }
+
+RC PageFile::unpin(PageId pid, char* frame, bool dirty, bool unpin)
+{
+  RC rc = 0;
+
+  // pages of a mapped file are not pinned, and cannot be modified
+  if (map != NULL) return dirty ? RC_FILE_WRITE_FAILED : 0;
+
+  if (dirty) {
+    if (pageMap != NULL) {
+      // the pages of a compressed file are written through
+      rc = writeCompressed(pid, frame);
+      if (rc == 0) __sync_fetch_and_add(&writeCount, 1);
+    } else if (bufferPool.isWriteBack()) {
+      // mark the frame dirty. the pool writes it back later
+      rc = bufferPool.markDirty(frame, fd);
+    } else {
+      // write the frame through to the disk
+      long long start = IOStats::now();
+      ssize_t len = ::pwrite(fd, frame, pageSize, offsetOf(pid));
+      stats.countCall(start);
+      if (len < 0) {
+        rc = RC_FILE_WRITE_FAILED;
+      } else {
+        __sync_fetch_and_add(&writeCount, 1);
+        stats.countWrite(1, pageSize);
+      }
+    }
+
+    // if the written pid >= end pid, update the end pid
+    if (rc == 0) extend(pid);
+  }
+
+  if (unpin) bufferPool.unpin(frame);
+  return rc;
+}
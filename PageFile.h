@@ -12,34 +12,142 @@
 
 #include <string>
 #include "Bruinbase.h"
+#include "BufferPool.h"
+#include "IOStats.h"
 
 typedef int PageId;
 
+class PageFile;
+
 /**
- * read/write a file in the unit of a page
+ * A pinned page of a PageFile. The handle points straight into the
+ * buffer pool frame that holds the page, so the page can be read and
+ * modified in place without copying it. The page stays in the pool
+ * until the handle is released or destroyed.
+ * Whoever modifies the page must call markDirty(), so that the change
+ * is written to the disk when the handle is released.
+ */
+class PageHandle {
+ public:
+  PageHandle();
+  ~PageHandle() { release(); }
+
+  /**
+   * @return the content of the page, or NULL if no page is pinned
+   */
+  char* data() const { return frame; }
+
+  /**
+   * @return true if the handle holds a pinned page
+   */
+  bool isPinned() const { return frame != NULL; }
+
+  /**
+   * @return true if the handle holds page pid of the file pf
+   */
+  bool isPageOf(const PageFile& pf, PageId pid) const;
+
+  /**
+   * note that the page has been modified.
+   */
+  void markDirty() { if (frame != NULL) dirty = true; }
+
+  /**
+   * write the page like PageFile::write() if it has been modified,
+   * but keep it pinned.
+   * @return error code. 0 if no error
+   */
+  RC write();
+
+  /**
+   * write the page if it has been modified, and unpin it.
+   * @return error code. 0 if no error
+   */
+  RC release();
+
+ private:
+  friend class PageFile;
+
+  PageFile* pf;     // the file the page belongs to
+  PageId    pid;    // the pinned page
+  char*     frame;  // the buffer pool frame holding the page
+  bool      dirty;  // true if the page has been modified
+
+  // a pin is owned by exactly one handle
+  PageHandle(const PageHandle&);
+  PageHandle& operator=(const PageHandle&);
+};
+
+/**
+ * read/write a file in the unit of a page.
+ * the size of a page is chosen when the file is created, and recorded
+ * in a header page at the beginning of the file. the header page is
+ * not visible to the users of the class: page 0 is the first page
+ * after the header. files created before page sizes could be chosen
+ * have no header and 1KB pages.
+ * pages are read and written with pread()/pwrite(), which do not move
+ * the file offset, so one PageFile can be read by several threads at
+ * the same time. open() and close() must not race with other calls.
+ * a file may be created compressed. its pages are then stored one after
+ * another with PageCodec, each taking only the bytes it compresses to,
+ * and a map from page ids to their place in the file is kept at the end
+ * of the file. the pages of a compressed file are always written through
+ * to the disk, and are never memory-mapped.
  */
 class PageFile {
  public:
 
-  static const int PAGE_SIZE = 1024;    // the size of a page is 1KB
+  static const int MIN_PAGE_SIZE = 1024;      // the smallest page size
+  static const int MAX_PAGE_SIZE = 16384;     // the largest page size
+  static const int DEFAULT_PAGE_SIZE = 4096;  // the page size of new files
+  static const int LEGACY_PAGE_SIZE = 1024;   // the page size of files without a header
+  static const int READ_AHEAD_SIZE = 128 * 1024;  // max # of bytes read ahead at once
+  static const int USER_DATA_SIZE = 32;       // # bytes of the header page kept for the user
+
+  // the expected order of page accesses, given to advise()
+  enum AccessPattern { NORMAL, SEQUENTIAL, RANDOM };
+
+  /**
+   * called by readBatch() for every page that it has read.
+   * @param pid[IN] the page
+   * @param page[IN] the content of the page, valid until the function returns
+   * @param arg[IN] the argument given to readBatch()
+   */
+  typedef void (*PageCallback)(PageId pid, const char* page, void* arg);
 
   PageFile();
   PageFile(const std::string& filename, char mode);
 
   /**
    * open a file in read or write mode.
-   * when opened in 'w' mode, if the file does not exist, it is created.
+   * when opened in 'w' mode, if the file does not exist, it is created
+   * with pages of newPageSize bytes, or getDefaultPageSize() bytes.
+   * when opened in 'r' mode, the file is memory-mapped (unless mapping
+   * has been turned off with setMmapReads() or the file is compressed),
+   * and its pages are read straight from the mapping instead of through
+   * the buffer pool.
    * @param filename[IN] the name of the file to open
    * @param mode[IN] 'r' for read, 'w' for write
+   * @param compress[IN] true to compress the pages of the file if it is
+   *                     created. an existing file stays as it was created
+   * @param newPageSize[IN] the page size of the file if it is created,
+   *                        or 0 for getDefaultPageSize()
    * @return error code. 0 if no error
    */
-  RC open(const std::string& filename, char mode);
+  RC open(const std::string& filename, char mode, bool compress = false, int newPageSize = 0);
 
   /**
-   * close the file.
+   * close the file. dirty pages of the file are written to disk first.
    * @return error code. 0 if no error
    */
   RC close();
+
+  /**
+   * write all dirty pages of the file that are cached in the
+   * buffer pool to the disk.
+   * @return error code. 0 if no error
+   */
+  RC flush();
   
   /**
    * read a disk page into memory buffer.
@@ -53,12 +161,129 @@ class PageFile {
    * write the memory buffer to the disk page.
    * if (pid >= endPid()), the file is expanded such that
    * endPid() becomes (pid + 1).
+   * in write-back mode the page is only updated in the buffer pool
+   * and reaches the disk when it is flushed or evicted.
    * @param pid[IN] page to write to
    * @param buffer[IN] the content to write
    * @return error code. 0 if no error
    */
   RC write(PageId pid, const void *buffer);
     
+  /**
+   * read a batch of pages. the pages that are not in the buffer pool
+   * are read into it with one batch of disk reads, so that the disk can
+   * work on all of them at once, and the pages are handed to callback
+   * once they are all in memory. each page is handed over once, no
+   * matter how often it appears in pids, in no particular order.
+   * with a NULL callback the pages are only brought into memory, ahead
+   * of reading them with read() or pin(). this does not count as a use
+   * of the pages by the buffer pool, and only the first pages of pids
+   * are read, as many as the buffer pool can keep until they are used.
+   * @param pids[IN] the pages to read
+   * @param n[IN] the # of pages in pids
+   * @param callback[IN] called for every page that has been read (may be NULL)
+   * @param arg[IN] passed to callback
+   * @return error code. 0 if no error
+   */
+  RC readBatch(const PageId* pids, int n, PageCallback callback, void* arg) const;
+
+  /**
+   * write a batch of pages like write(). in write-through mode the
+   * disk writes are issued all at once.
+   * @param pids[IN] the pages to write. a page may appear only once
+   * @param buffers[IN] the content of each page
+   * @param n[IN] the # of pages
+   * @return error code. 0 if no error
+   */
+  RC writeBatch(const PageId* pids, const void* const* buffers, int n);
+
+  /**
+   * pin a disk page in the buffer pool, reading it in if necessary,
+   * and give access to it through page without copying it.
+   * for a memory-mapped file, page points into the mapping.
+   * the page must be released before the file is closed.
+   * @param pid[IN] the page to pin
+   * @param page[OUT] the handle of the pinned page
+   * @return error code. 0 if no error
+   */
+  RC pin(PageId pid, PageHandle& page) const;
+
+  /**
+   * pin a zero-filled page that replaces the content of page pid.
+   * used to create a new page (e.g., pid = endPid()) without reading it.
+   * the page is marked dirty, so it is written when it is released.
+   * @param pid[IN] the page to create
+   * @param page[OUT] the handle of the pinned page
+   * @return error code. 0 if no error
+   */
+  RC pinNew(PageId pid, PageHandle& page);
+
+  /**
+   * tell the operating system how the pages of the file will be
+   * accessed, so that it can read ahead or not.
+   * pages read after a SEQUENTIAL hint are also kept from displacing
+   * the pages that other files use over and over in the buffer pool,
+   * and every page read from the disk brings the pages after it along.
+   * @param pattern[IN] SEQUENTIAL for scans, RANDOM for probes
+   * @return error code. 0 if no error
+   */
+  RC advise(AccessPattern pattern);
+
+  /**
+   * @return the size of the pages of the file in bytes
+   */
+  int getPageSize() const { return pageSize; }
+
+  /**
+   * set the page size of the files that are created from now on.
+   * @param size[IN] a power of two between MIN_PAGE_SIZE and MAX_PAGE_SIZE
+   * @return error code. 0 if no error
+   */
+  static RC setDefaultPageSize(int size);
+
+  /**
+   * @return the page size of the files that are created from now on
+   */
+  static int getDefaultPageSize() { return defaultPageSize; }
+
+  /**
+   * @return false if the file was created before page sizes could be
+   *         chosen, and has no header page
+   */
+  bool hasHeader() const { return base > 0; }
+
+  /**
+   * get the bytes of the header page that are kept for the user of the
+   * file, e.g., to tell how the pages are laid out. they are all zero
+   * in a new file and in a file without a header page.
+   * @param data[OUT] USER_DATA_SIZE bytes
+   */
+  void getUserData(void* data) const;
+
+  /**
+   * store the bytes of the header page that are kept for the user of the file.
+   * @param data[IN] USER_DATA_SIZE bytes
+   * @return error code. 0 if no error
+   */
+  RC setUserData(const void* data);
+
+  /**
+   * @return true if the pages of the file are compressed
+   */
+  bool isCompressed() const { return pageMap != NULL; }
+
+  /**
+   * @return true if the file is memory-mapped
+   */
+  bool isMapped() const { return map != NULL; }
+
+  /**
+   * turn memory-mapping of files opened in 'r' mode on or off.
+   * files that are already open are not affected.
+   * @param on[IN] true to map read-only files
+   */
+  static void setMmapReads(bool on) { mmapReads = on; }
+
   /**
    * note the +1 part. The last page id in the file is actually endPid()-1.
    * that is, the last page can be read by "read(endPid()-1, buffer)".
@@ -66,44 +291,112 @@ class PageFile {
    */
   PageId endPid() const;
 
+  /**
+   * the I/O of the file since it was opened, including the pages that
+   * the buffer pool wrote back for it. after close() the counters of
+   * the file stay available until it is opened again.
+   * @return the counters of the file
+   */
+  IOStats getStats() const;
+
   /**
    * @return the total # of disk reads
    */
   static int getPageReadCount()  { return readCount; }
   
   /**
-   * @return the total # of disk writes
+   * @return the total # of disk writes (including write-backs)
    */
-  static int getPageWriteCount() { return writeCount; }
+  static int getPageWriteCount() { return writeCount + bufferPool.getWriteBackCount(); }
+
+  /**
+   * the buffer pool shared by all PageFiles.
+   * use it to change the cache size or to get the hit/miss counts.
+   * @return the shared buffer pool
+   */
+  static BufferPool& getBufferPool() { return bufferPool; }
 
  protected:
+  friend class PageHandle;
+
   /**
-   * move the file cursor to the beginning of a page.
-   * this is an internal function not exposed to public.
-   * @param pid[IN] page to seek to
+   * write back a modified pinned page and/or unpin it.
+   * @param pid[IN] the pinned page
+   * @param frame[IN] the frame holding the page
+   * @param dirty[IN] true if the page has been modified
+   * @param unpin[IN] true to release the pin
+   * @return error code. 0 if no error
+   */
+  RC unpin(PageId pid, char* frame, bool dirty, bool unpin);
+
+  /**
+   * @return the position of a page in the unix file
+   */
+  off_t offsetOf(PageId pid) const { return base + (off_t)pid * pageSize; }
+
+  /**
+   * read a page that is not in the buffer pool into its frame.
+   * if the file is read sequentially, the pages that follow it are
+   * read into the buffer pool with the same system call.
+   * @param pid[IN] the page to read
+   * @param frame[IN] the pinned frame for the page, returned by fetch()
+   * @return error code. 0 if no error
+   */
+  RC load(PageId pid, char* frame) const;
+
+  /**
+   * read a page of a compressed file from the disk and decompress it.
+   * @param pid[IN] the page to read
+   * @param frame[OUT] the page
+   * @return error code. 0 if no error
+   */
+  RC readCompressed(PageId pid, char* frame) const;
+
+  /**
+   * compress a page of a compressed file and write it to the disk. the
+   * page is written over its old image if it fits there, and after the
+   * last image of the file otherwise.
+   * @param pid[IN] the page to write
+   * @param buffer[IN] the content of the page
    * @return error code. 0 if no error
    */
-  RC seek(PageId pid) const;
+  RC writeCompressed(PageId pid, const void* buffer);
+
+  /**
+   * write the page map of a compressed file to the end of the file,
+   * and record its place in the header page.
+   * @return error code. 0 if no error
+   */
+  RC writePageMap();
+
+  /**
+   * make sure that endPid() is larger than pid.
+   * this is an internal function not exposed to public.
+   * @param pid[IN] the page that has been written
+   */
+  void extend(PageId pid);
 
  private:
+  struct PageMap;  // the place of every page of a compressed file, see PageFile.cc
+
   int     fd;     // file descriptor of the associated unix file
   PageId  epid;   // (last page id + 1) of the file
+  int     fileId; // the id of the file in the buffer pool
+  int     pageSize;   // the size of the pages of the file
+  off_t   base;   // the position of page 0 (the size of the header, if any)
+  char    userData[USER_DATA_SIZE];  // the user's bytes of the header page
+  AccessPattern pattern;  // the access pattern given to advise()
+  mutable PageId lastRead;  // the last page read from the disk
+  mutable IOStats stats;    // the I/O of the file since it was opened
+  IOStats poolStats;        // the write-backs of the file before it was opened
+  char*   map;    // the mapping of a read-only file (NULL if not mapped)
+  size_t  mapLength;  // the length of the mapping
+  PageMap* pageMap;  // where the pages of a compressed file are (NULL if not compressed)
+
+  static bool mmapReads;  // map files opened in 'r' mode
+  static int  defaultPageSize;  // the page size of new files
 
-  //
-  // the following set of members implement LRU caching 
-  //
-  static const int CACHE_COUNT = 10;
-
-  static int cacheClock; // clock tick counter for LRU policy
-
-  // the actual cache data structure
-  static struct cacheStruct {
-    int    fd;              // file id of the cached page
-    PageId pid;             // page id of the cached page
-    int    lastAccessed;    // the last time the cached page was accessed
-                            //   (lastAccessed == 0) means that the buffer is empty
-    char buffer[PAGE_SIZE]; // the buffer used for caching
-  } readCache[CACHE_COUNT];
+  static BufferPool bufferPool;  // page cache shared by all PageFiles
 
   static int readCount;  // total # of page reads 
   static int writeCount; // total # of page writes 
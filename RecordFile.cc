@@ -9,15 +9,104 @@
 
 #include "Bruinbase.h"
 #include "RecordFile.h"
+#include <cerrno>
+#include <climits>
+#include <cstdio>
 #include <cstring>
+#include <deque>
+#include <map>
+#include <vector>
 
 using std::string;
+using std::vector;
+
+// # pages that appendBatch() fills before it writes them
+static const int BATCH_PAGES = 64;
 
 //
 // helper functions for page manipultation
 //
 
-// compute the pointer to the n'th slot in a page
+// the slotted page layout. a page starts with # records in the page and
+// the position of the first tuple, followed by the slot directory with
+// the position and length of each tuple. the tuples are packed from the
+// end of the page towards the directory, and each one is the key
+// followed by the characters of the value.
+struct SlottedHeader {
+  int count;      // # records in the page
+  int dataStart;  // the position of the first tuple
+};
+
+struct Slot {
+  unsigned short offset;  // the position of the tuple in the page
+  unsigned short length;  // the length of the tuple
+};
+
+// prepare an empty slotted page
+static void initPage(char* page, int pageSize);
+
+// get # bytes left for the tuple and the slot of a new record
+static int freeSpace(const char* page);
+
+// get # bytes that the tuple and the slot of a record take
+static int recordSize(const std::string& value);
+
+// read the n'th record of a slotted page
+static void readTuple(const char* page, int n, int& key, std::string& value);
+
+// add a record to a slotted page as its n'th record
+static void writeTuple(char* page, int n, int key, const std::string& value);
+
+// check whether the n'th record of a slotted page has been removed.
+// the slot of a removed record is kept with a length of zero, which
+// no tuple has, since every tuple starts with its key.
+static bool tupleRemoved(const char* page, int n);
+
+// the pages of a COLUMNAR file. a key page starts with # keys in the
+// page and the range of value pages that hold the values of the keys,
+// followed by the keys. the end of the page is a directory with the
+// slot of the first key of each of the value pages, filled from the
+// end. a value page is a slotted page of values alone, and the values
+// of a key page start on a value page of their own.
+struct KeyPageHeader {
+  int    count;           // # keys in the page
+  PageId firstValuePage;  // the value page of the first key
+  int    valuePages;      // # value pages of the keys in the page
+};
+
+// compute # entries of the value page directory of a key page
+static int valueDirSize(int pageSize);
+
+// compute # keys in a key page
+static int keysPerPage(int pageSize);
+
+// get/set the slot of the first key of the n'th value page of a key page
+static int getValueDir(const char* page, int pageSize, int n);
+static void setValueDir(char* page, int pageSize, int n, int slot);
+
+// get the length of a value as it is stored
+static int storedLength(const std::string& value);
+
+// get # bytes that a value and its slot take in a value page
+static int valueSize(const std::string& value);
+
+// get the n'th value of a value page
+static const char* valuePtr(const char* page, int n, int& length);
+
+// add a value to the end of a value page
+static void writeValue(char* page, const std::string& value);
+
+// the values of a DICTIONARY-encoded file. the dictionary file is a
+// sequence of value pages, and the code of a value is its position in
+// the sequence. a record stores its code in place of the value.
+struct RecordFile::Dictionary {
+  std::deque<string> values;   // the value of every code
+  std::map<string, int> codes; // the code of every value
+  vector<char> page;           // the last page of the dictionary file
+  PageId pid;                  // the id of the last page (-1 if none)
+};
+
+// compute the pointer to the n'th slot in a page with fixed-size slots
 static char* slotPtr(char* page, int n);
 
 // read the record in the n'th slot in the page
@@ -37,32 +126,6 @@ static void setRecordCount(char* page, int count);
 // helper functions for RecordId manipulation
 //
 
-// postfix record id iterator
-RecordId operator++ (RecordId& rid, int)
-{
-  RecordId prid(rid);
-
-  // if the end of a page is reached, move to the next page
-  if (++rid.sid >= RecordFile::RECORDS_PER_PAGE) {
-    rid.pid++;
-    rid.sid = 0;
-  }
-
-  return prid;
-}
-
-// prefix record id iterator
-RecordId& operator++ (RecordId& rid)
-{
-  // if the end of a page is reached, move to the next page
-  if (++rid.sid >= RecordFile::RECORDS_PER_PAGE) {
-    rid.pid++;
-    rid.sid = 0;
-  } 
-
-  return rid;
-}
-
 // RecordId comparators
 bool operator < (const RecordId& r1, const RecordId& r2)
 {
@@ -107,20 +170,161 @@ RecordFile::RecordFile()
 {
   erid.pid = 0;
   erid.sid = 0;
+  format = ROW;
+  slotted = true;
+  slotsPerPage = recordsPerPage(PageFile::getDefaultPageSize());
+  lastPage = -1;
+  dict = NULL;
+  zoned = false;
+  freeMapped = false;
 }
 
 RecordFile::RecordFile(const string& filename, char mode)
 {
+  erid.pid = 0;
+  erid.sid = 0;
+  format = ROW;
+  slotted = true;
+  slotsPerPage = recordsPerPage(PageFile::getDefaultPageSize());
+  lastPage = -1;
+  dict = NULL;
+  zoned = false;
+  freeMapped = false;
   open(filename, mode);
 }
 
-RC RecordFile::open(const string& filename, char mode)
+RC RecordFile::open(const string& filename, char mode, Format newFormat, bool compress,
+                    Encoding newEncoding, int newPageSize)
 {
   RC   rc;
-  char page[PageFile::PAGE_SIZE];
+  PageHandle page;
+  char info[PageFile::USER_DATA_SIZE];
+  int  stored, encoding, hasZones, hasFreeMap;
 
   // open the page file
-  if ((rc = pf.open(filename, mode)) < 0) return rc;
+  if ((rc = pf.open(filename, mode, compress, newPageSize)) < 0) return rc;
+  name = filename;
+  slotted = pf.hasHeader();
+  slotsPerPage = recordsPerPage(pf.getPageSize());
+  lastPage = -1;
+
+  // the format, the encoding and whether there is a zone map and a
+  // free-space map are kept in the user data of the header page, which
+  // is zero (ROW, PLAIN and no maps) in files of earlier builds
+  pf.getUserData(info);
+  memcpy(&stored, info, sizeof(int));
+  memcpy(&encoding, info + sizeof(int), sizeof(int));
+  memcpy(&hasZones, info + 2 * sizeof(int), sizeof(int));
+  memcpy(&hasFreeMap, info + 3 * sizeof(int), sizeof(int));
+  if ((mode == 'w' || mode == 'W') && stored == ROW && encoding == PLAIN && !hasZones &&
+      pf.hasHeader() && pf.endPid() == 0) {
+    stored = newFormat;
+    encoding = newEncoding;
+    hasZones = 1;
+    memcpy(info, &stored, sizeof(int));
+    memcpy(info + sizeof(int), &encoding, sizeof(int));
+    memcpy(info + 2 * sizeof(int), &hasZones, sizeof(int));
+    if ((rc = pf.setUserData(info)) < 0) {
+      pf.close();
+      return rc;
+    }
+    // drop the side files that an earlier file of the same name left behind
+    ::remove((filename + ".val").c_str());
+    ::remove((filename + ".dict").c_str());
+    ::remove((filename + ".zone").c_str());
+    ::remove((filename + ".free").c_str());
+  }
+
+  // the values of a COLUMNAR file are in a file of their own,
+  // compressed if the keys are
+  if (stored == COLUMNAR) {
+    if ((rc = vf.open(filename + ".val", mode, pf.isCompressed(), newPageSize)) < 0) {
+      pf.close();
+      return rc;
+    }
+    format = COLUMNAR;
+    slotted = false;
+    slotsPerPage = keysPerPage(pf.getPageSize());
+
+    // the value page directory of a key page assumes pages of the same size
+    if (vf.getPageSize() != pf.getPageSize()) {
+      close();
+      return RC_INVALID_FILE_FORMAT;
+    }
+  }
+
+  // read the whole dictionary of a DICTIONARY-encoded file into memory
+  if (encoding == DICTIONARY) {
+    if ((rc = df.open(filename + ".dict", mode, pf.isCompressed(), newPageSize)) < 0) {
+      close();
+      return rc;
+    }
+    dict = new Dictionary;
+    dict->page.assign(df.getPageSize(), 0);
+    dict->pid = df.endPid() - 1;
+    for (PageId pid = 0; pid < df.endPid(); pid++) {
+      if ((rc = df.pin(pid, page)) < 0) {
+        close();
+        return rc;
+      }
+      for (int i = 0; i < getRecordCount(page.data()); i++) {
+        int length;
+        const char* ptr = valuePtr(page.data(), i, length);
+        dict->codes[string(ptr, length)] = (int)dict->values.size();
+        dict->values.push_back(string(ptr, length));
+      }
+      if (pid == dict->pid) memcpy(&dict->page[0], page.data(), df.getPageSize());
+    }
+    page.release();
+  }
+
+  // read the zone map into memory. it may have entries for the empty
+  // pages at its end, and none for pages that failed to be added to it.
+  if (hasZones) {
+    if ((rc = zf.open(filename + ".zone", mode, pf.isCompressed(), newPageSize)) < 0) {
+      close();
+      return rc;
+    }
+    zoned = true;
+    int perPage = zf.getPageSize() / sizeof(KeyRange);
+    for (PageId pid = 0; pid < zf.endPid(); pid++) {
+      if ((rc = zf.pin(pid, page)) < 0) {
+        close();
+        return rc;
+      }
+      for (int i = 0; i < perPage; i++) {
+        KeyRange range;
+        memcpy(&range, page.data() + i * sizeof(KeyRange), sizeof(range));
+        zones.push_back(range);
+      }
+    }
+    page.release();
+    if ((PageId)zones.size() > pf.endPid()) zones.resize(pf.endPid());
+  }
+
+  // read the free-space map into memory. a file only has one
+  // once a record of it has been removed.
+  if (hasFreeMap) {
+    if ((rc = ff.open(filename + ".free", mode, pf.isCompressed(), newPageSize)) < 0) {
+      close();
+      return rc;
+    }
+    freeMapped = true;
+    int perPage = ff.getPageSize() / sizeof(int);
+    for (PageId pid = 0; pid < ff.endPid(); pid++) {
+      if ((rc = ff.pin(pid, page)) < 0) {
+        close();
+        return rc;
+      }
+      for (int i = 0; i < perPage; i++) {
+        int bytes;
+        memcpy(&bytes, page.data() + i * sizeof(int), sizeof(int));
+        freed.push_back(bytes);
+      }
+    }
+    page.release();
+    if ((PageId)freed.size() > pf.endPid()) freed.resize(pf.endPid());
+  }
   
   //
   // in the rest of this function, we set the end record id
@@ -139,16 +343,17 @@ RC RecordFile::open(const string& filename, char mode)
   // obtain # records in the last page to set sid of the end record id.
   // read the last page of the file and get # records in the page.
   // remeber that the id of the last page is endPid()-1 not endPid().
-  if ((rc = pf.read(--erid.pid, page)) < 0) {
+  if ((rc = pf.pin(--erid.pid, page)) < 0) {
     // an error occurred during page read
-    erid.pid = erid.sid = 0;
-    pf.close();
+    close();
     return rc;
   }
 
-  // get # records in the last page
-  erid.sid = getRecordCount(page);
-  if (erid.sid >= RECORDS_PER_PAGE) {
+  // get # records in the last page. whether another record fits
+  // into a slotted page depends on its size, so that is left to append()
+  erid.sid = getRecordCount(page.data());
+  page.release();
+  if (!slotted && erid.sid >= slotsPerPage) {
     // the last page is full. advance the end record id to the next page.
     erid.pid++;
     erid.sid = 0;
@@ -159,70 +364,864 @@ RC RecordFile::open(const string& filename, char mode)
 
 RC RecordFile::close()
 {
+  RC rc;
+
   erid.pid = 0;
   erid.sid = 0;
 
+  if (zoned) {
+    zoned = false;
+    zones.clear();
+    zf.close();
+  }
+  if (freeMapped) {
+    freeMapped = false;
+    freed.clear();
+    ff.close();
+  }
+  if (dict != NULL) {
+    delete dict;
+    dict = NULL;
+    if ((rc = df.close()) < 0) {
+      if (format == COLUMNAR) vf.close();
+      format = ROW;
+      pf.close();
+      return rc;
+    }
+  }
+  if (format == COLUMNAR) {
+    format = ROW;
+    if ((rc = vf.close()) < 0) {
+      pf.close();
+      return rc;
+    }
+  }
   return pf.close();
 }
 
 RC RecordFile::read(const RecordId& rid, int& key, string& value) const
 {
   RC   rc;
-  char page[PageFile::PAGE_SIZE];
+  PageHandle page;
   
   // check whether the rid is in the valid range
   if (rid.pid < 0 || rid.pid > erid.pid) return RC_INVALID_RID;
-  if (rid.sid < 0 || rid.sid >= RecordFile::RECORDS_PER_PAGE) return RC_INVALID_RID;
+  if (rid.sid < 0 || (!slotted && rid.sid >= slotsPerPage)) return RC_INVALID_RID;
   if (rid >= erid) return RC_INVALID_RID;
   
-  // read the page containing the record
-  if ((rc = pf.read(rid.pid, page)) < 0) return rc;
+  // pin the page containing the record
+  if ((rc = pf.pin(rid.pid, page)) < 0) return rc;
+
+  if (format == COLUMNAR) {
+    // the key is in the key page, and the value in one of its value pages
+    PageHandle vpage;
+    PageId vpid = -1;
+    int n, length;
+    if (rid.sid >= getRecordCount(page.data())) return RC_INVALID_RID;
+    memcpy(&key, page.data() + sizeof(KeyPageHeader) + rid.sid * sizeof(int), sizeof(int));
+    if ((rc = pinValue(page.data(), rid.sid, vpage, vpid, n)) < 0) return rc;
+    const char* ptr = valuePtr(vpage.data(), n, length);
+    value.assign(ptr, length);
+  } else if (!slotted) {
+    // read the record from the slot in the page
+    readSlot(page.data(), rid.sid, key, value);
+  } else {
+    // read the record through the slot directory, and remember
+    // # records in the page for next()
+    int count = getRecordCount(page.data());
+    if (rid.sid >= count) return RC_INVALID_RID;
+    if (tupleRemoved(page.data(), rid.sid)) return RC_NO_SUCH_RECORD;
+    readTuple(page.data(), rid.sid, key, value);
+    __atomic_store_n(&lastPage, (long long)rid.pid << 32 | count, __ATOMIC_RELAXED);
+  }
 
-  // read the record from the slot in the page
-  readSlot(page, rid.sid, key, value);
+  // look up the value of the stored code
+  if (dict != NULL) {
+    const string* decoded = decode(value.data(), (int)value.size());
+    if (decoded == NULL) return RC_INVALID_FILE_FORMAT;
+    value = *decoded;
+  }
 
   return 0;
 }
 
-RC RecordFile::append(int key, const std::string& value, RecordId& rid)
+RC RecordFile::findCode(const string& value, int& code) const
+{
+  if (dict == NULL) return RC_NO_SUCH_RECORD;
+
+  std::map<string, int>::const_iterator it = dict->codes.find(value);
+  if (it == dict->codes.end()) return RC_NO_SUCH_RECORD;
+  code = it->second;
+  return 0;
+}
+
+RC RecordFile::encode(const string* values, int n, string* codes)
 {
   RC   rc;
-  char page[PageFile::PAGE_SIZE];
+  int  pageSize = df.getPageSize();
+  bool dirty = false;  // true if the last dictionary page has new values
+
+  for (int i = 0; i < n; i++) {
+    // the dictionary holds the values as they would have been stored
+    string value = values[i].substr(0, storedLength(values[i]));
+    std::map<string, int>::iterator it = dict->codes.find(value);
+    int code;
+
+    if (it != dict->codes.end()) {
+      code = it->second;
+    } else {
+      // add the new value to the last dictionary page, or to a new one.
+      // a full page is written right away.
+      if (dict->pid < 0 || freeSpace(&dict->page[0]) < valueSize(value)) {
+        if (dirty && (rc = df.write(dict->pid, &dict->page[0])) < 0) return rc;
+        dict->pid++;
+        memset(&dict->page[0], 0, pageSize);
+        initPage(&dict->page[0], pageSize);
+      }
+      writeValue(&dict->page[0], value);
+      dirty = true;
+
+      code = (int)dict->values.size();
+      dict->codes[value] = code;
+      dict->values.push_back(value);
+    }
+    codes[i].assign((const char*)&code, sizeof(int));
+  }
+
+  // the dictionary is on the disk before any record that uses it
+  if (dirty && (rc = df.write(dict->pid, &dict->page[0])) < 0) return rc;
+  return 0;
+}
+
+const string* RecordFile::decode(const char* code, int length) const
+{
+  int n;
+
+  if (length != sizeof(int)) return NULL;
+  memcpy(&n, code, sizeof(int));
+  if (n < 0 || n >= (int)dict->values.size()) return NULL;
+  return &dict->values[n];
+}
+
+RC RecordFile::append(int key, const std::string& plain, RecordId& rid)
+{
+  RC   rc;
+  PageHandle page;
+  string code;
+
+  // a DICTIONARY-encoded file stores the code of the value
+  const string& value = (dict != NULL) ? code : plain;
+  if (dict != NULL && (rc = encode(&plain, 1, &code)) < 0) return rc;
+
+  if (format == COLUMNAR) {
+    if ((rc = appendColumns(&key, &value, 1, &rid)) < 0) return rc;
+    return addToZones(&key, &rid, 1);
+  }
 
   // unless we are writing to the the first slot of an empty page,
-  // we have to read the page first
+  // we have to pin the page first
   if (erid.sid > 0) {
-    if ((rc = pf.read(erid.pid, page)) < 0) return rc;
-  } else {
+    if ((rc = pf.pin(erid.pid, page)) < 0) return rc;
+
+    // start a new page if the record does not fit into the last one
+    if (slotted && freeSpace(page.data()) < recordSize(value)) {
+      page.release();
+      erid.pid++;
+      erid.sid = 0;
+    }
+  }
+  // the cached # records of the page read last may not be final
+  // once the page is not the last one anymore
+  if (erid.sid == 0) __atomic_store_n(&lastPage, -1LL, __ATOMIC_RELAXED);
+  if (erid.sid == 0) {
     // if this is the first slot of an empty page
-    // we can simply initialize the page with zeros
-    memset(page, 0, PageFile::PAGE_SIZE);
+    // we can simply start from a page of zeros
+    if ((rc = pf.pinNew(erid.pid, page)) < 0) return rc;
+    if (slotted) initPage(page.data(), pf.getPageSize());
   }
     
   // write the record to the first empty slot 
-  writeSlot(page, erid.sid, key, value);
+  if (slotted) {
+    writeTuple(page.data(), erid.sid, key, value);
+  } else {
+    writeSlot(page.data(), erid.sid, key, value);
+  }
 
   // the first four bytes in the page stores # records in the page.
   // update this number.
-  setRecordCount(page, erid.sid + 1);
+  setRecordCount(page.data(), erid.sid + 1);
 
   // write the page to the disk
-  if ((rc = pf.write(erid.pid, page)) < 0) return rc;
+  page.markDirty();
+  if ((rc = page.release()) < 0) return rc;
     
   // we need to output the rid of the record slot
   rid = erid;
 
-  // advance the end record id by one to the next empty slot
-  ++erid;
+  // advance the end record id by one to the next empty slot.
+  // a slotted page is only known to be full when the next record
+  // does not fit into it.
+  if (slotted) {
+    erid.sid++;
+  } else {
+    next(erid);
+  }
+
+  return addToZones(&key, &rid, 1);
+}
+
+RC RecordFile::appendBatch(const int* keys, const string* values, int n, RecordId* rids)
+{
+  RC   rc;
+  int  pageSize = pf.getPageSize();
+  RecordId end = erid;   // the end record id as the pages are filled
+  char* page = NULL;     // the page being filled
+  int  count = 0;        // # pages filled so far
+  vector<char> buffer((size_t)BATCH_PAGES * pageSize);
+  PageId pids[BATCH_PAGES];
+  const void* pages[BATCH_PAGES];
+  vector<string> codes;
+
+  if (n <= 0) return 0;
+
+  // a DICTIONARY-encoded file stores the codes of the values
+  if (dict != NULL) {
+    codes.resize(n);
+    if ((rc = encode(values, n, &codes[0])) < 0) return rc;
+    values = &codes[0];
+  }
+
+  if (format == COLUMNAR) {
+    if ((rc = appendColumns(keys, values, n, rids)) < 0) return rc;
+    return addToZones(keys, rids, n);
+  }
+  __atomic_store_n(&lastPage, -1LL, __ATOMIC_RELAXED);
+
+  for (int i = 0; i < n; i++) {
+    // move to the next page when the record does not fit into this one,
+    // and write the pages once there is no room left for another
+    if (page != NULL && (slotted ? freeSpace(page) < recordSize(values[i])
+                                 : end.sid >= slotsPerPage)) {
+      end.pid++;
+      end.sid = 0;
+      page = NULL;
+      if (count == BATCH_PAGES) {
+        if ((rc = pf.writeBatch(pids, pages, count)) < 0) return rc;
+        erid = end;
+        count = 0;
+      }
+    }
+
+    // only the last page of the file can hold records already.
+    // it is left as it is if the record does not fit into it.
+    if (page == NULL && end.sid > 0) {
+      page = &buffer[(size_t)count * pageSize];
+      if ((rc = pf.read(end.pid, page)) < 0) return rc;
+      if (slotted && freeSpace(page) < recordSize(values[i])) {
+        end.pid++;
+        end.sid = 0;
+        page = NULL;
+      } else {
+        pids[count] = end.pid;
+        pages[count++] = page;
+      }
+    }
+
+    if (page == NULL) {
+      page = &buffer[(size_t)count * pageSize];
+      pids[count] = end.pid;
+      pages[count++] = page;
+      memset(page, 0, pageSize);
+      if (slotted) initPage(page, pageSize);
+    }
+
+    if (slotted) {
+      writeTuple(page, end.sid, keys[i], values[i]);
+    } else {
+      writeSlot(page, end.sid, keys[i], values[i]);
+    }
+    setRecordCount(page, end.sid + 1);
+    rids[i] = end;
+    end.sid++;
+  }
+
+  // write the rest of the pages. the end record id of a file with
+  // fixed-size slots moves to the next page when the last one is full.
+  if ((rc = pf.writeBatch(pids, pages, count)) < 0) return rc;
+  if (!slotted && end.sid >= slotsPerPage) {
+    end.pid++;
+    end.sid = 0;
+  }
+  erid = end;
+
+  return addToZones(keys, rids, n);
+}
+
+RC RecordFile::addToZones(const int* keys, const RecordId* rids, int n)
+{
+  RC   rc;
+  int  pageSize = zf.getPageSize();
+  int  perPage = pageSize / sizeof(KeyRange);
+  KeyRange empty = { INT_MAX, INT_MIN };
+  bool changed = false;
+  vector<char> page(pageSize);
+
+  if (!zoned || n <= 0) return 0;
+
+  for (int i = 0; i < n; i++) {
+    PageId pid = rids[i].pid;
+    if (pid >= (PageId)zones.size()) zones.resize(pid + 1, empty);
+    if (keys[i] < zones[pid].min) {
+      zones[pid].min = keys[i];
+      changed = true;
+    }
+    if (keys[i] > zones[pid].max) {
+      zones[pid].max = keys[i];
+      changed = true;
+    }
+  }
+  if (!changed) return 0;
+
+  // the records are appended in rid order, so the pages of the zone
+  // map that changed are the ones from the first to the last record
+  for (PageId z = rids[0].pid / perPage; z <= rids[n - 1].pid / perPage; z++) {
+    for (int i = 0; i < perPage; i++) {
+      PageId pid = z * perPage + i;
+      const KeyRange& range = (pid < (PageId)zones.size()) ? zones[pid] : empty;
+      memcpy(&page[i * sizeof(KeyRange)], &range, sizeof(range));
+    }
+    if ((rc = zf.write(z, &page[0])) < 0) return rc;
+  }
+
+  return 0;
+}
+
+RC RecordFile::remove(const RecordId& rid)
+{
+  RC   rc;
+  Slot slot;
+  char info[PageFile::USER_DATA_SIZE];
+  vector<char> page(pf.getPageSize());
+
+  // only a slotted page has a slot to leave behind as a tombstone
+  if (!slotted) return RC_INVALID_FILE_FORMAT;
+  if (rid.pid < 0 || rid.sid < 0 || rid >= erid) return RC_INVALID_RID;
+
+  // the page is changed in a copy, so that a file opened in 'r' mode
+  // fails to write it rather than to change its mapped pages
+  if ((rc = pf.read(rid.pid, &page[0])) < 0) return rc;
+  if (rid.sid >= getRecordCount(&page[0])) return RC_INVALID_RID;
+  if (tupleRemoved(&page[0], rid.sid)) return RC_NO_SUCH_RECORD;
+  memcpy(&slot, &page[sizeof(SlottedHeader) + rid.sid * sizeof(Slot)], sizeof(slot));
+
+  // the free-space map is created with the first record that is removed
+  if (!freeMapped) {
+    pf.getUserData(info);
+    int hasFreeMap = 1;
+    memcpy(info + 3 * sizeof(int), &hasFreeMap, sizeof(int));
+    if ((rc = pf.setUserData(info)) < 0) return rc;
+    if ((rc = ff.open(name + ".free", 'w', pf.isCompressed())) < 0) return rc;
+    freeMapped = true;
+  }
+
+  // the map is written first. a record that it counts but that is still
+  // in its page costs vacuum() some work, while a removed record that it
+  // missed would be left behind.
+  if ((rc = addToFreeMap(rid.pid, slot.length + sizeof(Slot))) < 0) return rc;
+
+  // the tuple stays where it is, unreachable, until the file is vacuumed
+  slot.length = 0;
+  memcpy(&page[sizeof(SlottedHeader) + rid.sid * sizeof(Slot)], &slot, sizeof(slot));
+  return pf.write(rid.pid, &page[0]);
+}
+
+int RecordFile::getRemovedBytes(PageId pid) const
+{
+  if (pid < 0 || pid >= (PageId)freed.size()) return 0;
+  return freed[pid];
+}
+
+RC RecordFile::addToFreeMap(PageId pid, int bytes)
+{
+  int  pageSize = ff.getPageSize();
+  int  perPage = pageSize / sizeof(int);
+  PageId z = pid / perPage;
+  vector<char> page(pageSize);
+
+  if (pid >= (PageId)freed.size()) freed.resize(pid + 1, 0);
+  freed[pid] += bytes;
+
+  for (int i = 0; i < perPage; i++) {
+    PageId p = z * perPage + i;
+    int n = (p < (PageId)freed.size()) ? freed[p] : 0;
+    memcpy(&page[i * sizeof(int)], &n, sizeof(int));
+  }
+  return ff.write(z, &page[0]);
+}
+
+bool RecordFile::skipPage(PageId pid, int low, int high) const
+{
+  // a page without an entry in the zone map may hold any key
+  if (pid >= (PageId)zones.size()) return false;
+  return zones[pid].max < low || zones[pid].min > high;
+}
+
+RC RecordFile::appendColumns(const int* keys, const string* values, int n, RecordId* rids)
+{
+  RC   rc;
+  int  pageSize = pf.getPageSize();
+  RecordId end = erid;   // the end record id as the pages are filled
+  PageId vend = vf.endPid();  // the next new value page
+  char* page = NULL;     // the key page being filled
+  char* vpage = NULL;    // the value page being filled
+  int  count = 0;        // # key pages filled so far
+  int  vcount = 0;       // # value pages filled so far
+  KeyPageHeader header;
+  vector<char> buffer((size_t)BATCH_PAGES * pageSize);
+  vector<char> vbuffer((size_t)BATCH_PAGES * pageSize);
+  PageId pids[BATCH_PAGES], vpids[BATCH_PAGES];
+  const void* pages[BATCH_PAGES];
+  const void* vpages[BATCH_PAGES];
+
+  if (n <= 0) return 0;
+
+  for (int i = 0; i < n; i++) {
+    // move to the next key page when this one is full. the values of
+    // its keys start on a new value page.
+    if (page != NULL && end.sid >= slotsPerPage) {
+      end.pid++;
+      end.sid = 0;
+      page = vpage = NULL;
+      if (count == BATCH_PAGES) {
+        if ((rc = vf.writeBatch(vpids, vpages, vcount)) < 0) return rc;
+        if ((rc = pf.writeBatch(pids, pages, count)) < 0) return rc;
+        erid = end;
+        count = vcount = 0;
+      }
+    }
+
+    if (page == NULL) {
+      page = &buffer[(size_t)count * pageSize];
+      pids[count] = end.pid;
+      pages[count++] = page;
+
+      // only the last key page of the file can hold keys already,
+      // and their last value page is the last one of the file
+      if (end.sid > 0) {
+        if ((rc = pf.read(end.pid, page)) < 0) return rc;
+        memcpy(&header, page, sizeof(header));
+        vpage = &vbuffer[(size_t)vcount * pageSize];
+        vpids[vcount] = header.firstValuePage + header.valuePages - 1;
+        vpages[vcount++] = vpage;
+        if ((rc = vf.read(vpids[vcount - 1], vpage)) < 0) return rc;
+      } else {
+        memset(page, 0, pageSize);
+        header.count = 0;
+        header.firstValuePage = vend;
+        header.valuePages = 0;
+        memcpy(page, &header, sizeof(header));
+      }
+    }
+
+    // move to a new value page when the value does not fit into this one
+    if (vpage == NULL || freeSpace(vpage) < valueSize(values[i])) {
+      if (vcount == BATCH_PAGES) {
+        if ((rc = vf.writeBatch(vpids, vpages, vcount)) < 0) return rc;
+        vcount = 0;
+      }
+      vpage = &vbuffer[(size_t)vcount * pageSize];
+      vpids[vcount] = vend++;
+      vpages[vcount++] = vpage;
+      memset(vpage, 0, pageSize);
+      initPage(vpage, pageSize);
+
+      memcpy(&header, page, sizeof(header));
+      setValueDir(page, pageSize, header.valuePages++, end.sid);
+      memcpy(page, &header, sizeof(header));
+    }
+
+    // store the value, and then the key
+    writeValue(vpage, values[i]);
+    memcpy(page + sizeof(KeyPageHeader) + end.sid * sizeof(int), &keys[i], sizeof(int));
+    setRecordCount(page, end.sid + 1);
+    rids[i] = end;
+    end.sid++;
+  }
+
+  // write the rest of the pages, the values first.
+  // the end record id moves to the next key page when the last one is full.
+  if ((rc = vf.writeBatch(vpids, vpages, vcount)) < 0) return rc;
+  if ((rc = pf.writeBatch(pids, pages, count)) < 0) return rc;
+  if (end.sid >= slotsPerPage) {
+    end.pid++;
+    end.sid = 0;
+  }
+  erid = end;
 
   return 0;
 }
 
+RC RecordFile::pinValue(const char* keyPage, int sid, PageHandle& vpage, PageId& vpid, int& n) const
+{
+  RC rc;
+  KeyPageHeader header;
+  int pageSize = pf.getPageSize();
+  int lo, hi, mid;
+
+  memcpy(&header, keyPage, sizeof(header));
+  if (sid < 0 || sid >= header.count) return RC_INVALID_RID;
+
+  // find the last value page of the key page whose first key is not after sid
+  lo = 0;
+  hi = header.valuePages - 1;
+  while (lo < hi) {
+    mid = (lo + hi + 1) / 2;
+    if (getValueDir(keyPage, pageSize, mid) <= sid) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  // keep the page if it is pinned already
+  if (!vpage.isPinned() || vpid != header.firstValuePage + lo) {
+    vpid = -1;
+    if ((rc = vf.pin(header.firstValuePage + lo, vpage)) < 0) return rc;
+    vpid = header.firstValuePage + lo;
+  }
+  n = sid - getValueDir(keyPage, pageSize, lo);
+  return 0;
+}
+
 const RecordId& RecordFile::endRid() const
 {
   return erid;
 }
 
+RecordId& RecordFile::next(RecordId& rid) const
+{
+  // if the end of a page is reached, move to the next page.
+  // the end record id of a file with slotted pages is right after
+  // the last record of the last page.
+  if (slotted) {
+    if (++rid.sid >= countRecords(rid.pid) && rid.pid != erid.pid) {
+      rid.pid++;
+      rid.sid = 0;
+    }
+  } else if (++rid.sid >= slotsPerPage) {
+    rid.pid++;
+    rid.sid = 0;
+  }
+
+  return rid;
+}
+
+int RecordFile::countRecords(PageId pid) const
+{
+  PageHandle page;
+
+  // the last page may still grow. the records of any other page
+  // are usually being read one after the other.
+  if (pid == erid.pid) return erid.sid;
+  long long last = __atomic_load_n(&lastPage, __ATOMIC_RELAXED);
+  if (last >= 0 && (PageId)(last >> 32) == pid) return (int)(last & 0xffffffff);
+
+  // a page that cannot be read has no records
+  if (pf.pin(pid, page) < 0) return 0;
+  return getRecordCount(page.data());
+}
+
+RC RecordFile::advise(PageFile::AccessPattern pattern)
+{
+  if (format == COLUMNAR) vf.advise(pattern);
+  return pf.advise(pattern);
+}
+
+IOStats RecordFile::getStats() const
+{
+  // the side files keep their counters after close() too
+  IOStats s = pf.getStats();
+  s += vf.getStats();
+  s += df.getStats();
+  s += zf.getStats();
+  s += ff.getStats();
+  return s;
+}
+
+RC RecordFile::prefetch(const RecordId* rids, int n) const
+{
+  vector<PageId> pids(n);
+
+  if (n <= 0) return 0;
+  for (int i = 0; i < n; i++) pids[i] = rids[i].pid;
+  return pf.readBatch(&pids[0], n, NULL, NULL);
+}
+
+RC RecordFile::vacuum(const string& filename, vector<vector<RecordId> >& moved)
+{
+  RC   rc;
+  RecordFile from, to;
+  ScanCursor scan;
+  string temp = filename + ".vacuum";
+  static const char* const sides[] = { ".val", ".dict", ".zone", ".free" };
+  vector<int> keys;
+  vector<string> values;
+  vector<RecordId> where, rids;
+  RecordId removed = { -1, -1 };
+
+  moved.clear();
+  if ((rc = from.open(filename, 'r')) < 0) return rc;
+  if (!from.hasRemoved()) return from.close();
+
+  // the live records go to a new file like the old one, which takes its
+  // place once it is complete
+  ::remove(temp.c_str());
+  if ((rc = to.open(temp, 'w', from.format, from.pf.isCompressed(), from.getEncoding(),
+                    from.pf.getPageSize())) < 0) {
+    from.close();
+    return rc;
+  }
+
+  // copy the records a batch at a time, in the order of the old file,
+  // and note where each one goes
+  scan.open(from);
+  for (;;) {
+    bool end = ((rc = scan.nextPage()) < 0);
+    if (end && rc != RC_END_OF_FILE) break;
+
+    if (!end) {
+      PageId pid = scan.rid(0).pid;
+      if (pid >= (PageId)moved.size()) moved.resize(pid + 1);
+      moved[pid].assign(scan.count(), removed);
+      for (int i = 0; i < scan.count(); i++) {
+        int length;
+        const char* value;
+        if (scan.isRemoved(i)) continue;
+        if ((value = scan.value(i, length)) == NULL) {
+          rc = RC_INVALID_FILE_FORMAT;
+          break;
+        }
+        keys.push_back(scan.key(i));
+        values.push_back(string(value, length));
+        where.push_back(scan.rid(i));
+      }
+      if (rc < 0) break;
+    }
+
+    if (!keys.empty() && (end || (int)keys.size() >= BATCH_PAGES * from.slotsPerPage)) {
+      rids.resize(keys.size());
+      if ((rc = to.appendBatch(&keys[0], &values[0], keys.size(), &rids[0])) < 0) break;
+      for (unsigned i = 0; i < where.size(); i++) {
+        moved[where[i].pid][where[i].sid] = rids[i];
+      }
+      keys.clear();
+      values.clear();
+      where.clear();
+    }
+    if (end) {
+      rc = 0;
+      break;
+    }
+  }
+  scan.close();
+  from.close();
+  if (to.close() < 0 && rc == 0) rc = RC_FILE_CLOSE_FAILED;
+  if (rc < 0) {
+    moved.clear();
+    ::remove(temp.c_str());
+    for (unsigned i = 0; i < sizeof(sides) / sizeof(sides[0]); i++) {
+      ::remove((temp + sides[i]).c_str());
+    }
+    return rc;
+  }
+
+  // move the new file over the old one first, so that the old file and
+  // its side files are left as they were if that fails. then the side
+  // files of the new file replace those of the old one, and a side file
+  // of the old file that the new one does not have goes away.
+  if (::rename(temp.c_str(), filename.c_str()) < 0) {
+    moved.clear();
+    ::remove(temp.c_str());
+    for (unsigned i = 0; i < sizeof(sides) / sizeof(sides[0]); i++) {
+      ::remove((temp + sides[i]).c_str());
+    }
+    return RC_FILE_WRITE_FAILED;
+  }
+  for (unsigned i = 0; i < sizeof(sides) / sizeof(sides[0]); i++) {
+    if (::rename((temp + sides[i]).c_str(), (filename + sides[i]).c_str()) == 0) continue;
+    if (errno == ENOENT) {
+      ::remove((filename + sides[i]).c_str());
+    } else {
+      rc = RC_FILE_WRITE_FAILED;
+    }
+  }
+  return rc;
+}
+
+RecordFile::ScanCursor::ScanCursor()
+{
+  rf = NULL;
+  pid = -1;
+  n = 0;
+  low = INT_MIN;
+  high = INT_MAX;
+  vpid = -1;
+}
+
+void RecordFile::ScanCursor::open(const RecordFile& file)
+{
+  close();
+  rf = &file;
+  pid = -1;
+  low = INT_MIN;
+  high = INT_MAX;
+}
+
+void RecordFile::ScanCursor::setKeyRange(int low, int high)
+{
+  this->low = low;
+  this->high = high;
+}
+
+void RecordFile::ScanCursor::close()
+{
+  page.release();
+  vpage.release();
+  vpid = -1;
+  n = 0;
+}
+
+RC RecordFile::ScanCursor::nextPage()
+{
+  RC rc;
+
+  // the value page stays pinned, since the values of the next key page
+  // of a COLUMNAR file start on the page after it
+  page.release();
+  n = 0;
+  if (rf == NULL) return RC_INVALID_CURSOR;
+
+  // pass over the pages that hold no key in the range without reading them
+  PageId to = pid + 1;
+  while (to <= rf->erid.pid && rf->skipPage(to, low, high)) to++;
+
+  // the end record id is on the page after the last one
+  // when the last page of a file with fixed-size slots is full
+  if (to > rf->erid.pid || (to == rf->erid.pid && rf->erid.sid == 0)) {
+    return RC_END_OF_FILE;
+  }
+
+  if ((rc = rf->pf.pin(to, page)) < 0) return rc;
+  pid = to;
+  n = getRecordCount(page.data());
+  return 0;
+}
+
+RC RecordFile::ScanCursor::moveTo(PageId to)
+{
+  RC rc;
+
+  if (rf == NULL) return RC_INVALID_CURSOR;
+  if (page.isPinned() && pid == to) return 0;
+  page.release();
+  n = 0;
+
+  if (to < 0 || to > rf->erid.pid || (to == rf->erid.pid && rf->erid.sid == 0)) {
+    return RC_INVALID_PID;
+  }
+  if ((rc = rf->pf.pin(to, page)) < 0) return rc;
+  pid = to;
+  n = getRecordCount(page.data());
+  return 0;
+}
+
+RecordId RecordFile::ScanCursor::rid(int i) const
+{
+  RecordId r;
+
+  r.pid = pid;
+  r.sid = i;
+  return r;
+}
+
+int RecordFile::ScanCursor::key(int i) const
+{
+  int key;
+  Slot slot;
+
+  if (rf->format == COLUMNAR) {
+    memcpy(&key, page.data() + sizeof(KeyPageHeader) + i * sizeof(int), sizeof(int));
+  } else if (!rf->slotted) {
+    memcpy(&key, slotPtr(page.data(), i), sizeof(int));
+  } else {
+    memcpy(&slot, page.data() + sizeof(SlottedHeader) + i * sizeof(Slot), sizeof(slot));
+    memcpy(&key, page.data() + slot.offset, sizeof(int));
+  }
+  return key;
+}
+
+const char* RecordFile::ScanCursor::value(int i, int& length) const
+{
+  const char* ptr = storedValue(i, length);
+
+  // the value of a code stays where it is while the file is open
+  if (ptr != NULL && rf->dict != NULL) {
+    const string* value = rf->decode(ptr, length);
+    if (value == NULL) {
+      length = 0;
+      return NULL;
+    }
+    ptr = value->data();
+    length = (int)value->size();
+  }
+  return ptr;
+}
+
+int RecordFile::ScanCursor::code(int i) const
+{
+  int length, code;
+  const char* ptr;
+
+  if (rf->dict == NULL) return -1;
+  ptr = storedValue(i, length);
+  if (ptr == NULL || length != sizeof(int)) return -1;
+  memcpy(&code, ptr, sizeof(int));
+  return code;
+}
+
+bool RecordFile::ScanCursor::isRemoved(int i) const
+{
+  return rf->slotted && tupleRemoved(page.data(), i);
+}
+
+const char* RecordFile::ScanCursor::storedValue(int i, int& length) const
+{
+  const char* ptr;
+  Slot slot;
+  int k;
+
+  if (rf->format == COLUMNAR) {
+    if (rf->pinValue(page.data(), i, vpage, vpid, k) < 0) {
+      length = 0;
+      return NULL;
+    }
+    ptr = valuePtr(vpage.data(), k, length);
+  } else if (!rf->slotted) {
+    ptr = slotPtr(page.data(), i) + sizeof(int);
+    length = strlen(ptr);
+  } else {
+    memcpy(&slot, page.data() + sizeof(SlottedHeader) + i * sizeof(Slot), sizeof(slot));
+    if (slot.length == 0) {
+      // the record has been removed
+      length = 0;
+      return NULL;
+    }
+    ptr = page.data() + slot.offset + sizeof(int);
+    length = slot.length - sizeof(int);
+  }
+  return ptr;
+}
+
 static int getRecordCount(const char* page)
 {
   int count;
@@ -238,6 +1237,75 @@ static void setRecordCount(char* page, int count)
   memcpy(page, &count, sizeof(int));
 }
 
+static void initPage(char* page, int pageSize)
+{
+  SlottedHeader header;
+
+  header.count = 0;
+  header.dataStart = pageSize;
+  memcpy(page, &header, sizeof(header));
+}
+
+static int freeSpace(const char* page)
+{
+  SlottedHeader header;
+
+  memcpy(&header, page, sizeof(header));
+  return header.dataStart - (int)(sizeof(header) + header.count * sizeof(Slot));
+}
+
+static int storedLength(const std::string& value)
+{
+  // a value is cut to MAX_VALUE_LENGTH - 1 characters, as it always was
+  int length = (int)value.size();
+  if (length >= RecordFile::MAX_VALUE_LENGTH) length = RecordFile::MAX_VALUE_LENGTH - 1;
+
+  return length;
+}
+
+static int recordSize(const std::string& value)
+{
+  return (int)(sizeof(int) + storedLength(value) + sizeof(Slot));
+}
+
+static void readTuple(const char* page, int n, int& key, std::string& value)
+{
+  Slot slot;
+
+  // find the tuple through its slot
+  memcpy(&slot, page + sizeof(SlottedHeader) + n * sizeof(Slot), sizeof(slot));
+
+  // read the key and the value
+  memcpy(&key, page + slot.offset, sizeof(int));
+  value.assign(page + slot.offset + sizeof(int), slot.length - sizeof(int));
+}
+
+static void writeTuple(char* page, int n, int key, const std::string& value)
+{
+  SlottedHeader header;
+  Slot slot;
+
+  // the tuple goes right below the tuples that are in the page already
+  memcpy(&header, page, sizeof(header));
+  slot.length = (unsigned short)(recordSize(value) - sizeof(Slot));
+  slot.offset = (unsigned short)(header.dataStart - slot.length);
+
+  memcpy(page + slot.offset, &key, sizeof(int));
+  memcpy(page + slot.offset + sizeof(int), value.data(), slot.length - sizeof(int));
+  memcpy(page + sizeof(header) + n * sizeof(Slot), &slot, sizeof(slot));
+
+  header.dataStart = slot.offset;
+  memcpy(page, &header, sizeof(header));
+}
+
+static bool tupleRemoved(const char* page, int n)
+{
+  Slot slot;
+
+  memcpy(&slot, page + sizeof(SlottedHeader) + n * sizeof(Slot), sizeof(slot));
+  return slot.length == 0;
+}
+
 static char* slotPtr(char* page, int n) 
 {
   // compute the location of the n'th slot in a page.
@@ -276,3 +1344,65 @@ static void writeSlot(char* page, int n, int key, const std::string& value)
     strcpy(ptr + sizeof(int), value.c_str());
   }
 }
+
+static int valueDirSize(int pageSize)
+{
+  // a value page holds at least this many values, even the longest ones
+  int values = (pageSize - sizeof(SlottedHeader)) /
+               (RecordFile::MAX_VALUE_LENGTH - 1 + sizeof(Slot));
+  int room = (pageSize - sizeof(KeyPageHeader)) / sizeof(int);
+
+  // the fewest entries such that the rest of the room is enough
+  // for keys whose values need no more value pages than that
+  return (room + values) / (values + 1);
+}
+
+static int keysPerPage(int pageSize)
+{
+  return (int)((pageSize - sizeof(KeyPageHeader)) / sizeof(int)) - valueDirSize(pageSize);
+}
+
+static int getValueDir(const char* page, int pageSize, int n)
+{
+  int slot;
+
+  memcpy(&slot, page + pageSize - (n + 1) * sizeof(int), sizeof(int));
+  return slot;
+}
+
+static void setValueDir(char* page, int pageSize, int n, int slot)
+{
+  memcpy(page + pageSize - (n + 1) * sizeof(int), &slot, sizeof(int));
+}
+
+static int valueSize(const std::string& value)
+{
+  return (int)(storedLength(value) + sizeof(Slot));
+}
+
+static const char* valuePtr(const char* page, int n, int& length)
+{
+  Slot slot;
+
+  memcpy(&slot, page + sizeof(SlottedHeader) + n * sizeof(Slot), sizeof(slot));
+  length = slot.length;
+  return page + slot.offset;
+}
+
+static void writeValue(char* page, const std::string& value)
+{
+  SlottedHeader header;
+  Slot slot;
+
+  // the value goes right below the values that are in the page already
+  memcpy(&header, page, sizeof(header));
+  slot.length = (unsigned short)storedLength(value);
+  slot.offset = (unsigned short)(header.dataStart - slot.length);
+
+  memcpy(page + slot.offset, value.data(), slot.length);
+  memcpy(page + sizeof(header) + header.count * sizeof(Slot), &slot, sizeof(slot));
+
+  header.count++;
+  header.dataStart = slot.offset;
+  memcpy(page, &header, sizeof(header));
+}
@@ -11,6 +11,7 @@
 #define RECORDFILE_H
 
 #include <string>
+#include <vector>
 #include "PageFile.h"
 
 /**
@@ -26,10 +27,6 @@ typedef struct {
 // helper functions for RecordId
 // 
 
-// RecordId iterators
-RecordId& operator++ (RecordId& rid);
-RecordId  operator++ (RecordId& rid, int);
-
 // RecordId comparators
 bool operator> (const RecordId& r1, const RecordId& r2);
 bool operator< (const RecordId& r1, const RecordId& r2);
@@ -39,7 +36,27 @@ bool operator== (const RecordId& r1, const RecordId& r2);
 bool operator!= (const RecordId& r1, const RecordId& r2);
 
 /**
- * read/write a record to a file
+ * read/write a record to a file.
+ * records are stored in slotted pages: a page starts with a directory
+ * of its records, and the records themselves are packed from the end
+ * of the page, each taking only as many bytes as its value needs.
+ * so the number of records in a page varies from page to page.
+ * files without a header page (see PageFile) keep the fixed-size
+ * record slots that every file used to have.
+ * a file may instead be created in the COLUMNAR format, which keeps the
+ * keys in dense arrays of their own, and the values in a second file
+ * named after it with ".val" appended. a scan that needs only the keys
+ * then reads a fraction of the bytes.
+ * the values of a file may also be dictionary-encoded: every distinct
+ * value is stored once, in a file named after it with ".dict" appended,
+ * and a record holds the integer code of its value in place of the value.
+ * a file created with a header page also keeps a zone map, named after
+ * it with ".zone" appended, with the smallest and the largest key of
+ * each page, so that a scan can skip the pages without the keys it wants.
+ * a record of a file with slotted pages can be removed. its slot stays
+ * as a tombstone, so that the other records keep their record ids, and
+ * the bytes it took are counted in a free-space map, named after the
+ * file with ".free" appended, until vacuum() rewrites the file.
  */
 class RecordFile {
  public:
@@ -47,9 +64,130 @@ class RecordFile {
   // maximum length of the value field
   static const int MAX_VALUE_LENGTH = 100;  
 
-  // number of record slots per page
-  static const int RECORDS_PER_PAGE = (PageFile::PAGE_SIZE - sizeof(int))/ (sizeof(int) + MAX_VALUE_LENGTH);  
-    // Note that we subtract sizeof(int) from PAGE_SIZE because the first
+  // the ways to store the records of a file
+  enum Format {
+    ROW,       // each record is kept whole in a page
+    COLUMNAR   // the keys and the values are kept apart
+  };
+
+  // the ways to store the values of a file
+  enum Encoding {
+    PLAIN,      // each record holds its value
+    DICTIONARY  // each record holds the code of its value in the dictionary
+  };
+
+  /**
+   * scans the records of a file one page at a time, or visits the pages
+   * of given records with moveTo().
+   * the current page stays pinned, and its records are read in
+   * place, without checking each record id or copying the page.
+   * the cursor must be closed before the file is.
+   */
+  class ScanCursor {
+   public:
+    ScanCursor();
+
+    /**
+     * start a scan before the first page of a file.
+     * @param rf[IN] the file to scan
+     */
+    void open(const RecordFile& rf);
+
+    /**
+     * unpin the page being scanned.
+     */
+    void close();
+
+    /**
+     * move to the next page of the file (the first page after open())
+     * that may hold a key in the range given to setKeyRange().
+     * @return error code. 0 if no error. RC_END_OF_FILE after the last page
+     */
+    RC nextPage();
+
+    /**
+     * let nextPage() skip the pages whose keys are all out of a range,
+     * as far as the zone map of the file tells. the records of the
+     * pages that are not skipped still have to be checked.
+     * @param low[IN] the smallest key wanted
+     * @param high[IN] the largest key wanted
+     */
+    void setKeyRange(int low, int high);
+
+    /**
+     * move to a page of the file, to read some of its records in place.
+     * the page stays pinned if the cursor is on it already.
+     * @param pid[IN] the page to move to
+     * @return error code. 0 if no error
+     */
+    RC moveTo(PageId pid);
+
+    /**
+     * @return # records in the current page
+     */
+    int count() const { return n; }
+
+    /**
+     * @param i[IN] the index of a record in the current page
+     * @return the record id of the record
+     */
+    RecordId rid(int i) const;
+
+    /**
+     * @param i[IN] the index of a record in the current page
+     * @return the key of the record
+     */
+    int key(int i) const;
+
+    /**
+     * get the value of a record. it is not null-terminated, and stays
+     * valid until the cursor moves to another page.
+     * @param i[IN] the index of a record in the current page
+     * @param length[OUT] the length of the value
+     * @return the characters of the value (NULL if they cannot be read)
+     */
+    const char* value(int i, int& length) const;
+
+    /**
+     * get the dictionary code of the value of a record, which is the
+     * same for two records if and only if their values are the same.
+     * @param i[IN] the index of a record in the current page
+     * @return the code of the value (-1 if the file is not DICTIONARY-encoded)
+     */
+    int code(int i) const;
+
+    /**
+     * @param i[IN] the index of a record in the current page
+     * @return true if the record has been removed. its key and value
+     *         must not be used then
+     */
+    bool isRemoved(int i) const;
+
+   private:
+    const RecordFile* rf;  // the file being scanned
+    PageId     pid;        // the current page
+    PageHandle page;       // the current page, pinned
+    int        n;          // # records in the current page
+    int        low;        // the smallest key wanted by nextPage()
+    int        high;       // the largest key wanted by nextPage()
+    mutable PageId     vpid;   // the value page of a COLUMNAR file last used
+    mutable PageHandle vpage;  // the value page last used, pinned
+
+    /**
+     * get the value of a record as it is stored in the file
+     * (the code of the value in a DICTIONARY-encoded file).
+     */
+    const char* storedValue(int i, int& length) const;
+  };
+
+  /**
+   * compute the number of record slots in a page with fixed-size slots.
+   * @param pageSize[IN] the size of the page
+   * @return the number of records that fit in the page
+   */
+  static int recordsPerPage(int pageSize)
+    { return (pageSize - sizeof(int)) / (sizeof(int) + MAX_VALUE_LENGTH); }
+    // Note that we subtract sizeof(int) from pageSize because the first
     // four bytes in the page is used to store # records in the page.
 
   RecordFile();
@@ -60,9 +198,37 @@ class RecordFile {
    * when opened in 'w' mode, if the file does not exist, it is created.
    * @param filename[IN] the name of the file to open
    * @param mode[IN] 'r' for read, 'w' for write
+   * @param format[IN] the format of the file if it is created. an existing
+   *                   file keeps the format it was created with
+   * @param compress[IN] true to compress the pages of the file if it is
+   *                     created (see PageFile)
+   * @param encoding[IN] the encoding of the values if the file is created
+   * @param newPageSize[IN] the page size of the file and its side files
+   *                        if they are created, or 0 for the default one
    * @return error code. 0 if no error
    */
-  RC open(const std::string& filename, char mode);
+  RC open(const std::string& filename, char mode, Format format = ROW,
+          bool compress = false, Encoding encoding = PLAIN, int newPageSize = 0);
+
+  /**
+   * @return the format of the file
+   */
+  Format getFormat() const { return format; }
+
+  /**
+   * @return the encoding of the values of the file
+   */
+  Encoding getEncoding() const { return (dict != NULL) ? DICTIONARY : PLAIN; }
+
+  /**
+   * get the code of a value in the dictionary of the file.
+   * see ScanCursor::code().
+   * @param value[IN] the value to look up
+   * @param code[OUT] the code of the value
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if no record
+   *         of the file has the value, or the file is not DICTIONARY-encoded
+   */
+  RC findCode(const std::string& value, int& code) const;
 
   /**
    * close the file.
@@ -90,15 +256,180 @@ class RecordFile {
    */
   RC append(int key, const std::string& value, RecordId& rid);
 
+  /**
+   * append a batch of records at the end of the file, like append().
+   * the records are put into pages in memory, and each page is
+   * written once, with a batch of disk writes.
+   * @param keys[IN] the record keys
+   * @param values[IN] the record values
+   * @param n[IN] the # of records
+   * @param rids[OUT] the location of each stored record
+   * @return error code. 0 if no error
+   */
+  RC appendBatch(const int* keys, const std::string* values, int n, RecordId* rids);
+
+  /**
+   * remove a record from a file with slotted pages. its slot is kept as
+   * a tombstone, so that the record ids of the other records stay the
+   * same, and the bytes it takes are added to the free-space map.
+   * @param rid[IN] the id of the record to remove
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if the record
+   *         is removed already
+   */
+  RC remove(const RecordId& rid);
+
+  /**
+   * @return true if any record of the file has been removed since it
+   *         was last vacuumed
+   */
+  bool hasRemoved() const { return !freed.empty(); }
+
+  /**
+   * get the free-space map entry of a page.
+   * @param pid[IN] the page
+   * @return # bytes that the removed records of the page take
+   */
+  int getRemovedBytes(PageId pid) const;
+
+  /**
+   * rewrite a file with the records that have not been removed, packed
+   * densely into pages in the same order. the new file has the format,
+   * the encoding, the compression and the page size of the old one, and
+   * replaces it. the file must not be open.
+   * @param filename[IN] the name of the file
+   * @param moved[OUT] for each page of the old file, the new record id of
+   *                   each of its records ({-1, -1} if it was removed).
+   *                   empty if no record had been removed
+   * @return error code. 0 if no error
+   */
+  static RC vacuum(const std::string& filename,
+                   std::vector<std::vector<RecordId> >& moved);
+
   /**
    * note the +1 part. The rid of the last record is endRid()-1.
    * @return (last record id + 1) of the RecordFile
    */
   const RecordId& endRid() const;
 
+  /**
+   * move a record id to the next record of the file.
+   * the number of records in a page differs from page to page, so
+   * this may have to look at the page of rid.
+   * @param rid[IN/OUT] the record id to advance
+   * @return rid
+   */
+  RecordId& next(RecordId& rid) const;
+
+  /**
+   * tell the operating system how the records will be accessed.
+   * @param pattern[IN] SEQUENTIAL for a table scan, RANDOM for index lookups
+   * @return error code. 0 if no error
+   */
+  RC advise(PageFile::AccessPattern pattern);
+
+  /**
+   * read the pages of a set of records into memory with one batch of
+   * disk reads, ahead of reading the records one by one with read().
+   * @param rids[IN] the records that are about to be read
+   * @param n[IN] the # of records in rids
+   * @return error code. 0 if no error
+   */
+  RC prefetch(const RecordId* rids, int n) const;
+
+  /**
+   * @return the I/O of the file since it was opened
+   */
+  IOStats getStats() const;
+
  private:
-  PageFile pf;     // the PageFile used to store the records
+  struct Dictionary;  // the values of a DICTIONARY-encoded file, see RecordFile.cc
+
+  // the smallest and the largest key of a page in the zone map
+  // (min > max if the page has no records)
+  struct KeyRange {
+    int min;
+    int max;
+  };
+
+  PageFile pf;     // the PageFile used to store the records (or the keys)
+  PageFile vf;     // the values of a COLUMNAR file
+  PageFile df;     // the dictionary of a DICTIONARY-encoded file
+  Dictionary* dict;  // the dictionary in memory (NULL if the values are PLAIN)
+  PageFile zf;     // the zone map of the file
+  bool zoned;      // true if the file has a zone map
+  std::vector<KeyRange> zones;  // the zone map in memory, one entry per page
+  PageFile ff;     // the free-space map of the file
+  bool freeMapped; // true if the file has a free-space map
+  std::vector<int> freed;  // the free-space map in memory (empty if nothing is removed)
+  std::string name;  // the name of the file, for the free-space map that remove() creates
   RecordId erid;   // the last record id of the file + 1
+  Format format;    // the format of the file
+  bool slotted;     // false if the file has fixed-size record slots or is COLUMNAR
+  int slotsPerPage; // # record slots in a page with fixed-size slots (# keys if COLUMNAR)
+  mutable long long lastPage;  // (pid << 32 | # records) of the page read last
+
+  /**
+   * @return the # of records in a page of a file with slotted pages
+   */
+  int countRecords(PageId pid) const;
+
+  /**
+   * replace values by their codes, adding the values that are not in the
+   * dictionary yet to it, and write the dictionary pages that changed.
+   * @param values[IN] the values
+   * @param n[IN] the # of values
+   * @param codes[OUT] the code of each value, as the value to store
+   * @return error code. 0 if no error
+   */
+  RC encode(const std::string* values, int n, std::string* codes);
+
+  /**
+   * get the value that a code stored in a record stands for.
+   * @param code[IN] the code as it is stored
+   * @param length[IN] the length of the stored code
+   * @return the value (NULL if the code is not in the dictionary)
+   */
+  const std::string* decode(const char* code, int length) const;
+
+  /**
+   * add appended records to the zone map, and write the pages of the
+   * zone map that changed.
+   * @param keys[IN] the keys of the records
+   * @param rids[IN] the location of the records
+   * @param n[IN] the # of records
+   * @return error code. 0 if no error
+   */
+  RC addToZones(const int* keys, const RecordId* rids, int n);
+
+  /**
+   * add the bytes of a removed record to the free-space map, and write
+   * the page of the map that changed.
+   * @param pid[IN] the page of the record
+   * @param bytes[IN] # bytes that the record takes
+   * @return error code. 0 if no error
+   */
+  RC addToFreeMap(PageId pid, int bytes);
+
+  /**
+   * @return true if no key of page pid is in [low, high]
+   */
+  bool skipPage(PageId pid, int low, int high) const;
+
+  /**
+   * append records to a COLUMNAR file. see appendBatch().
+   */
+  RC appendColumns(const int* keys, const std::string* values, int n, RecordId* rids);
+
+  /**
+   * pin the page of a COLUMNAR file that holds a value.
+   * @param keyPage[IN] the key page of the record
+   * @param sid[IN] the slot of the record in the key page
+   * @param vpage[IN/OUT] the pinned value page. kept if it holds the value
+   * @param vpid[IN/OUT] the id of the page in vpage (-1 if none)
+   * @param n[OUT] the slot of the value in the value page
+   * @return error code. 0 if no error
+   */
+  RC pinValue(const char* keyPage, int sid, PageHandle& vpage, PageId& vpid, int& n) const;
 };
 
 #endif // RECORDFILE_H
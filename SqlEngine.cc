@@ -27,6 +27,110 @@ extern FILE* sqlin;
 int sqlparse(void);
 BTreeIndex indexTree;
 
+IOStats SqlEngine::tableStats;
+IOStats SqlEngine::indexStats;
+
+// Compares a value of the given length with a C string, like strcmp()
+static int compareValue(const char* value, int length, const char* s)
+{
+    int n = strlen(s);
+    int diff = memcmp(value, s, length < n ? length : n);
+    if (diff != 0) {
+        return diff;
+    }
+    return length - n;
+}
+
+// Checks the conditions on a tuple, and prints the tuple for the selected
+// attribute if it meets them. An (in)equality with a value is checked on
+// the code of the value where byCode says so, with the code of the value
+// of the condition in codes (-1 if no tuple has it).
+// Returns true if the tuple meets the conditions.
+static bool printIfMatches(int attr, const vector<SelCond>& cond, int key, const char* value,
+                           int length, int code, const vector<bool>& byCode,
+                           const vector<int>& codes)
+{
+    for (unsigned i = 0; i < cond.size(); i++) {
+        // compute the difference between the tuple value and the condition value
+        int diff = 0;
+        switch (cond[i].attr) {
+            case 1:
+                // 1 indicates we're selecting on a key
+                diff = key - atoi(cond[i].value);
+                break;
+            case 2:
+                if (byCode[i]) {
+                    diff = (codes[i] >= 0 && code == codes[i]) ? 0 : 1;
+                } else {
+                    diff = compareValue(value, length, cond[i].value);
+                }
+                break;
+        }
+
+        // skip the tuple if any condition is not met
+        switch (cond[i].comp) {
+            case SelCond::EQ:
+                if (diff != 0) return false;
+                break;
+            case SelCond::NE:
+                if (diff == 0) return false;
+                break;
+            case SelCond::GT:
+                if (diff <= 0) return false;
+                break;
+            case SelCond::LT:
+                if (diff >= 0) return false;
+                break;
+            case SelCond::GE:
+                if (diff < 0) return false;
+                break;
+            case SelCond::LE:
+                if (diff > 0) return false;
+                break;
+        }
+    }
+
+    // print the tuple
+    switch (attr) {
+        case 1:  // SELECT key
+            fprintf(stdout, "%d\n", key);
+            break;
+        case 2:  // SELECT value
+            fprintf(stdout, "%.*s\n", length, value);
+            break;
+        case 3:  // SELECT *
+            fprintf(stdout, "%d '%.*s'\n", key, length, value);
+            break;
+    }
+    return true;
+}
+
+// Narrows [low, high] down to the keys that the conditions on keys allow.
+// low > high if no key can meet them.
+static void keyBounds(const vector<SelCond>& cond, long long& low, long long& high)
+{
+    low = INT_MIN;
+    high = INT_MAX;
+    vector<SelCond>::const_iterator it;
+    for (it = cond.begin(); it != cond.end(); it++) {
+        if (it->attr != 1) {
+            continue;
+        }
+        long long compKey = atoi(it->value);
+        if ((it->comp == SelCond::EQ || it->comp == SelCond::GE) && compKey > low) {
+            low = compKey;
+        }
+        if (it->comp == SelCond::GT && compKey + 1 > low) {
+            low = compKey + 1;
+        }
+        if ((it->comp == SelCond::EQ || it->comp == SelCond::LE) && compKey < high) {
+            high = compKey;
+        }
+        if (it->comp == SelCond::LT && compKey - 1 < high) {
+            high = compKey - 1;
+        }
+    }
+}
 
 RC SqlEngine::run(FILE* commandline)
 {
@@ -40,30 +144,47 @@ RC SqlEngine::run(FILE* commandline)
     return 0;
 }
 
-// attr is a number that notes what 
+// Runs the query, and keeps the I/O counters of its files around
+// after they have been closed, so that they can be reported
 RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
+{
+    RecordFile rf;   // RecordFile containing the table
+    BTreeIndex indexTree; // Index file data for B+ tree
+
+    RC rc = select(attr, table, cond, rf, indexTree);
+    tableStats = rf.getStats();
+    indexStats = indexTree.getStats();
+    return rc;
+}
+
+// attr is a number that notes what 
+RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond,
+                     RecordFile& rf, BTreeIndex& indexTree)
 {
     // Error: attr is outside of its allowable range
     if (attr < 1 || attr > 4) {
         fprintf(stderr, "Error: SqlEngine::load() received an invalid 'attr' argument");
     }
 
-    RecordFile rf;   // RecordFile containing the table
-    RecordId   rid;  // record cursor for table scanning
-    BTreeIndex indexTree; // Index file data for B+ tree
+    RecordFile::ScanCursor scan;  // record cursor for reading tuples in place
     int countResult = 0; // Number of matching result tuples
 
-    // Open the table file
+    // Open the index file, if the table was loaded with one.
+    // A table without an index is scanned instead, and the tuples
+    // of an index-organized table are all in its index.
+    // fprintf(stderr, "DEBUG: Table name passed-in: %s\n", table.c_str());
     RC rc;
-    if ((rc = rf.open(table + ".tbl", 'r')) < 0) {
-        fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
+    bool hasIndex = (indexTree.open(table + ".idx", 'r') == 0);
+    if (hasIndex && indexTree.holdsTuples()) {
+        rc = selectTuples(attr, cond, indexTree);
+        indexTree.close();
         return rc;
     }
 
-    // Open the index file
-    // fprintf(stderr, "DEBUG: Table name passed-in: %s\n", table.c_str());
-    if ((rc = indexTree.open(table + ".idx", 'r')) < 0) {
-        fprintf(stderr, "Error: IndexFile %s.idx does not exist\n", table.c_str());
+    // Open the table file
+    if ((rc = rf.open(table + ".tbl", 'r')) < 0) {
+        fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
+        indexTree.close();
         return rc;
     }
 
@@ -75,11 +196,42 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
     bool useIndex = false; 
     std::vector<SelCond>::const_iterator it;
     for (it = cond.begin(); it != cond.end(); it++) {
-        if (it->attr == 1 && it->comp != SelCond::NE) {
+        if (hasIndex && it->attr == 1 && it->comp != SelCond::NE) {
             useIndex = true;
         }
     }
 
+    // The values are only read from the table if they are printed or compared.
+    // Otherwise the keys are all that is needed, and the index has them.
+    // If the values are dictionary-encoded, (in)equality with a value is
+    // checked on its code, which is looked up here once. No tuple has the
+    // code of a value that is not in the dictionary.
+    bool needValue = (attr == 2 || attr == 3);
+    bool needCode = false;
+    vector<bool> byCode(cond.size(), false);
+    vector<int>  codes(cond.size(), -1);
+    for (unsigned i = 0; i < cond.size(); i++) {
+        if (cond[i].attr != 2) {
+            continue;
+        }
+        if (rf.getEncoding() == RecordFile::DICTIONARY &&
+            (cond[i].comp == SelCond::EQ || cond[i].comp == SelCond::NE)) {
+            if (rf.findCode(cond[i].value, codes[i]) < 0) {
+                codes[i] = -1;
+            }
+            byCode[i] = true;
+            needCode = true;
+        } else {
+            needValue = true;
+        }
+    }
+    scan.open(rf);
+
+    // Removed tuples keep their slots, and their index entries, until the
+    // table is vacuumed. The index path then has to look at each tuple.
+    bool removed = rf.hasRemoved();
+    bool needTable = needValue || needCode || removed;
+
     // To use the index, we find the range of keys over which to check tuples. 
     // For example: key >= 5 AND key < 11 implies: 5 <= key < 11
     // This lets us handle arbitrarily many conditions on keys, 
@@ -89,6 +241,9 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
     // If there are no WHERE conditions, we can just iterate
     // through the table and get projected attributes
     if (useIndex && cond.size() != 0) {
+        // Tuples are fetched one rid at a time in key order
+        rf.advise(PageFile::RANDOM);
+
         // Keys are of at most long int size, i.e., +/- 2 billion or so
         // See: https://piazza.com/class/ieyj7ojonx58s?cid=328
         // See: http://www.cplusplus.com/reference/climits/
@@ -108,13 +263,13 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
             int compKey = atoi(it->value);
             if (it->attr == 1) {
                 // Update rangeBottom if we find a 'key < A' or 'key <= A', 
-                // where A < rangeBottom. 
-                if (it->comp == SelCond::LE || it->comp == SelCond::LT) {
+                // where A < rangeBottom. 'key = A' bounds both ends.
+                if (it->comp == SelCond::LE || it->comp == SelCond::LT || it->comp == SelCond::EQ) {
                     if (compKey < rangeTop) {
                         rangeTop = compKey;
                     }
                 }
-                else if (it->comp == SelCond::GE || it->comp == SelCond::GT) {
+                if (it->comp == SelCond::GE || it->comp == SelCond::GT || it->comp == SelCond::EQ) {
                     if (compKey > rangeBottom) {
                         rangeBottom = compKey;
                     }
@@ -122,11 +277,18 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
             }
         }
 
-        // Make sure that rangeBottom and rangeTop don't have an impossible range
+        // Make sure that rangeBottom and rangeTop don't have an impossible range.
+        // No tuple can meet the conditions then.
         if (rangeTop < rangeBottom) {
             // fprintf(stderr, "This is an impossible range.\n");
             // fprintf(stderr, "rangeTop and rangeBottom: %d %d\n", rangeTop, rangeBottom);    
-            return RC_INVALID_ATTRIBUTE;
+            if (attr == 4) {
+                fprintf(stdout, "0\n");
+            }
+            scan.close();
+            rf.close();
+            indexTree.close();
+            return 0;
         }
 
         // DEBUG - checking what our range is 
@@ -140,9 +302,6 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
         IndexCursor cursor;
         indexTree.locate(start_key, cursor);
 
-        IndexCursor cursor2;
-        indexTree.locate(4657, cursor2);
-
         // DEBUG
         // fprintf(stderr, "DEBUG: key: %d pid:%d eid:%d \n", start_key, cursor.pid, cursor.eid);
 
@@ -151,111 +310,87 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
         RecordId rid;
         rid.pid = -1; 
         rid.sid = -1;
-        string value = "";
-        int diff = 0;
+        const char* value = NULL;
+        int length = 0;
+        int code = -1;
+
+        // The (key, rid) pairs of the rest of the current leaf.
+        // The pages of their tuples are read with one batch,
+        // rather than one at a time as the tuples are visited.
+        // A key may have any number of entries, so the loop stops
+        // at the first key past the range, and a batch ends there.
+        vector<int>      leafKeys;
+        vector<RecordId> leafRids;
+        unsigned         next = 0;
 
         // Major for-loop to print out all the keys
         while (1) {
 
-            // Reads the current cursor into key and rid, goes to the next one
-            indexTree.readForward(cursor, key, rid);
-
-            // DEBUG
-            // Look for the key that's missing!
-            if (key == 4657) {
-                fprintf(stderr, "DEBUG: What we really want: pid: %d eid:%d\n", cursor2.pid, cursor2.eid);                            
+            // Reads the rest of the leaf once its entries are used up
+            if (next == leafRids.size()) {
+                PageId leaf = cursor.pid;
+                leafKeys.clear();
+                leafRids.clear();
+                next = 0;
+                while (cursor.pid == leaf && indexTree.readForward(cursor, key, rid) == 0) {
+                    leafKeys.push_back(key);
+                    leafRids.push_back(rid);
+                    if (key > rangeTop || key > largest_key) {
+                        break;
+                    }
+                }
+                if (leafRids.empty()) {
+                    break;
+                }
+                // The entry past the range, if any, has no tuple to read
+                unsigned wanted = leafRids.size();
+                if (leafKeys.back() > rangeTop || leafKeys.back() > largest_key) {
+                    wanted--;
+                }
+                if (needTable && wanted > 0) {
+                    rf.prefetch(&leafRids[0], wanted);
+                }
             }
 
-            // DEBUG
-            // fprintf(stderr, "DEBUG: looking for: pid:%d sid:%d key:%d\n", rid.pid, rid.sid, key);
-
-            if ((rc = rf.read(rid, key, value)) < 0) {
-                fprintf(stderr, "Error: while reading a tuple from table %s: %d\n", table.c_str(), rc);
-                goto exit_index_select;
-            }
+            // Takes the next key and rid of the leaf
+            key = leafKeys[next];
+            rid = leafRids[next];
+            next++;
 
             // Make sure if it's a key that goes too far
             if (key > rangeTop || key > largest_key) {
                     break;
             }
 
-            // Keep track if equal case is handled
-            bool eq_check = false;
-            int value_check = 0;
-
-            // Check the conditions on the tuple
-            // Run through the list of conditions for each tuple
-            for (unsigned i = 0; i < cond.size(); i++) {
-                eq_check = false;
-                value_check = 0;
-
-                // compute the difference between the tuple value and the condition value
-                switch (cond[i].attr) {
-                    case 1:
-                        // 1 indicates we're selecting on a key
-                        eq_check = true;
-                        value_check = atoi(cond[i].value);
-                        diff = key - value_check;
-                        break;
-                    case 2:
-                        diff = strcmp(value.c_str(), cond[i].value);
-                        break;
-                }
+            // DEBUG
+            // fprintf(stderr, "DEBUG: looking for: pid:%d sid:%d key:%d\n", rid.pid, rid.sid, key);
 
-                // skip the tuple if any condition is not met
-                switch (cond[i].comp) {
-                    case SelCond::EQ:
-                        if (diff != 0) goto equal_escape;
-                        break;
-                    case SelCond::NE:
-                        if (diff == 0) goto read_forward;
-                        break;
-                    case SelCond::GT:
-                        if (diff <= 0) goto read_forward;
-                        break;
-                    case SelCond::LT:
-                        if (diff >= 0) goto read_forward;
-                        break;
-                    case SelCond::GE:
-                        if (diff < 0) goto read_forward;
-                        break;
-                    case SelCond::LE:
-                        if (diff > 0) goto read_forward;
-                        break;
+            // Read the value (or its code) in place, if it is needed
+            if (needTable) {
+                if ((rc = scan.moveTo(rid.pid)) == 0 && rid.sid >= scan.count()) {
+                    rc = RC_INVALID_RID;
+                }
+                if (rc < 0) {
+                    fprintf(stderr, "Error: while reading a tuple from table %s: %d\n", table.c_str(), rc);
+                    goto exit_index_select;
+                }
+                if (removed && scan.isRemoved(rid.sid)) {
+                    // Skip the removed tuple
+                    continue;
+                }
+                if (needValue) {
+                    value = scan.value(rid.sid, length);
+                }
+                if (needCode) {
+                    code = scan.code(rid.sid);
                 }
             }
 
-            // the condition is met for the tuple.
-            // increase matching tuple counter
-            countResult++;
 
-            // print the tuple
-            switch (attr) {
-                case 1:  // SELECT key
-                    fprintf(stdout, "%d\n", key);
-                    break;
-                case 2:  // SELECT value
-                    fprintf(stdout, "%s\n", value.c_str());
-                    break;
-                case 3:  // SELECT *
-                    fprintf(stdout, "%d '%s'\n", key, value.c_str());
-                    break;
+            // Print the tuple if it meets the conditions
+            if (printIfMatches(attr, cond, key, value, length, code, byCode, codes)) {
+                countResult++;
             }
-
-            equal_escape:
-                // if you found an equal key to the one looked for, exit!
-                if (eq_check == true && key == value_check) {
-                    break;
-                } else {
-                    goto read_forward;
-                }
-
-            // move to the next tuple
-            read_forward:
-                // At the end of the for loop, if this was the last key, then break out of loop
-                if (key == rangeTop || key == largest_key) {
-                    break;
-                }
         }
 
         // SELECT COUNT(*) ?
@@ -266,84 +401,57 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
 
         // close the table file and return
         exit_index_select:
+            scan.close();
             rf.close();
+            indexTree.close();
             return rc;
     }
 
     // Scan through the table if we should do that instead
     else {
         int    key;
-        string value;
+        const char* value = NULL;
+        int    length = 0;
+        int    code = -1;
         int    count;
-        int    diff;
 
-        // scan the table file from the beginning
-        rid.pid = rid.sid = 0;
-        count = 0;
-        while (rid < rf.endRid()) {
-            // read the tuple
-            if ((rc = rf.read(rid, key, value)) < 0) {
-                fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-                goto exit_select;
-            }
+        // The conditions on keys bound the keys of the tuples to print.
+        // The pages whose keys are all out of the bounds are skipped.
+        long long low, high;
+        keyBounds(cond, low, high);
+        if (low > high) {
+            // No key can meet the conditions
+            low = INT_MAX;
+            high = INT_MIN;
+        }
+        scan.setKeyRange((int)low, (int)high);
 
-            // Check the conditions on the tuple
-            // Run through the list of conditions for each tuple
-            for (unsigned i = 0; i < cond.size(); i++) {
-                // compute the difference between the tuple value and the condition value
-                switch (cond[i].attr) {
-                    case 1:
-                        // 1 indicates we're selecting on a key
-                        diff = key - atoi(cond[i].value);
-                        break;
-                    case 2:
-                        diff = strcmp(value.c_str(), cond[i].value);
-                        break;
+        // scan the table file from the beginning, a page at a time
+        rf.advise(PageFile::SEQUENTIAL);
+        count = 0;
+        while ((rc = scan.nextPage()) == 0) {
+            for (int slot = 0; slot < scan.count(); slot++) {
+                // read the tuple in place, unless it has been removed
+                if (removed && scan.isRemoved(slot)) {
+                    continue;
                 }
-
-                // skip the tuple if any condition is not met
-                switch (cond[i].comp) {
-                    case SelCond::EQ:
-                        if (diff != 0) goto next_tuple;
-                        break;
-                    case SelCond::NE:
-                        if (diff == 0) goto next_tuple;
-                        break;
-                    case SelCond::GT:
-                        if (diff <= 0) goto next_tuple;
-                        break;
-                    case SelCond::LT:
-                        if (diff >= 0) goto next_tuple;
-                        break;
-                    case SelCond::GE:
-                        if (diff < 0) goto next_tuple;
-                        break;
-                    case SelCond::LE:
-                        if (diff > 0) goto next_tuple;
-                        break;
+                key = scan.key(slot);
+                if (needValue) {
+                    value = scan.value(slot, length);
+                }
+                if (needCode) {
+                    code = scan.code(slot);
                 }
-            }
-
-            // the condition is met for the tuple.
-            // increase matching tuple counter
-            count++;
 
-            // print the tuple
-            switch (attr) {
-                case 1:  // SELECT key
-                    fprintf(stdout, "%d\n", key);
-                    break;
-                case 2:  // SELECT value
-                    fprintf(stdout, "%s\n", value.c_str());
-                    break;
-                case 3:  // SELECT *
-                    fprintf(stdout, "%d '%s'\n", key, value.c_str());
-                    break;
+                // Print the tuple if it meets the conditions
+                if (printIfMatches(attr, cond, key, value, length, code, byCode, codes)) {
+                    count++;
+                }
             }
-
-            // move to the next tuple
-            next_tuple:
-                    ++rid;
+        }
+        if (rc != RC_END_OF_FILE) {
+            fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+            goto exit_select;
         }
 
         // print matching tuple count if "select count(*)"
@@ -354,7 +462,9 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
 
         // close the table file and return
         exit_select:
+            scan.close();
             rf.close();
+            indexTree.close();
             return rc;
     }
     
@@ -373,7 +483,69 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
 
 
 
-RC SqlEngine::load(const string& table, const string& loadfile, bool index)
+// The tuples of an index-organized table are kept in key order in the
+// leaves of its index. The keys that the conditions allow are next to
+// each other there, so one walk along the leaves reads them all,
+// a leaf at a time, with the tuples read in place.
+RC SqlEngine::selectTuples(int attr, const vector<SelCond>& cond, BTreeIndex& indexTree)
+{
+    IndexCursor cursor;
+    BTLeafNode  leaf;
+    int    key;
+    const char* value = NULL;
+    int    length = 0;
+    int    count = 0;
+    RC     rc = 0;
+
+    // No value is compared by its code
+    vector<bool> byCode(cond.size(), false);
+    vector<int>  codes(cond.size(), -1);
+
+    long long low, high;
+    keyBounds(cond, low, high);
+    if (low <= high) {
+        indexTree.locate((int)low, cursor);
+    } else {
+        // No key can meet the conditions
+        cursor.pid = 0;
+        cursor.eid = 0;
+    }
+
+    while ((rc = indexTree.readLeaf(cursor, leaf)) == 0) {
+        for (; cursor.eid < leaf.getKeyCount(); cursor.eid++) {
+            // read the tuple in place
+            if ((rc = leaf.readTuple(cursor.eid, key, value, length)) < 0) {
+                goto exit_select;
+            }
+            if (key > high) {
+                goto exit_select;
+            }
+
+            // Print the tuple if it meets the conditions
+            if (printIfMatches(attr, cond, key, value, length, -1, byCode, codes)) {
+                count++;
+            }
+        }
+        cursor.pid = leaf.getNextNodePtr();
+        cursor.eid = 0;
+    }
+
+    exit_select:
+        if (rc != 0 && rc != RC_END_OF_TREE) {
+            fprintf(stderr, "Error: while reading a tuple from the index: %d\n", rc);
+            return rc;
+        }
+
+    // print matching tuple count if "select count(*)"
+    if (attr == 4) {
+        fprintf(stdout, "%d\n", count);
+    }
+    return 0;
+}
+
+RC SqlEngine::load(const string& table, const string& loadfile, bool index,
+                   RecordFile::Format format, bool compress, RecordFile::Encoding encoding,
+                   bool organized)
 {
     // Use I/O libraries to open() loadfile and get a resource handle for it.
     // Open RecordFile "table".tbl if it already exists, or create it if not.
@@ -388,8 +560,20 @@ RC SqlEngine::load(const string& table, const string& loadfile, bool index)
     RC retRecCode = 0;
     RC retIndexCode = 0;
 
+    // An index-organized table is loaded into its index alone,
+    // and has no table file to append tuples to
+    if (organized) {
+        return loadTuples(table, loadfile, compress, encoding);
+    }
+    if (indexFile.open(table + ".idx", 'r') == 0 && indexFile.holdsTuples()) {
+        fprintf(stderr, "Error: table %s is index-organized\n", table.c_str());
+        indexFile.close();
+        return RC_INVALID_FILE_FORMAT;
+    }
+    indexFile.close();
+
     // Make sure to create recordFile
-    if ((retRecCode = recFile.open(table + ".tbl", 'w')) < 0) {
+    if ((retRecCode = recFile.open(table + ".tbl", 'w', format, compress, encoding)) < 0) {
         fprintf(stderr, "Could not open/create file %s.tbl for writing\n", table.c_str());
         return retRecCode;
     }
@@ -405,7 +589,6 @@ RC SqlEngine::load(const string& table, const string& loadfile, bool index)
 
     // CRYSTAL
     // If index is true, make a BTreeIndex in addition to the RecordFile
-    // I was going to try and integrate both methods, but that would add extra logic in the while() statement
     if (index == true) {
         // DEBUG
         // fprintf(stderr, "DEBUG: Desire to make index is TRUE!\n");
@@ -414,64 +597,181 @@ RC SqlEngine::load(const string& table, const string& loadfile, bool index)
             fprintf(stderr, "Could not open/create file %s.idx for writing\n", table.c_str());
             return retIndexCode;
         }
+    }
 
-        if (load.is_open()) {
-            // fprintf(stderr, "DEBUG: Loadfile stream is open!\n");
-            int key = -1;
-            string value = "";
-            RecordId rid;
-            rid.pid = -1; // PageID
-            rid.sid = -1; // SlotID
-
-            // Load a line into 'line'
-            while(getline(load, line)) {
-                // Parse 'line', load it into the RecordFile, add to BTreeIndex
-                parseLoadLine(line, key, value);
-                // fprintf(stderr, "DEBUG: Key: %d \n Value: %s\n\n", key, value.c_str());
-                recFile.append(key, value, rid);
-                // fprintf(stderr, "DEBUG: rid.PID: %d\n rid.SID: %d\n", rid.pid, rid.sid);
-                indexFile.insert(key, rid);
+    if (load.is_open()) {
+        vector<int> keys;
+        vector<string> values;
+        int key = -1;
+        string value = "";
+
+        // Load a line into 'line'
+        while (getline(load, line)) {
+            // Parse 'line' and hold on to the tuple until a batch is full
+            parseLoadLine(line, key, value);
+            // fprintf(stderr, "DEBUG: Key: %d \n Value: %s\n\n", key, value.c_str());
+            keys.push_back(key);
+            values.push_back(value);
+            if (keys.size() == LOAD_BATCH_SIZE) {
+                if ((retRecCode = appendRows(recFile, index ? &indexFile : NULL, keys, values)) < 0) {
+                    break;
+                }
             }
         }
-        else {
-            fprintf(stderr, "Unable to open file %s for reading\n", loadfile.c_str());
-            return RC_FILE_OPEN_FAILED;
+        if (retRecCode == 0) {
+            retRecCode = appendRows(recFile, index ? &indexFile : NULL, keys, values);
+        }
+        if (retRecCode < 0) {
+            fprintf(stderr, "Could not append to file %s.tbl or its index\n", table.c_str());
         }
+    }
+    else {
+        fprintf(stderr, "Unable to open file %s for reading\n", loadfile.c_str());
+        retRecCode = RC_FILE_OPEN_FAILED;
+    }
 
+    if (index == true) {
         indexFile.close();
     }
-    // TODO: We actually always need to load into a RecordFile
-    // It's only optional on whether or not we create a BTreeIndex
-    else {
-        // DEBUG:
-        // fprintf(stderr, "DEBUG: Desire to make index is FALSE!\n");
-        if (load.is_open()) {
-            int key = -1;
-            string value = "";
-            RecordId rid;
-            rid.pid = -1; // PageID
-            rid.sid = -1; // SlotID
-
-            // Load a line into 'line'
-            while(getline(load, line)) {
-                // Parse 'line' and load it into the RecordFile
-                parseLoadLine(line, key, value);
-                // fprintf(stderr, "DEBUG: Key: %d \n Value: %s\n\n", key, value.c_str());
-                recFile.append(key, value, rid);
-                // fprintf(stderr, "DEBUG: rid.PID: %d\n rid.SID: %d\n", rid.pid, rid.sid);
+    load.close();
+    recFile.close();
+    return retRecCode;
+}
+
+// Inserts the tuples of a load file into the leaves of the index of an
+// index-organized table, one at a time, as an index is loaded
+RC SqlEngine::loadTuples(const string& table, const string& loadfile, bool compress,
+                         RecordFile::Encoding encoding)
+{
+    RecordFile recFile;
+    BTreeIndex indexFile;
+    RC rc = 0;
+
+    if (compress || encoding != RecordFile::PLAIN) {
+        fprintf(stderr, "Error: an index-organized table cannot be compressed or dictionary-encoded\n");
+        return RC_INVALID_ATTRIBUTE;
+    }
+
+    // A table that has a table file keeps its tuples there
+    if (recFile.open(table + ".tbl", 'r') == 0) {
+        recFile.close();
+        fprintf(stderr, "Error: table %s is not index-organized\n", table.c_str());
+        return RC_INVALID_FILE_FORMAT;
+    }
+    if ((rc = indexFile.open(table + ".idx", 'w', true)) < 0) {
+        fprintf(stderr, "Could not open/create file %s.idx for writing\n", table.c_str());
+        return rc;
+    }
+    if (!indexFile.holdsTuples()) {
+        fprintf(stderr, "Error: table %s is not index-organized\n", table.c_str());
+        indexFile.close();
+        return RC_INVALID_FILE_FORMAT;
+    }
+
+    string line;
+    ifstream load;
+    load.open(loadfile.c_str());
+    if (load.is_open()) {
+        int key = -1;
+        string value = "";
+        while (getline(load, line)) {
+            parseLoadLine(line, key, value);
+            if ((rc = indexFile.insert(key, value)) < 0) {
+                fprintf(stderr, "Could not insert into file %s.idx\n", table.c_str());
+                break;
             }
         }
-        else {
-            fprintf(stderr, "Unable to open file %s for reading\n", loadfile.c_str());
-            return RC_FILE_OPEN_FAILED;
-        }
+    }
+    else {
+        fprintf(stderr, "Unable to open file %s for reading\n", loadfile.c_str());
+        rc = RC_FILE_OPEN_FAILED;
     }
 
     load.close();
-    recFile.close();
+    indexFile.close();
+    return rc;
+}
+
+// Appends a batch of tuples to the RecordFile, so that each of its pages
+// is written once instead of once per tuple, and then adds them to the
+// index (if any) now that their rids are known. Empties the batch.
+RC SqlEngine::appendRows(RecordFile& rf, BTreeIndex* index, vector<int>& keys, vector<string>& values)
+{
+    RC rc;
+    vector<RecordId> rids(keys.size());
+
+    if (keys.empty()) {
+        return 0;
+    }
+
+    if ((rc = rf.appendBatch(&keys[0], &values[0], keys.size(), &rids[0])) < 0) {
+        return rc;
+    }
+    if (index != NULL) {
+        for (size_t i = 0; i < keys.size(); i++) {
+            if ((rc = index->insert(keys[i], rids[i])) < 0) {
+                return rc;
+            }
+        }
+    }
+
+    keys.clear();
+    values.clear();
     return 0;
 }
 
+// Gives the RecordId that RecordFile::vacuum() moved a tuple to,
+// or false if the tuple had been removed
+static bool movedRid(RecordId& rid, void* arg)
+{
+    const vector<vector<RecordId> >& moved = *(const vector<vector<RecordId> >*) arg;
+
+    if (rid.pid < 0 || rid.pid >= (int) moved.size() ||
+        rid.sid < 0 || rid.sid >= (int) moved[rid.pid].size()) {
+        return false;
+    }
+    rid = moved[rid.pid][rid.sid];
+    return rid.pid >= 0;
+}
+
+RC SqlEngine::vacuum(const string& table)
+{
+    BTreeIndex indexFile;
+    vector<vector<RecordId> > moved;
+    RC rc;
+
+    // The tuples of an index-organized table are never removed,
+    // and there is no table file to rewrite
+    bool hasIndex = (indexFile.open(table + ".idx", 'r') == 0);
+    if (hasIndex && indexFile.holdsTuples()) {
+        indexFile.close();
+        return 0;
+    }
+    if (hasIndex) {
+        indexFile.close();
+    }
+
+    if ((rc = RecordFile::vacuum(table + ".tbl", moved)) < 0) {
+        fprintf(stderr, "Error: could not vacuum table %s: %d\n", table.c_str(), rc);
+        return rc;
+    }
+
+    // Nothing moved if no tuple had been removed. Otherwise the index
+    // still points to where the tuples were, and the removed ones
+    // are dropped from it.
+    if (!hasIndex || moved.empty()) {
+        return 0;
+    }
+    if ((rc = indexFile.open(table + ".idx", 'w')) == 0) {
+        rc = indexFile.updateRids(movedRid, &moved);
+        indexFile.close();
+    }
+    if (rc < 0) {
+        fprintf(stderr, "Error: could not update index %s.idx: %d\n", table.c_str(), rc);
+    }
+    return rc;
+}
+
 // Takes a raw input line from the loadfile,
 // and populates its outputs with the key/value pair.
 RC SqlEngine::parseLoadLine(const string& line, int& key, string& value)
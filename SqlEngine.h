@@ -13,6 +13,9 @@
 #include <vector>
 #include "Bruinbase.h"
 #include "RecordFile.h"
+#include "IOStats.h"
+
+class BTreeIndex;
 
 /**
  * data structure to represent a condition in the WHERE clause
@@ -50,14 +53,43 @@ class SqlEngine {
    */
   static RC select(int attr, const std::string& table, const std::vector<SelCond>& conds);
 
+  /**
+   * @return the I/O on the table file during the last select()
+   */
+  static const IOStats& getTableStats() { return tableStats; }
+
+  /**
+   * @return the I/O on the index file during the last select()
+   */
+  static const IOStats& getIndexStats() { return indexStats; }
+
   /**
    * load a table from a load file.
    * @param table[IN] the table name in the LOAD command
    * @param loadfile[IN] the file name of the load file
    * @param index[IN] true if "WITH INDEX" option was specified
+   * @param format[IN] the format of the table if it is created
+   *                   (COLUMNAR if "WITH FORMAT COLUMNAR" was specified)
+   * @param compress[IN] true if "WITH COMPRESSION" was specified. the pages
+   *                     of the table are compressed if it is created
+   * @param encoding[IN] the encoding of the values if the table is created
+   *                     (DICTIONARY if "WITH DICTIONARY" was specified)
+   * @param organized[IN] true if "WITH FORMAT INDEXED" was specified. the
+   *                      tuples of the table are then kept in the leaves of
+   *                      its index, and it has no table file
    * @return error code. 0 if no error
    */
-  static RC load(const std::string& table, const std::string& loadfile, bool index);
+  static RC load(const std::string& table, const std::string& loadfile, bool index,
+                 RecordFile::Format format = RecordFile::ROW, bool compress = false,
+                 RecordFile::Encoding encoding = RecordFile::PLAIN, bool organized = false);
+
+  /**
+   * rewrite the pages of a table densely without its removed tuples,
+   * and move the RecordIds of its index along.
+   * @param table[IN] the table name in the VACUUM command
+   * @return error code. 0 if no error
+   */
+  static RC vacuum(const std::string& table);
 
   /**
    * parse a line from the load file into the (key, value) pair.
@@ -67,6 +99,43 @@ class SqlEngine {
    * @return error code. 0 if no error
    */
   static RC parseLoadLine(const std::string& line, int& key, std::string& value);
+
+ private:
+  // # tuples that load() appends to the table at a time
+  static const unsigned LOAD_BATCH_SIZE = 1024;
+
+  static IOStats tableStats;  // the table I/O of the last select()
+  static IOStats indexStats;  // the index I/O of the last select()
+
+  /**
+   * executes a SELECT statement on the given table and index files.
+   * both files are closed when it returns.
+   */
+  static RC select(int attr, const std::string& table, const std::vector<SelCond>& conds,
+                   RecordFile& rf, BTreeIndex& indexTree);
+
+  /**
+   * executes a SELECT statement on an index-organized table, whose
+   * index is open. see select().
+   */
+  static RC selectTuples(int attr, const std::vector<SelCond>& conds, BTreeIndex& indexTree);
+
+  /**
+   * load an index-organized table from a load file. see load().
+   */
+  static RC loadTuples(const std::string& table, const std::string& loadfile, bool compress,
+                       RecordFile::Encoding encoding);
+
+  /**
+   * appends a batch of tuples to a table, and adds them to its index.
+   * @param rf[IN] the table
+   * @param index[IN] the index of the table (NULL if none)
+   * @param keys[IN/OUT] the keys of the tuples. emptied on success
+   * @param values[IN/OUT] the values of the tuples. emptied on success
+   * @return error code. 0 if no error
+   */
+  static RC appendRows(RecordFile& rf, BTreeIndex* index,
+                       std::vector<int>& keys, std::vector<std::string>& values);
 };
 
 #endif /* SQLENGINE_H */
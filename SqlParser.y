@@ -13,6 +13,23 @@ int  sqllex(void);
 void sqlerror(const char *str) { fprintf(stderr, "Error: %s\n", str); }
 extern "C" { int  sqlwrap() { return 1; } }
 
+// the options of a LOAD command, or-ed together by load_options
+static const int LOAD_INDEX = 1;      // WITH INDEX
+static const int LOAD_COLUMNAR = 2;   // WITH FORMAT COLUMNAR
+static const int LOAD_COMPRESS = 4;   // WITH COMPRESSION
+static const int LOAD_DICTIONARY = 8; // WITH DICTIONARY
+static const int LOAD_INDEXED = 16;   // WITH FORMAT INDEXED
+static const int LOAD_BAD_FORMAT = 32; // WITH FORMAT of an unknown format
+
+static void runLoad(const char* table, const char* loadfile, int options)
+{
+  SqlEngine::load(table, loadfile, (options & LOAD_INDEX) != 0,
+                  (options & LOAD_COLUMNAR) ? RecordFile::COLUMNAR : RecordFile::ROW,
+                  (options & LOAD_COMPRESS) != 0,
+                  (options & LOAD_DICTIONARY) ? RecordFile::DICTIONARY : RecordFile::PLAIN,
+                  (options & LOAD_INDEXED) != 0);
+}
+
 static void runSelect(int attr, const char* table, const std::vector<SelCond>& conds)
 {
   struct tms tmsbuf;
@@ -26,6 +43,8 @@ static void runSelect(int attr, const char* table, const std::vector<SelCond>& c
   epagecnt = PageFile::getPageReadCount();
 
   fprintf(stderr, "  -- %.3f seconds to run the select command. Read %d pages\n", ((float)(etime - btime))/sysconf(_SC_CLK_TCK), epagecnt - bpagecnt);
+  SqlEngine::getTableStats().print(stderr, (std::string(table) + ".tbl").c_str());
+  SqlEngine::getIndexStats().print(stderr, (std::string(table) + ".idx").c_str());
 }
 
 %}
@@ -37,12 +56,12 @@ static void runSelect(int attr, const char* table, const std::vector<SelCond>& c
   std::vector<SelCond>* conds;
 }
 
-%token SELECT FROM WHERE LOAD WITH INDEX QUIT COUNT AND OR 
+%token SELECT FROM WHERE LOAD WITH INDEX FORMAT COMPRESSION DICTIONARY VACUUM QUIT COUNT AND OR 
 %token COMMA STAR LF
 %token <string> INTEGER STRING ID
 %token EQUAL NEQUAL LESS LESSEQUAL GREATER GREATEREQUAL 
 
-%type <integer> attributes attribute comparator
+%type <integer> attributes attribute comparator format load_options
 %type <string> table value
 %type <cond> condition
 %type <conds> conditions
@@ -56,6 +75,7 @@ commands:
 command:
         load_command { fprintf(stdout, "Bruinbase> "); }
 	| select_command { fprintf(stdout, "Bruinbase> "); }
+	| vacuum_command { fprintf(stdout, "Bruinbase> "); }
 	| quit_command
 	| error LF { fprintf(stdout, "Bruinbase> "); }
 	| LF { fprintf(stdout, "Bruinbase> "); }
@@ -66,15 +86,36 @@ quit_command:
 	;
 
 load_command:
-	LOAD table FROM STRING LF { 
-	  SqlEngine::load(std::string($2), std::string($4), false); 
+	LOAD table FROM STRING load_options LF { 
+	  // the command is not run if it has an error
+	  if (($5 & LOAD_BAD_FORMAT) == 0) runLoad($2, $4, $5);
 	  free($2);
 	  free($4);
 	}
-	| LOAD table FROM STRING WITH INDEX LF { 
-	  SqlEngine::load(std::string($2), std::string($4), true); 
+	;
+
+load_options:
+	load_options WITH INDEX { $$ = $1 | LOAD_INDEX; }
+	| load_options WITH FORMAT format { $$ = ($1 & ~(LOAD_COLUMNAR | LOAD_INDEXED)) | $4; }
+	| load_options WITH COMPRESSION { $$ = $1 | LOAD_COMPRESS; }
+	| load_options WITH DICTIONARY { $$ = $1 | LOAD_DICTIONARY; }
+	| { $$ = 0; }
+	;
+
+format:
+	ID { 
+		if (strcasecmp($1, "row") == 0) $$ = 0;
+		else if (strcasecmp($1, "columnar") == 0) $$ = LOAD_COLUMNAR;
+		else if (strcasecmp($1, "indexed") == 0) $$ = LOAD_INDEXED;
+		else { sqlerror("wrong table format. neither row, columnar or indexed"); $$ = LOAD_BAD_FORMAT; }
+		free($1);
+	}
+	;
+
+vacuum_command:
+	VACUUM table LF {
+	  SqlEngine::vacuum($2);
 	  free($2);
-	  free($4);
 	}
 	;
 
@@ -9,10 +9,64 @@
  
 #include "Bruinbase.h"
 #include "SqlEngine.h"
+#include "PageFile.h"
+#include "BTreeIndex.h"
 #include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
 
-int main()
+static void usage(const char* prog)
 {
+  fprintf(stderr, "usage: %s [-c cache_pages | -m cache_megabytes] [-s] [-n] [-p page_size] [-f fill_factor]\n", prog);
+  fprintf(stderr, "  -s  write pages through to the disk instead of caching them\n");
+  fprintf(stderr, "  -n  read tables and indexes through the cache instead of mmap\n");
+  fprintf(stderr, "  -p  page size of new tables and indexes (1024 to 16384 bytes)\n");
+  fprintf(stderr, "  -f  percent of an index node kept by a split when keys are appended (50 to 100)\n");
+}
+
+int main(int argc, char* argv[])
+{
+  int opt;
+
+  // configure the page cache shared by all tables and indexes
+  while ((opt = getopt(argc, argv, "c:m:snp:f:")) != -1) {
+    switch (opt) {
+    case 'c':
+      if (PageFile::getBufferPool().setCapacity(atoi(optarg)) < 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'm':
+      if (PageFile::getBufferPool().setCapacityMB(atoi(optarg)) < 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 's':
+      PageFile::getBufferPool().setWriteBack(false);
+      break;
+    case 'n':
+      PageFile::setMmapReads(false);
+      break;
+    case 'p':
+      if (PageFile::setDefaultPageSize(atoi(optarg)) < 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'f':
+      if (BTreeIndex::setFillFactor(atoi(optarg)) < 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
   // run the SQL engine taking user commands from standard input (console).
   SqlEngine::run(stdin);
 
@@ -9,6 +9,41 @@
 #include "RecordFile.h"
 #include "PageFile.h"
 #include "BTreeNode.h"
+#include "KeySearch.h"
+
+// read the eid'th entry of a node from its page: the keys follow the
+// key count and the first PageId, and the PageIds follow the keys
+void readNonLeafEntry(const char* buffer, int eid, int& key, PageId& pid) {
+    int count;
+    int offset = sizeof(int) + sizeof(PageId);
+    memcpy(&count, buffer, sizeof(int));
+    memcpy(&key, &buffer[offset + eid * sizeof(int)], sizeof(int));
+    memcpy(&pid, &buffer[offset + count * sizeof(int) + eid * sizeof(PageId)], sizeof(PageId));
+}
+
+// the same for a leaf, where the key, the pid and the sid of the
+// entries each have an array of their own, with each one kept as its
+// difference from a base in the header, in 1, 2 or 4 bytes
+void readLeafEntry(const char* buffer, int eid, int& key, RecordId& rid) {
+    int count;
+    int base[3];
+    unsigned char width[3];
+    int values[3];
+    int offset = sizeof(int) + sizeof(PageId);
+    memcpy(&count, buffer, sizeof(int));
+    memcpy(base, &buffer[offset], sizeof(base));
+    memcpy(width, &buffer[offset + sizeof(base)], sizeof(width));
+    offset += sizeof(base) + sizeof(int);
+    for (int field = 0; field < 3; field++) {
+        unsigned int delta = 0;
+        memcpy(&delta, &buffer[offset + eid * width[field]], width[field]);
+        values[field] = base[field] + delta;
+        offset += count * width[field];
+    }
+    key = values[0];
+    rid.pid = values[1];
+    rid.sid = values[2];
+}
 
 // print the current keys in a node - in order
 void printNode(BTNonLeafNode* node, PageFile* pagefile) {
@@ -32,14 +67,12 @@ void printNode(BTNonLeafNode* node, PageFile* pagefile) {
     // printf("first page id: %d\n", first_pageid);
 
     nonLeafEntry inserted; 
-    int offset = sizeof(int) + sizeof(PageId);
 
     while(x < node->getKeyCount()) {
-        memcpy(&inserted, &buffer[offset], sizeof(nonLeafEntry));
+        readNonLeafEntry(buffer, x, inserted.key, inserted.pid);
         // DEBUG
         // printf("key: %d\n", inserted.key);
         // printf("pid: %d\n", inserted.pid);
-        offset = offset + sizeof(nonLeafEntry);
         x++;
     }
 }
@@ -66,19 +99,285 @@ void printLeafNode(BTLeafNode* node, PageFile* pagefile) {
     // printf("next page id: %d\n", next_pageid);
 
     LeafEntry inserted; 
-    int offset = sizeof(int) + sizeof(PageId);
 
     while(x < node->getKeyCount()) {
-        memcpy(&inserted, &buffer[offset], sizeof(LeafEntry));
+        readLeafEntry(buffer, x, inserted.key, inserted.rid);
         // DEBUG
         // printf("key: %d\n", inserted.key);
         // printf("pid: %d\n", inserted.rid.pid);
         // printf("sid: %d\n", inserted.rid.sid);
-        offset = offset + sizeof(LeafEntry);
         x++;
     }
 }
 
+// Every kernel the CPU can run should find the same position as
+// a plain linear count, for keys in, between and around the node's keys
+int keySearchTest() {
+    int keys[200];
+    for (int i = 0; i < 200; i++) {
+        keys[i] = i * 3 - 100;
+    }
+
+    KeySearch::Kernel best = KeySearch::getKernel();
+    KeySearch::Kernel kernels[] = { KeySearch::SCALAR, KeySearch::SSE2, KeySearch::AVX2 };
+    int rc = 0;
+    for (int k = 0; k < 3 && rc == 0; k++) {
+        if (!KeySearch::setKernel(kernels[k])) continue;
+
+        // Every count of keys, so the blocks have every length
+        for (int n = 0; n <= 200 && rc == 0; n++) {
+            for (int key = -105; key <= 3 * n - 95; key++) {
+                int less = 0;
+                while (less < n && keys[less] < key) less++;
+                int lessOrEqual = less;
+                while (lessOrEqual < n && keys[lessOrEqual] <= key) lessOrEqual++;
+
+                if (KeySearch::countLess((char*) keys, n, key) != less ||
+                    KeySearch::countLessOrEqual((char*) keys, n, key) != lessOrEqual) {
+                    rc = -1;
+                    break;
+                }
+            }
+        }
+        if (KeySearch::countLessOrEqual((char*) keys, 200, 2147483647) != 200 ||
+            KeySearch::countLess((char*) keys, 200, -2147483647 - 1) != 0) {
+            rc = -1;
+        }
+
+        // The differences of a packed leaf, across the top bit of their width
+        unsigned char bytes[250];
+        unsigned short shorts[600];
+        for (int i = 0; i < 250; i++) {
+            bytes[i] = i + 3;
+        }
+        for (int i = 0; i < 600; i++) {
+            shorts[i] = i * 100 + 7;
+        }
+        for (int n = 0; n <= 250 && rc == 0; n += 7) {
+            for (unsigned int delta = 0; delta <= 255; delta++) {
+                int less = 0;
+                while (less < n && bytes[less] < delta) less++;
+                if (KeySearch::countLessDelta((char*) bytes, 1, n, delta) != less) {
+                    rc = -1;
+                    break;
+                }
+            }
+        }
+        for (int n = 0; n <= 600 && rc == 0; n += 13) {
+            for (unsigned int delta = 0; delta <= 65535; delta += 37) {
+                int less = 0;
+                while (less < n && shorts[less] < delta) less++;
+                if (KeySearch::countLessDelta((char*) shorts, 2, n, delta) != less) {
+                    rc = -1;
+                    break;
+                }
+            }
+        }
+    }
+    KeySearch::setKernel(best);
+    assert(rc == 0);
+    return rc;
+}
+
+// Clustered keys and RecordIds pack into a few bytes an entry, so a leaf
+// takes more of them than the 12 bytes an entry would leave room for.
+// A key or a RecordId far from the others packs the node anew.
+int packedLeafTest() {
+    BTLeafNode leaf(1024);
+    RecordId rid;
+    int key, eid;
+    int rc;
+
+    // 160 entries would not fit in a 1024-byte page at 12 bytes each
+    for (int i = 0; i < 160; i++) {
+        rid.pid = 1000 + i / 40;
+        rid.sid = i % 40;
+        rc = leaf.insert(5000 + 2 * i, rid);
+        if (rc < 0) {
+            assert(0);
+            return rc;
+        }
+    }
+    if (leaf.getKeyCount() != 160) {
+        assert(0);
+        return -1;
+    }
+
+    for (int i = 0; i < 160; i++) {
+        rc = leaf.locate(5000 + 2 * i, eid);
+        if (rc < 0 || eid != i) {
+            assert(0);
+            return -1;
+        }
+        rc = leaf.readEntry(eid, key, rid);
+        if (rc < 0 || key != 5000 + 2 * i || rid.pid != 1000 + i / 40 || rid.sid != i % 40) {
+            assert(0);
+            return -1;
+        }
+        rc = leaf.locate(5001 + 2 * i, eid);
+        if (rc != RC_NO_SUCH_RECORD || eid != i + 1) {
+            assert(0);
+            return -1;
+        }
+    }
+
+    // A key and a RecordId far off widen the fields of every entry,
+    // so they no longer fit, and the node is left as it was
+    rid.pid = 2000000;
+    rid.sid = 70000;
+    rc = leaf.insert(-2000000000, rid);
+    if (rc != RC_NODE_FULL || leaf.getKeyCount() != 160) {
+        assert(0);
+        return -1;
+    }
+    rc = leaf.readEntry(0, key, rid);
+    if (rc < 0 || key != 5000 || rid.pid != 1000 || rid.sid != 0) {
+        assert(0);
+        return -1;
+    }
+
+    // Either half fits however it packs, so the split takes it
+    BTLeafNode sibling(1024);
+    int siblingKey;
+    rid.pid = 2000000;
+    rid.sid = 70000;
+    rc = leaf.insertAndSplit(5101, rid, sibling, siblingKey);
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+    if (leaf.getKeyCount() != 80 || sibling.getKeyCount() != 81 || siblingKey != 5158) {
+        assert(0);
+        return -1;
+    }
+    rc = leaf.readEntry(51, key, rid);
+    if (rc < 0 || key != 5101 || rid.pid != 2000000 || rid.sid != 70000) {
+        assert(0);
+        return -1;
+    }
+    rc = leaf.readEntry(52, key, rid);
+    if (rc < 0 || key != 5102 || rid.pid != 1001 || rid.sid != 11) {
+        assert(0);
+        return -1;
+    }
+    rc = sibling.locate(5318, eid);
+    if (rc < 0 || eid != 80) {
+        assert(0);
+        return -1;
+    }
+    rc = sibling.readEntry(eid, key, rid);
+    if (rc < 0 || key != 5318 || rid.pid != 1003 || rid.sid != 39) {
+        assert(0);
+        return -1;
+    }
+    return 0;
+}
+
+// The entries of a key stay in one leaf when it is split, and a lookup
+// follows the child in front of a key equal to the one it looks for,
+// where the entries of the key may start.
+int duplicateKeyNodeTest() {
+    BTLeafNode leaf(1024);
+    RecordId rid;
+    int key, eid;
+    int rc;
+
+    // Each key has 7 entries, until the leaf is full
+    int n = 0;
+    rid.sid = 0;
+    while (true) {
+        rid.pid = n;
+        if (leaf.insert(n / 7, rid) != 0) {
+            break;
+        }
+        n++;
+    }
+    if (leaf.getKeyCount() != n) {
+        assert(0);
+        return -1;
+    }
+    rc = leaf.locate(3, eid);
+    if (rc < 0 || eid != 21) {
+        assert(0);
+        return -1;
+    }
+
+    BTLeafNode sibling(1024);
+    int siblingKey;
+    rid.pid = n;
+    rc = leaf.insertAndSplit(n / 7, rid, sibling, siblingKey);
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+    if (leaf.getKeyCount() + sibling.getKeyCount() != n + 1 ||
+        leaf.getKeyCount() != siblingKey * 7) {
+        assert(0);
+        return -1;
+    }
+    rc = leaf.readEntry(leaf.getKeyCount() - 1, key, rid);
+    if (rc < 0 || key != siblingKey - 1) {
+        assert(0);
+        return -1;
+    }
+    rc = sibling.readEntry(0, key, rid);
+    if (rc < 0 || key != siblingKey || rid.pid != siblingKey * 7) {
+        assert(0);
+        return -1;
+    }
+
+    // The entries of a key give way to one that stands for all of them
+    RecordId overflow;
+    overflow.pid = 99;
+    overflow.sid = -1;
+    rc = leaf.replaceEntries(7, 7, overflow);
+    if (rc < 0 || leaf.getKeyCount() != siblingKey * 7 - 6) {
+        assert(0);
+        return -1;
+    }
+    rc = leaf.readEntry(7, key, rid);
+    if (rc < 0 || key != 1 || rid.pid != 99 || rid.sid != -1) {
+        assert(0);
+        return -1;
+    }
+    rc = leaf.readEntry(8, key, rid);
+    if (rc < 0 || key != 2 || rid.pid != 14 || rid.sid != 0) {
+        assert(0);
+        return -1;
+    }
+    rc = leaf.replaceEntries(leaf.getKeyCount() - 1, 2, overflow);
+    if (rc != RC_NO_SUCH_RECORD) {
+        assert(0);
+        return -1;
+    }
+
+    // Children 10, 20 and 30, split by the keys 5 and 8
+    BTNonLeafNode root(1024);
+    PageId pid;
+    rc = root.initializeRoot(10, 5, 20);
+    if (rc == 0) {
+        rc = root.insert(8, 30);
+    }
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+    // A search key and the child that each lookup should follow
+    struct { int key; bool first; PageId child; } lookups[] = {
+        { 5, false, 20 }, { 5, true, 10 }, { 4, true, 10 },
+        { 6, true, 20 }, { 8, true, 20 }, { 9, true, 30 }
+    };
+    for (unsigned i = 0; i < sizeof(lookups) / sizeof(lookups[0]); i++) {
+        rc = lookups[i].first ? root.locateFirstChildPtr(lookups[i].key, pid)
+                              : root.locateChildPtr(lookups[i].key, pid);
+        if (rc < 0 || pid != lookups[i].child) {
+            assert(0);
+            return -1;
+        }
+    }
+    return 0;
+}
+
 void nonLeafNodeTest(PageFile nf) {
     /// TESTING FOR NON-LEAF FILE
 
@@ -133,10 +432,9 @@ void nonLeafNodeTest(PageFile nf) {
     } nonLeafEntry;
 
     nonLeafEntry inserted2; 
-    int offset2 = sizeof(int) + sizeof(PageId);
     PageId first_pageid;
     memcpy(&first_pageid, &buffer2[sizeof(int)], sizeof(PageId));
-    memcpy(&inserted2, &buffer2[offset2], sizeof(nonLeafEntry));
+    readNonLeafEntry(buffer2, 0, inserted2.key, inserted2.pid);
     assert(first_pageid == 2);
     assert(inserted2.key == 10);
     assert(inserted2.pid == 1); 
@@ -148,22 +446,22 @@ void nonLeafNodeTest(PageFile nf) {
     pid1 = 3; 
 
     // Compute before insertion, as this key is being added in
-    int insertPoint = offset2 + (nonleafNode.getKeyCount() * sizeof(nonLeafEntry));
+    int insertPoint = nonleafNode.getKeyCount();
     assert(nonleafNode.insert(key1, pid1) == 0);
     nonleafNode.write(0, nf);
     nf.read(0, buffer2);
-    memcpy(&inserted2, &buffer2[insertPoint], sizeof(nonLeafEntry));
+    readNonLeafEntry(buffer2, insertPoint, inserted2.key, inserted2.pid);
     assert(inserted2.key == 15);
     assert(inserted2.pid == 3);
 
     // // This key should go between the previous two: 10, 12, 15
     key1 = 12; 
     pid1 = 4; 
-    insertPoint = offset2 + (sizeof(nonLeafEntry));
+    insertPoint = 1;
     assert(nonleafNode.insert(key1, pid1) == 0);
     nonleafNode.write(0, nf);
     nf.read(0, buffer2);
-    memcpy(&inserted2, &buffer2[insertPoint], sizeof(nonLeafEntry));
+    readNonLeafEntry(buffer2, insertPoint, inserted2.key, inserted2.pid);
     // DEBUG
     // printf("Key at second entry: %d\n", inserted.key);
     assert(inserted2.key == 12);
@@ -189,11 +487,11 @@ void nonLeafNodeTest(PageFile nf) {
     // // This negative key should go first: -1, 10, 12, 15
     key1 = -1; 
     pid1 = 5; 
-    insertPoint = offset2;
+    insertPoint = 0;
     assert(nonleafNode.insert(key1, pid1) == 0);
     nonleafNode.write(0, nf);
     nf.read(0, buffer2);
-    memcpy(&inserted2, &buffer2[insertPoint], sizeof(nonLeafEntry));
+    readNonLeafEntry(buffer2, insertPoint, inserted2.key, inserted2.pid);
     // DEBUG
     // printf("Key at second entry: %d\n", inserted.key);
     assert(inserted2.key == -1);
@@ -212,14 +510,14 @@ void nonLeafNodeTest(PageFile nf) {
     int manyInsertPoint = 0;
     nonLeafEntry manyInserted;
     for (int i = 0; i < 66; i++) {
-        manyInsertPoint = offset2 + (nonleafNode.getKeyCount() * sizeof(nonLeafEntry));
+        manyInsertPoint = nonleafNode.getKeyCount();
         assert(nonleafNode.insert(manyKey, manyPID) == 0);
         // Update PageFile with latest node contents
         nonleafNode.write(0, nf);
         nf.read(0, buffer2);
 
         // Check inserted key
-        memcpy(&manyInserted, &buffer2[manyInsertPoint], sizeof(nonLeafEntry));
+        readNonLeafEntry(buffer2, manyInsertPoint, manyInserted.key, manyInserted.pid);
         assert(manyInserted.key == manyKey);
         manyKey++;
         manyPID++;
@@ -315,6 +613,12 @@ void nonLeafNodeTest(PageFile nf) {
 int main() 
 {
     /// TESTING: Initial BTLeafNode state and getter/setter functions
+    // The buffers below are 1KB, so the test files get 1KB pages
+    // and are created from scratch
+    PageFile::setDefaultPageSize(PageFile::LEGACY_PAGE_SIZE);
+    remove("node-test.txt");
+    remove("nonleaf-node-test.txt");
+
     // Create PageFile that will store a leaf node
     PageFile pf("node-test.txt", 'w');
     assert(pf.getPageReadCount() == 0);
@@ -389,8 +693,7 @@ int main()
     } LeafEntry;
 
     LeafEntry inserted; 
-    int offset = sizeof(int) + sizeof(PageId);
-    memcpy(&inserted, &buffer[offset], sizeof(LeafEntry));
+    readLeafEntry(buffer, 0, inserted.key, inserted.rid);
     assert(inserted.key == 10);
     assert(inserted.rid.pid == 1); 
     assert(inserted.rid.sid == 0);
@@ -400,11 +703,11 @@ int main()
     rid.pid = 2; 
     rid.sid = 3;
     // Compute before insertion, as this key is being added in
-    int insertPoint = offset + (leafNode.getKeyCount() * sizeof(LeafEntry));
+    int insertPoint = leafNode.getKeyCount();
     assert(leafNode.insert(key, rid) == 0);
     leafNode.write(0, pf);
     pf.read(0, buffer);
-    memcpy(&inserted, &buffer[insertPoint], sizeof(LeafEntry));
+    readLeafEntry(buffer, insertPoint, inserted.key, inserted.rid);
     assert(inserted.key == 15);
     assert(inserted.rid.pid == 2);
     assert(inserted.rid.sid == 3);
@@ -413,11 +716,11 @@ int main()
     key = 12; 
     rid.pid = 4; 
     rid.sid = 5;
-    insertPoint = offset + (1 * sizeof(LeafEntry));
+    insertPoint = 1;
     assert(leafNode.insert(key, rid) == 0);
     leafNode.write(0, pf);
     pf.read(0, buffer);
-    memcpy(&inserted, &buffer[insertPoint], sizeof(LeafEntry));
+    readLeafEntry(buffer, insertPoint, inserted.key, inserted.rid);
     // DEBUG
     // printf("Key at second entry: %d\n", inserted.key);
     assert(inserted.key == 12);
@@ -428,11 +731,11 @@ int main()
     key = -1; 
     rid.pid = 5; 
     rid.sid = 6;
-    insertPoint = offset;
+    insertPoint = 0;
     assert(leafNode.insert(key, rid) == 0);
     leafNode.write(0, pf);
     pf.read(0, buffer);
-    memcpy(&inserted, &buffer[insertPoint], sizeof(LeafEntry));
+    readLeafEntry(buffer, insertPoint, inserted.key, inserted.rid);
     // DEBUG
     // printf("Key at second entry: %d\n", inserted.key);
     assert(inserted.key == -1);
@@ -449,14 +752,14 @@ int main()
     int manyInsertPoint = 0;
     LeafEntry manyInserted;
     for (int i = 0; i < 67; i++) {
-        manyInsertPoint = offset + (leafNode.getKeyCount() * sizeof(LeafEntry));
+        manyInsertPoint = leafNode.getKeyCount();
         assert(leafNode.insert(manyKey, manyRID) == 0);
         // Update PageFile with latest node contents
         leafNode.write(0, pf);
         pf.read(0, buffer);
 
         // Check inserted key
-        memcpy(&manyInserted, &buffer[manyInsertPoint], sizeof(LeafEntry));
+        readLeafEntry(buffer, manyInsertPoint, manyInserted.key, manyInserted.rid);
         assert(manyInserted.key == manyKey);
         manyKey++;
         manyRID.pid++;
@@ -581,6 +884,22 @@ int main()
     // Create PageFile that will store a non leaf node
 
     nonLeafNodeTest(nf);
+
+    // Not else-if or return 1, as we want to see all failures
+    int rc1 = keySearchTest();
+    if (rc1 < 0) {
+        printf("keySearchTest FAILED with error: %d\n", rc1);
+    }
+
+    int rc2 = packedLeafTest();
+    if (rc2 < 0) {
+        printf("packedLeafTest FAILED with error: %d\n", rc2);
+    }
+
+    int rc3 = duplicateKeyNodeTest();
+    if (rc3 < 0) {
+        printf("duplicateKeyNodeTest FAILED with error: %d\n", rc3);
+    }
     pf.close();
     return 0;
 }
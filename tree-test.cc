@@ -2,14 +2,19 @@
 // main() will then display all failed unit-tests
 #define NDEBUG
 #include <cassert>
+#include <climits>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include "Bruinbase.h"
 #include "RecordFile.h"
 #include "PageFile.h"
 #include "BTreeIndex.h"
+#include "BTree.h"
 
 // Encapsulate everything into test functions
 // for ease of abstracting and checking I/O
@@ -29,6 +34,25 @@ int insertAndLocateTest(const std::string& filename);
 // Check readForward()
 int readForwardTest(const std::string& filename);
 
+// Check insert() and readForward() of (key, value) tuples
+int organizedTest(const std::string& filename);
+
+// Check updateRids()
+int updateRidsTest(const std::string& filename);
+
+// Keys in ascending order leave the leaves as full as the fill factor
+int appendSplitTest(const std::string& filename);
+
+// Check insert(), locate() and readForward() of keys inserted many times
+int duplicateKeyTest(const std::string& filename);
+
+// Check BTree with 64-bit and string keys
+int templateTreeTest(const std::string& filename);
+
+// Check removing the records of a table and vacuuming it,
+// and the index of the table after that
+int vacuumTest(const std::string& table);
+
 int main()
 {
     const std::string filename = "tree-test.txt";
@@ -64,8 +88,45 @@ int main()
         printf("readForwardTest FAILED with error: %d\n", rc5);
     }
 
+    // An index-organized table keeps tuples in its leaves instead
+    int rc6 = organizedTest("organized-test.txt");
+    if (rc6 < 0) {
+        printf("organizedTest FAILED with error: %d\n", rc6);
+    }
+
+    // The RecordIds of an index move along with the records
+    int rc7 = updateRidsTest("update-test.txt");
+    if (rc7 < 0) {
+        printf("updateRidsTest FAILED with error: %d\n", rc7);
+    }
+
+    // A sorted load should not leave the leaves half empty
+    int rc8 = appendSplitTest("append-test.txt");
+    if (rc8 < 0) {
+        printf("appendSplitTest FAILED with error: %d\n", rc8);
+    }
+
+    // A key may be inserted any number of times
+    int rc9 = duplicateKeyTest("duplicate-test.txt");
+    if (rc9 < 0) {
+        printf("duplicateKeyTest FAILED with error: %d\n", rc9);
+    }
+
+    // Keys of other types go in a BTree
+    int rc10 = templateTreeTest("template-test.txt");
+    if (rc10 < 0) {
+        printf("templateTreeTest FAILED with error: %d\n", rc10);
+    }
+
+    // Tables are rewritten without their removed records
+    int rc11 = vacuumTest("vacuum-test");
+    if (rc11 < 0) {
+        printf("vacuumTest FAILED with error: %d\n", rc11);
+    }
+
     // Write this only once and break only once: after all tests have run
-    if (rc1 < 0 || rc2 < 0 || rc3 < 0 || rc4 < 0 || rc5 < 0) {
+    if (rc1 < 0 || rc2 < 0 || rc3 < 0 || rc4 < 0 || rc5 < 0 || rc6 < 0 || rc7 < 0 || rc8 < 0 ||
+        rc9 < 0 || rc10 < 0 || rc11 < 0) {
         // See: https://stackoverflow.com/questions/18840422/do-negative-numbers-return-false-in-c-c
         // "A zero value, null pointer value, or null member pointer value is
         // converted to false; any other value is converted to true."
@@ -312,3 +373,712 @@ int readForwardTest(const std::string& filename)
 
     return 0;
 }
+
+// The record numbered n of a table is at (n / 40, n % 40)
+static RecordId ridOf(int n)
+{
+    RecordId rid;
+    rid.pid = n / 40;
+    rid.sid = n % 40;
+    return rid;
+}
+
+// The key numbered n
+static int keyOf(int n)
+{
+    return n;
+}
+
+// Insert count entries into an open index, out of order: the n'th
+// entry has the key makeKey(n) and the value makeValue(n)
+template <class Index, class Key, class Value>
+static int insertShuffled(Index& index, int count, Key (*makeKey)(int), Value (*makeValue)(int))
+{
+    for (int i = 0; i < count; i++) {
+        int n = (int) (((long long) i * 7919) % count);
+        int rc = index.insert(makeKey(n), makeValue(n));
+        if (rc < 0) {
+            return rc;
+        }
+    }
+    return 0;
+}
+
+// Close an index and open it again for reading
+template <class Index>
+static int reopenForRead(Index& index, const std::string& filename)
+{
+    int rc = index.close();
+    if (rc < 0) {
+        return rc;
+    }
+    return index.open(filename, 'r');
+}
+
+// Read an index from the first entry of the key first to the end, and
+// check that the keys come in order and that check(key, value) holds
+// for every entry. Returns the number of entries, or -1.
+template <class Value, class Index, class Key, class Check>
+static int walkFrom(Index& index, const Key& first, Check& check)
+{
+    IndexCursor cursor;
+    index.locate(first, cursor);
+    Key key;
+    Key last = first;
+    Value value;
+    int count = 0;
+    int rc;
+    while ((rc = index.readForward(cursor, key, value)) == 0) {
+        if (key < last || !check(key, value)) {
+            return -1;
+        }
+        last = key;
+        count++;
+    }
+    return (rc == RC_END_OF_TREE) ? count : -1;
+}
+
+// The tuple of the key n in organizedTest(): n in n % 90 + 1 digits
+static std::string tupleOf(int n)
+{
+    char value[RecordFile::MAX_VALUE_LENGTH];
+    int length = snprintf(value, sizeof(value), "%0*d", n % 90 + 1, n);
+    return std::string(value, length);
+}
+
+// Checks that the keys come one after another from next on,
+// each with the tuple of its key
+struct NextTuple {
+    int next;
+
+    bool operator()(int key, const std::string& tuple)
+    {
+        return key == next++ && tuple == tupleOf(key);
+    }
+};
+
+// The key of every third tuple in organizedTest()
+static const int HOT_TUPLE_KEY = 7;
+
+// The key of the tuple of row n in organizedTest(), out of order
+static int hotKeyOf(int n)
+{
+    return (n % 3 == 0) ? HOT_TUPLE_KEY : (n * 37) % 300;
+}
+
+// Checks that a tuple is the one of a row of its key
+static bool isTupleOfKey(int key, const std::string& tuple)
+{
+    int n = atoi(tuple.c_str());
+    return tuple == tupleOf(n) && key == hotKeyOf(n);
+}
+
+int organizedTest(const std::string& filename)
+{
+    BTreeIndex indexTree;
+    remove(filename.c_str());
+    int rc = indexTree.open(filename, 'w', true);
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+    if (!indexTree.holdsTuples()) {
+        assert(0);
+        return -1;
+    }
+
+    // Enough tuples of differing lengths to split leaves and the root,
+    // inserted out of order
+    const int count = 2000;
+    rc = insertShuffled(indexTree, count, keyOf, tupleOf);
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+
+    // RecordIds have no place in these leaves
+    if (indexTree.insert(count, ridOf(0)) != RC_INVALID_FILE_FORMAT) {
+        assert(0);
+        return -1;
+    }
+
+    // Reopened, a walk from a key in the middle gives the rest in order
+    rc = reopenForRead(indexTree, filename);
+    if (rc < 0 || !indexTree.holdsTuples()) {
+        assert(0);
+        return -1;
+    }
+
+    NextTuple check = { count / 2 };
+    if (walkFrom<std::string>(indexTree, count / 2, check) != count - count / 2) {
+        assert(0);
+        return -1;
+    }
+
+    rc = indexTree.close();
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+
+    // Every third tuple has the same key, which then spans many leaves,
+    // and the others have keys on both sides of it, out of order. Each
+    // tuple is found, in key order, and the lookup of that key finds
+    // all of its tuples. Small pages give the key many separators.
+    remove(filename.c_str());
+    int pageSize = PageFile::getDefaultPageSize();
+    PageFile::setDefaultPageSize(PageFile::LEGACY_PAGE_SIZE);
+    rc = indexTree.open(filename, 'w', true);
+    PageFile::setDefaultPageSize(pageSize);
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+    const int rows = 6000;
+    int hotRows = 0;
+    for (int n = 0; n < rows; n++) {
+        int key = hotKeyOf(n);
+        if (key == HOT_TUPLE_KEY) {
+            hotRows++;
+        }
+        rc = indexTree.insert(key, tupleOf(n));
+        if (rc < 0) {
+            assert(0);
+            return rc;
+        }
+    }
+    rc = reopenForRead(indexTree, filename);
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+
+    if (walkFrom<std::string>(indexTree, INT_MIN, isTupleOfKey) != rows) {
+        assert(0);
+        return -1;
+    }
+    IndexCursor cursor;
+    int key;
+    std::string tuple;
+    int hot = 0;
+    indexTree.locate(HOT_TUPLE_KEY, cursor);
+    while (indexTree.readForward(cursor, key, tuple) == 0 && key == HOT_TUPLE_KEY) {
+        hot++;
+    }
+    if (hot != hotRows) {
+        assert(0);
+        return -1;
+    }
+
+    rc = indexTree.close();
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+
+    return 0;
+}
+
+// Moves every record to the page 1000 pages further,
+// and drops the records whose keys are multiples of 3
+static bool moveRid(RecordId& rid, void* arg)
+{
+    int perPage = *(int*) arg;
+    if ((rid.pid * perPage + rid.sid) % 3 == 0) {
+        return false;
+    }
+    rid.pid += 1000;
+    return true;
+}
+
+// Checks that the keys that moveRid() keeps come one after another
+// from next on, each with the RecordId of its record, moved
+struct NextMovedRid {
+    int next;
+
+    bool operator()(int key, const RecordId& rid)
+    {
+        bool found = (key == next && rid.pid == ridOf(key).pid + 1000 &&
+                      rid.sid == ridOf(key).sid);
+        next += (next % 3 == 1) ? 1 : 2;
+        return found;
+    }
+};
+
+int updateRidsTest(const std::string& filename)
+{
+    BTreeIndex indexTree;
+    remove(filename.c_str());
+    int rc = indexTree.open(filename, 'w');
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+
+    // Enough entries to split leaves, inserted out of order,
+    // each with the RecordId of a record numbered by its key
+    const int count = 2000;
+    int perPage = 40;
+    rc = insertShuffled(indexTree, count, keyOf, ridOf);
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+
+    rc = indexTree.updateRids(moveRid, &perPage);
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+
+    // Reopened, the index has the entries that were kept, in order
+    rc = reopenForRead(indexTree, filename);
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+
+    NextMovedRid check = { 1 };
+    if (walkFrom<RecordId>(indexTree, INT_MIN, check) < 0 || check.next < count) {
+        assert(0);
+        return -1;
+    }
+
+    rc = indexTree.close();
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+
+    return 0;
+}
+
+// Insert count ascending keys with the given fill factor,
+// and count the leaves that they end up in
+static int countLeavesAfterAppends(const std::string& filename, int fillFactor, int count)
+{
+    BTreeIndex indexTree;
+    remove(filename.c_str());
+    BTreeIndex::setFillFactor(fillFactor);
+    int rc = indexTree.open(filename, 'w');
+    if (rc < 0) {
+        return rc;
+    }
+
+    RecordId rid;
+    for (int key = 0; key < count; key++) {
+        rid.pid = key / 40;
+        rid.sid = key % 40;
+        if ((rc = indexTree.insert(key, rid)) < 0) {
+            return rc;
+        }
+    }
+
+    // Every key is there, in order, and the leaves are counted
+    // as the cursor moves on to each one
+    IndexCursor cursor;
+    indexTree.locate(INT_MIN, cursor);
+    int key;
+    int expected = 0;
+    int leaves = 0;
+    PageId leaf = -1;
+    while (cursor.pid > 0) {
+        if (cursor.pid != leaf) {
+            leaf = cursor.pid;
+            leaves++;
+        }
+        if ((rc = indexTree.readForward(cursor, key, rid)) < 0) {
+            break;
+        }
+        if (key != expected || rid.pid != key / 40 || rid.sid != key % 40) {
+            return -1;
+        }
+        expected++;
+    }
+    if (expected != count) {
+        return -1;
+    }
+
+    rc = indexTree.close();
+    if (rc < 0) {
+        return rc;
+    }
+    return leaves;
+}
+
+int appendSplitTest(const std::string& filename)
+{
+    const int count = 20000;
+
+    int halves = countLeavesAfterAppends(filename, 50, count);
+    int full = countLeavesAfterAppends(filename, 100, count);
+    int ninety = countLeavesAfterAppends(filename, BTreeIndex::DEFAULT_FILL_FACTOR, count);
+    BTreeIndex::setFillFactor(BTreeIndex::DEFAULT_FILL_FACTOR);
+    if (halves < 0 || full < 0 || ninety < 0) {
+        assert(0);
+        return -1;
+    }
+
+    // Half-full leaves take about twice as many
+    if (full * 3 > halves * 2 || ninety < full || ninety * 3 > halves * 2) {
+        assert(0);
+        return -1;
+    }
+
+    // Out of range fill factors are turned down
+    if (BTreeIndex::setFillFactor(49) != RC_INVALID_ATTRIBUTE ||
+        BTreeIndex::setFillFactor(101) != RC_INVALID_ATTRIBUTE ||
+        BTreeIndex::getFillFactor() != BTreeIndex::DEFAULT_FILL_FACTOR) {
+        assert(0);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Read the entries of a key from where locate() puts the cursor, and
+// check that they are the records of the key that are expected: those
+// that moveRid() keeps if moved, with their pids moved as well.
+// Record i of the table is at (i / perPage, i % perPage).
+// Returns the number of leaves the cursor went through, or -1.
+static int checkKey(BTreeIndex& indexTree, int searchKey, const std::vector<int>& records,
+                    int perPage, bool moved)
+{
+    std::vector<int> expected;
+    for (unsigned i = 0; i < records.size(); i++) {
+        if (!moved || records[i] % 3 != 0) {
+            expected.push_back(records[i]);
+        }
+    }
+
+    IndexCursor cursor;
+    indexTree.locate(searchKey, cursor);
+    std::vector<int> found;
+    int leaves = 0;
+    PageId leaf = -1;
+    int key;
+    RecordId rid;
+    while (true) {
+        PageId pid = cursor.pid;
+        if (indexTree.readForward(cursor, key, rid) < 0 || key != searchKey) {
+            break;
+        }
+        if (pid != leaf) {
+            leaf = pid;
+            leaves++;
+        }
+        found.push_back((rid.pid - (moved ? 1000 : 0)) * perPage + rid.sid);
+    }
+
+    std::sort(expected.begin(), expected.end());
+    std::sort(found.begin(), found.end());
+    return (found == expected) ? leaves : -1;
+}
+
+int duplicateKeyTest(const std::string& filename)
+{
+    BTreeIndex indexTree;
+    remove(filename.c_str());
+    int rc = indexTree.open(filename, 'w');
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+
+    // Each of the even keys below 2 * keys is inserted copies times,
+    // out of order, and a hot key in between as often as all of them
+    const int keys = 150;
+    const int copies = 20;
+    const int hotKey = 75;
+    int perPage = 40;
+    std::vector<std::vector<int> > records(keys);
+    std::vector<int> hotRecords;
+    int record = 0;
+    RecordId rid;
+    for (int i = 0; i < keys * copies; i++) {
+        int k = (i * 7) % keys;
+        rid.pid = record / perPage;
+        rid.sid = record % perPage;
+        records[k].push_back(record++);
+        if ((rc = indexTree.insert(2 * k, rid)) < 0) {
+            assert(0);
+            return rc;
+        }
+
+        rid.pid = record / perPage;
+        rid.sid = record % perPage;
+        hotRecords.push_back(record++);
+        if ((rc = indexTree.insert(hotKey, rid)) < 0) {
+            assert(0);
+            return rc;
+        }
+    }
+
+    // Every entry of a key is found, and those of the hot key
+    // without going from leaf to leaf
+    for (int moved = 0; moved <= 1; moved++) {
+        for (int k = 0; k < keys; k++) {
+            if (checkKey(indexTree, 2 * k, records[k], perPage, moved) < 0) {
+                assert(0);
+                return -1;
+            }
+        }
+        if (checkKey(indexTree, hotKey, hotRecords, perPage, moved) != 1) {
+            assert(0);
+            return -1;
+        }
+
+        // The hot key keeps its RecordIds as they move, after it
+        // is read from the disk again
+        if (!moved) {
+            if ((rc = indexTree.updateRids(moveRid, &perPage)) < 0 ||
+                (rc = indexTree.close()) < 0 ||
+                (rc = indexTree.open(filename, 'r')) < 0) {
+                assert(0);
+                return rc;
+            }
+        }
+    }
+
+    rc = indexTree.close();
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+
+    return 0;
+}
+
+// Checks that a key is the key of the entry whose RecordId it has
+template <class Key>
+struct SameKeyAsRid {
+    Key (*makeKey)(int);
+    int count;
+
+    bool operator()(const Key& key, const RecordId& rid)
+    {
+        int n = rid.pid * 40 + rid.sid;
+        return n >= 0 && n < count && !(key < makeKey(n)) && !(makeKey(n) < key);
+    }
+};
+
+// Insert count entries into a BTree out of order, with the keys that
+// makeKey() makes. Every key is then found, and the entries are read
+// back in order.
+template <class Key, int PageSize>
+static int checkTemplateTree(const std::string& filename, Key (*makeKey)(int), int count)
+{
+    BTree<Key, PageSize> tree;
+    remove(filename.c_str());
+    int rc = tree.open(filename, 'w');
+    if (rc < 0) {
+        return rc;
+    }
+    if ((rc = insertShuffled(tree, count, makeKey, ridOf)) < 0) {
+        return rc;
+    }
+    if (tree.getTreeHeight() < 1 || reopenForRead(tree, filename) < 0) {
+        return -1;
+    }
+
+    SameKeyAsRid<Key> check = { makeKey, count };
+    IndexCursor cursor;
+    Key key;
+    RecordId rid;
+    for (int n = 0; n < count; n++) {
+        if (tree.locate(makeKey(n), cursor) != 0 ||
+            tree.readForward(cursor, key, rid) != 0 || !check(key, rid) ||
+            makeKey(n) < key || key < makeKey(n)) {
+            return -1;
+        }
+    }
+    if (walkFrom<RecordId>(tree, makeKey(0), check) != count) {
+        return -1;
+    }
+
+    return tree.close();
+}
+
+// 64-bit keys past the range of an int, two entries each
+static int64_t makeLongKey(int n)
+{
+    return (int64_t) (n / 2) * 1000000007LL - 5000000000LL;
+}
+
+// String keys that sort as the numbers they are made of, two entries each
+static FixedString<16> makeStringKey(int n)
+{
+    char s[17];
+    sprintf(s, "key%08d", n / 2);
+    return FixedString<16>(s);
+}
+
+int templateTreeTest(const std::string& filename)
+{
+    int rc = checkTemplateTree<int64_t, 4096>(filename, makeLongKey, 5000);
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+    rc = checkTemplateTree<FixedString<16>, 8192>(filename, makeStringKey, 5000);
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+
+    // A file of one kind of tree is not opened as another
+    BTree<int64_t, 4096> longTree;
+    BTreeIndex index;
+    if (longTree.open(filename, 'r') != RC_INVALID_FILE_FORMAT ||
+        index.open(filename, 'r') != RC_INVALID_FILE_FORMAT) {
+        assert(0);
+        return -1;
+    }
+
+    // Keys compare by their characters, and longer ones are cut off
+    if (!(FixedString<4>("abc") < FixedString<4>("abd")) ||
+        FixedString<4>("abcdef").str() != "abcd" || FixedString<4>("ab").str() != "ab") {
+        assert(0);
+        return -1;
+    }
+
+    return 0;
+}
+
+// The value of the record numbered n in vacuumTest(). There are few
+// distinct values, as in the tables that are dictionary-encoded.
+static std::string valueOf(int n)
+{
+    char value[32];
+    snprintf(value, sizeof(value), "value %d", n % 50);
+    return value;
+}
+
+// Gives the RecordId that RecordFile::vacuum() moved a record to,
+// or false if the record had been removed, as SqlEngine::vacuum() does
+static bool vacuumedRid(RecordId& rid, void* arg)
+{
+    const std::vector<std::vector<RecordId> >& moved =
+        *(const std::vector<std::vector<RecordId> >*) arg;
+
+    if (rid.pid < 0 || rid.pid >= (int) moved.size() ||
+        rid.sid < 0 || rid.sid >= (int) moved[rid.pid].size()) {
+        return false;
+    }
+    rid = moved[rid.pid][rid.sid];
+    return rid.pid >= 0;
+}
+
+// Checks that the keys that are not multiples of 3 come one after
+// another from next on, each with the RecordId of its record in rf
+struct NextVacuumedRecord {
+    RecordFile* rf;
+    int next;
+
+    bool operator()(int key, const RecordId& rid)
+    {
+        int storedKey;
+        std::string value;
+        bool found = (key == next && rf->read(rid, storedKey, value) == 0 &&
+                      storedKey == key && value == valueOf(key));
+        next += (next % 3 == 1) ? 1 : 2;
+        return found;
+    }
+};
+
+// Load a table and its index, remove the records whose keys are
+// multiples of 3, and vacuum the table. The records that are left
+// are then found, both in the table and through the index.
+static int checkVacuum(const std::string& table, bool compress, RecordFile::Encoding encoding)
+{
+    RecordFile rf;
+    BTreeIndex indexTree;
+    remove((table + ".tbl").c_str());
+    remove((table + ".idx").c_str());
+    int rc;
+    if ((rc = rf.open(table + ".tbl", 'w', RecordFile::ROW, compress, encoding)) < 0 ||
+        (rc = indexTree.open(table + ".idx", 'w')) < 0) {
+        return rc;
+    }
+
+    const int count = 3000;
+    std::vector<RecordId> rids(count);
+    for (int n = 0; n < count; n++) {
+        if ((rc = rf.append(n, valueOf(n), rids[n])) < 0 ||
+            (rc = indexTree.insert(n, rids[n])) < 0) {
+            return rc;
+        }
+    }
+    for (int n = 0; n < count; n += 3) {
+        if ((rc = rf.remove(rids[n])) < 0) {
+            return rc;
+        }
+    }
+
+    // A removed record is gone, and cannot be removed again
+    int key;
+    std::string value;
+    if (!rf.hasRemoved() || rf.read(rids[0], key, value) != RC_NO_SUCH_RECORD ||
+        rf.remove(rids[0]) != RC_NO_SUCH_RECORD || rf.read(rids[1], key, value) != 0) {
+        return -1;
+    }
+    if ((rc = rf.close()) < 0) {
+        return rc;
+    }
+
+    std::vector<std::vector<RecordId> > moved;
+    if ((rc = RecordFile::vacuum(table + ".tbl", moved)) < 0 ||
+        (rc = indexTree.updateRids(vacuumedRid, &moved)) < 0) {
+        return rc;
+    }
+    if (moved.empty() || (rc = reopenForRead(indexTree, table + ".idx")) < 0 ||
+        (rc = rf.open(table + ".tbl", 'r')) < 0) {
+        return -1;
+    }
+
+    // The table holds only the records that are left, and the index
+    // leads to each of them
+    int left = 0;
+    RecordId rid;
+    rid.pid = 0;
+    rid.sid = 0;
+    for (; rid < rf.endRid(); rf.next(rid)) {
+        if (rf.read(rid, key, value) != 0 || key % 3 == 0 || value != valueOf(key)) {
+            return -1;
+        }
+        left++;
+    }
+    NextVacuumedRecord check = { &rf, 1 };
+    if (rf.hasRemoved() || left != count - (count + 2) / 3 ||
+        walkFrom<RecordId>(indexTree, INT_MIN, check) != left || check.next < count) {
+        return -1;
+    }
+
+    if ((rc = rf.close()) < 0) {
+        return rc;
+    }
+    return indexTree.close();
+}
+
+int vacuumTest(const std::string& table)
+{
+    // Tables of plain values, of compressed pages, and of
+    // dictionary-encoded values
+    int rc = checkVacuum(table, false, RecordFile::PLAIN);
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+    rc = checkVacuum(table, true, RecordFile::PLAIN);
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+    rc = checkVacuum(table, false, RecordFile::DICTIONARY);
+    if (rc < 0) {
+        assert(0);
+        return rc;
+    }
+
+    return 0;
+}